@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+// Every allocation is aligned like malloc's.
+#define ARENA_ALIGNMENT (_Alignof(max_align_t))
+
+Arena *create_arena(const char *name)
+{
+    Arena *arena = (Arena *)malloc(sizeof(Arena));
+    if (arena == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for Arena.\n");
+        exit(EXIT_FAILURE);
+    }
+    arena->name = name;
+    arena->head = NULL;
+    arena->bytes_used = 0;
+    arena->chunk_count = 0;
+    return arena;
+}
+
+static ArenaChunk *arena_add_chunk(Arena *arena, size_t size)
+{
+    ArenaChunk *chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + size);
+    if (chunk == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for ArenaChunk.\n");
+        exit(EXIT_FAILURE);
+    }
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = arena->head;
+    arena->head = chunk;
+    arena->chunk_count++;
+    return chunk;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    ArenaChunk *chunk = arena->head;
+    if (chunk == NULL || chunk->size - chunk->used < size)
+    {
+        chunk = arena_add_chunk(arena, size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->bytes_used += size;
+    return ptr;
+}
+
+// Copies len bytes of str into the arena and NUL terminates them.
+char *arena_strndup(Arena *arena, const char *str, size_t len)
+{
+    char *copy = (char *)arena_alloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// Releases every allocation at once. The arena can be used again afterwards.
+void arena_reset(Arena *arena)
+{
+    ArenaChunk *chunk = arena->head;
+    while (chunk)
+    {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->bytes_used = 0;
+    arena->chunk_count = 0;
+}
+
+// Releases every allocation like arena_reset(), but keeps the oldest chunk
+// for the next allocations. Meant for arenas that are emptied very often.
+void arena_clear(Arena *arena)
+{
+    ArenaChunk *chunk = arena->head;
+    while (chunk && chunk->next)
+    {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = chunk;
+    arena->bytes_used = 0;
+    arena->chunk_count = chunk ? 1 : 0;
+    if (chunk)
+    {
+        chunk->used = 0;
+    }
+}
+
+// Returns whether ptr points into memory handed out by the arena.
+int arena_contains(Arena *arena, const void *ptr)
+{
+    const char *address = (const char *)ptr;
+    for (ArenaChunk *chunk = arena->head; chunk; chunk = chunk->next)
+    {
+        if (address >= chunk->data && address < chunk->data + chunk->used)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void free_arena(Arena *arena)
+{
+    arena_reset(arena);
+    free(arena);
+}
+
+void print_arena_stats(Arena *arena)
+{
+    fprintf(stderr, "Arena %-8s %10zu bytes in %zu chunks\n", arena->name, arena->bytes_used, arena->chunk_count);
+}
@@ -0,0 +1,38 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Default size of an arena chunk. Larger allocations get a chunk of their own.
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct ArenaChunk
+{
+    struct ArenaChunk *next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaChunk;
+
+// Arena is a bump-pointer allocator. Allocations cannot be freed one by one,
+// everything is released together by arena_reset() or free_arena().
+typedef struct Arena
+{
+    const char *name;
+    ArenaChunk *head;
+
+    // Counters for --arena-stats.
+    size_t bytes_used;
+    size_t chunk_count;
+} Arena;
+
+Arena *create_arena(const char *name);
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strndup(Arena *arena, const char *str, size_t len);
+void arena_reset(Arena *arena);
+void arena_clear(Arena *arena);
+int arena_contains(Arena *arena, const void *ptr);
+void free_arena(Arena *arena);
+void print_arena_stats(Arena *arena);
+
+#endif // ARENA_H
\ No newline at end of file
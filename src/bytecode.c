@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+
+Chunk *create_chunk(NameTable *names)
+{
+    Chunk *chunk = (Chunk *)malloc(sizeof(Chunk));
+    if (chunk == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for Chunk.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    chunk->code = NULL;
+    chunk->count = 0;
+    chunk->capacity = 0;
+
+    chunk->constants = NULL;
+    chunk->constant_count = 0;
+    chunk->constant_capacity = 0;
+
+    chunk->slot_count = 0;
+    chunk->names = names;
+
+    chunk->jit_sites = NULL;
+    chunk->jit_site_count = 0;
+    chunk->jit_site_capacity = 0;
+
+    return chunk;
+}
+
+void free_chunk(Chunk *chunk)
+{
+    free(chunk->code);
+    free(chunk->constants);
+    free(chunk->jit_sites);
+    free(chunk);
+}
+
+void chunk_write(Chunk *chunk, uint8_t byte)
+{
+    if (chunk->count == chunk->capacity)
+    {
+        chunk->capacity = chunk->capacity < 64 ? 64 : chunk->capacity * 2;
+        chunk->code = (uint8_t *)realloc(chunk->code, chunk->capacity);
+        if (chunk->code == NULL)
+        {
+            fprintf(stderr, "Failed to allocate memory for Chunk->code.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    chunk->code[chunk->count++] = byte;
+}
+
+void chunk_write_short(Chunk *chunk, uint16_t value)
+{
+    chunk_write(chunk, (value >> 8) & 0xff);
+    chunk_write(chunk, value & 0xff);
+}
+
+// Returns the index of the constant, reusing an existing slot when possible.
+int chunk_add_constant(Chunk *chunk, Value value)
+{
+    for (int i = 0; i < chunk->constant_count; i++)
+    {
+        Value constant = chunk->constants[i];
+        if (constant.type != value.type)
+        {
+            continue;
+        }
+        if (constant.type == VAL_INT && constant.as.integer == value.as.integer)
+        {
+            return i;
+        }
+        if (constant.type == VAL_STR && constant.as.string == value.as.string)
+        {
+            return i;
+        }
+    }
+
+    if (chunk->constant_count == chunk->constant_capacity)
+    {
+        chunk->constant_capacity = chunk->constant_capacity < 8 ? 8 : chunk->constant_capacity * 2;
+        chunk->constants = (Value *)realloc(chunk->constants, chunk->constant_capacity * sizeof(Value));
+        if (chunk->constants == NULL)
+        {
+            fprintf(stderr, "Failed to allocate memory for Chunk->constants.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    chunk->constants[chunk->constant_count] = value;
+    return chunk->constant_count++;
+}
+
+int chunk_add_jit_site(Chunk *chunk, JitSite site)
+{
+    if (chunk->jit_site_count == chunk->jit_site_capacity)
+    {
+        chunk->jit_site_capacity = chunk->jit_site_capacity < 8 ? 8 : chunk->jit_site_capacity * 2;
+        chunk->jit_sites = (JitSite *)realloc(chunk->jit_sites, chunk->jit_site_capacity * sizeof(JitSite));
+        if (chunk->jit_sites == NULL)
+        {
+            fprintf(stderr, "Failed to allocate memory for Chunk->jit_sites.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    chunk->jit_sites[chunk->jit_site_count] = site;
+    return chunk->jit_site_count++;
+}
+
+void name_table_set(NameTable *table, int slot, const char *name)
+{
+    if (slot >= table->capacity)
+    {
+        int capacity = table->capacity < 8 ? 8 : table->capacity;
+        while (capacity <= slot)
+        {
+            capacity *= 2;
+        }
+        table->names = (char **)realloc(table->names, capacity * sizeof(char *));
+        if (table->names == NULL)
+        {
+            fprintf(stderr, "Failed to allocate memory for NameTable.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = table->capacity; i < capacity; i++)
+        {
+            table->names[i] = NULL;
+        }
+        table->capacity = capacity;
+    }
+
+    free(table->names[slot]);
+    table->names[slot] = (char *)malloc(strlen(name) + 1);
+    if (table->names[slot] == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for NameTable entry.\n");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(table->names[slot], name);
+    if (slot >= table->count)
+    {
+        table->count = slot + 1;
+    }
+}
+
+const char *opcode_to_string(OpCode op)
+{
+    switch (op)
+    {
+    case OP_CONSTANT:
+        return "OP_CONSTANT";
+    case OP_ADD:
+        return "OP_ADD";
+    case OP_SUBTRACT:
+        return "OP_SUBTRACT";
+    case OP_MULTIPLY:
+        return "OP_MULTIPLY";
+    case OP_DIVIDE:
+        return "OP_DIVIDE";
+    case OP_EQUAL:
+        return "OP_EQUAL";
+    case OP_NOT_EQUAL:
+        return "OP_NOT_EQUAL";
+    case OP_LESS:
+        return "OP_LESS";
+    case OP_LESS_EQUAL:
+        return "OP_LESS_EQUAL";
+    case OP_GREATER:
+        return "OP_GREATER";
+    case OP_GREATER_EQUAL:
+        return "OP_GREATER_EQUAL";
+    case OP_NEGATE:
+        return "OP_NEGATE";
+    case OP_NOT:
+        return "OP_NOT";
+    case OP_GET:
+        return "OP_GET";
+    case OP_SET:
+        return "OP_SET";
+    case OP_APPEND:
+        return "OP_APPEND";
+    case OP_JUMP:
+        return "OP_JUMP";
+    case OP_JUMP_IF_FALSE:
+        return "OP_JUMP_IF_FALSE";
+    case OP_LOOP:
+        return "OP_LOOP";
+    case OP_JIT_LOOP:
+        return "OP_JIT_LOOP";
+    case OP_PRINT:
+        return "OP_PRINT";
+    case OP_HALT:
+        return "OP_HALT";
+    default:
+        return "OP_UNKNOWN";
+    }
+}
+
+static uint16_t read_short(Chunk *chunk, int offset)
+{
+    return (uint16_t)((chunk->code[offset] << 8) | chunk->code[offset + 1]);
+}
+
+// Prints the instruction at offset and returns the offset of the next one.
+int disassemble_instruction(Chunk *chunk, int offset)
+{
+    OpCode op = chunk->code[offset];
+    const char *name = opcode_to_string(op);
+    printf("%04d ", offset);
+
+    switch (op)
+    {
+    case OP_CONSTANT:
+    {
+        uint16_t index = read_short(chunk, offset + 1);
+        Value constant = chunk->constants[index];
+        if (constant.type == VAL_INT)
+        {
+            printf("%-18s %4d '%d'\n", name, index, constant.as.integer);
+        }
+        else
+        {
+            printf("%-18s %4d \"%s\"\n", name, index, constant.as.string);
+        }
+        return offset + 3;
+    }
+    case OP_GET:
+    case OP_SET:
+    {
+        uint16_t slot = read_short(chunk, offset + 1);
+        const char *variable = slot < chunk->names->count ? chunk->names->names[slot] : NULL;
+        printf("%-18s %4d '%s'\n", name, slot, variable ? variable : "?");
+        return offset + 3;
+    }
+    case OP_APPEND:
+    {
+        uint16_t slot = read_short(chunk, offset + 1);
+        uint16_t count = read_short(chunk, offset + 3);
+        const char *variable = slot < chunk->names->count ? chunk->names->names[slot] : NULL;
+        printf("%-18s %4d '%s' (%d values)\n", name, slot, variable ? variable : "?", count);
+        return offset + 5;
+    }
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    {
+        uint16_t jump = read_short(chunk, offset + 1);
+        printf("%-18s %4d -> %04d\n", name, jump, offset + 3 + jump);
+        return offset + 3;
+    }
+    case OP_LOOP:
+    {
+        uint16_t jump = read_short(chunk, offset + 1);
+        printf("%-18s %4d -> %04d\n", name, jump, offset + 3 - jump);
+        return offset + 3;
+    }
+    case OP_JIT_LOOP:
+    {
+        uint16_t index = read_short(chunk, offset + 1);
+        uint16_t jump = read_short(chunk, offset + 3);
+        printf("%-18s %4d -> %04d (%d variables)\n", name, index, offset + 5 + jump,
+               chunk->jit_sites[index].loop->variable_count);
+        return offset + 5;
+    }
+    default:
+        printf("%s\n", name);
+        return offset + 1;
+    }
+}
+
+void disassemble_chunk(Chunk *chunk, const char *title)
+{
+    printf("== %s ==\n", title);
+    for (int offset = 0; offset < chunk->count;)
+    {
+        offset = disassemble_instruction(chunk, offset);
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+
+#include "jit.h"
+#include "value.h"
+
+// Maximum depth of the VM operand stack.
+#define STACK_MAX 256
+
+/**
+ * Instructions are one byte long, followed by their operands.
+ * Every operand is a big-endian 16 bit unsigned integer.
+ *
+ * OP_CONSTANT idx      push constants[idx]
+ * OP_GET slot          push the value of the variable in slot
+ * OP_SET slot          pop a value and store it in slot
+ * OP_APPEND slot n     pop n values and add them in order to the variable
+ *                      in slot, see value_append_all()
+ * OP_JUMP off          ip += off
+ * OP_JUMP_IF_FALSE off pop a value, ip += off if it is false
+ * OP_LOOP off          ip -= off
+ * OP_JIT_LOOP idx off  run the machine code of jit_sites[idx], ip += off if
+ *                      it ran (otherwise the bytecode of the loop follows)
+ */
+typedef enum OpCode
+{
+    OP_CONSTANT,
+
+    // Binary operations
+    OP_ADD,
+    OP_SUBTRACT,
+    OP_MULTIPLY,
+    OP_DIVIDE,
+    OP_EQUAL,
+    OP_NOT_EQUAL,
+    OP_LESS,
+    OP_LESS_EQUAL,
+    OP_GREATER,
+    OP_GREATER_EQUAL,
+
+    // Unary operations
+    OP_NEGATE,
+    OP_NOT,
+
+    // Variables
+    OP_GET,
+    OP_SET,
+    OP_APPEND,
+
+    // Control flow
+    OP_JUMP,
+    OP_JUMP_IF_FALSE,
+    OP_LOOP,
+    OP_JIT_LOOP,
+
+    // Statements
+    OP_PRINT,
+    OP_HALT,
+} OpCode;
+
+// Names of the variables in each VM slot, used by the disassembler.
+typedef struct NameTable
+{
+    char **names;
+    int count;
+    int capacity;
+} NameTable;
+
+// A loop compiled by the JIT and the VM slots of its variables.
+typedef struct JitSite
+{
+    JitLoop *loop;
+    int slots[JIT_MAX_VARIABLES];
+} JitSite;
+
+typedef struct Chunk
+{
+    uint8_t *code;
+    int count;
+    int capacity;
+
+    Value *constants;
+    int constant_count;
+    int constant_capacity;
+
+    // Number of variable slots the chunk uses.
+    int slot_count;
+    NameTable *names;
+
+    JitSite *jit_sites;
+    int jit_site_count;
+    int jit_site_capacity;
+} Chunk;
+
+Chunk *create_chunk(NameTable *names);
+void free_chunk(Chunk *chunk);
+void chunk_write(Chunk *chunk, uint8_t byte);
+void chunk_write_short(Chunk *chunk, uint16_t value);
+int chunk_add_constant(Chunk *chunk, Value value);
+int chunk_add_jit_site(Chunk *chunk, JitSite site);
+
+void name_table_set(NameTable *table, int slot, const char *name);
+
+const char *opcode_to_string(OpCode op);
+int disassemble_instruction(Chunk *chunk, int offset);
+void disassemble_chunk(Chunk *chunk, const char *title);
+
+#endif // BYTECODE_H
\ No newline at end of file
@@ -0,0 +1,651 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "closure.h"
+
+// Expressions
+
+static Value eval_constant(ExprClosure *self, ClosureEngine *engine)
+{
+    return self->constant;
+}
+
+static Value eval_slot(ExprClosure *self, ClosureEngine *engine)
+{
+    return engine->slots[self->slot];
+}
+
+// Slow path of every binary operation: strings, mixed types and errors.
+static Value eval_binary_fallback(ExprClosure *self, ClosureEngine *engine, Value left, Value right)
+{
+    Value result;
+    if (value_binary_op(engine->heap, self->op, left, right, &result) == FAILURE)
+    {
+        engine->failed = 1;
+        return INT_VALUE(0);
+    }
+    return result;
+}
+
+// An operand that failed stops the evaluation, its error is the one reported.
+static Value eval_binary(ExprClosure *self, ClosureEngine *engine)
+{
+    Value left = self->left->eval(self->left, engine);
+    if (engine->failed)
+    {
+        return left;
+    }
+    Value right = self->right->eval(self->right, engine);
+    if (engine->failed)
+    {
+        return right;
+    }
+    return eval_binary_fallback(self, engine, left, right);
+}
+
+// Defines the closures of an integer operation for the operand shapes
+// "slot op constant", "slot op slot" and "expression op expression".
+#define DEFINE_INT_BINARY(name, c_op)                                                \
+    static Value eval_##name##_slot_constant(ExprClosure *self, ClosureEngine *engine) \
+    {                                                                                \
+        Value left = engine->slots[self->slot];                                      \
+        if (left.type == VAL_INT && self->constant.type == VAL_INT)                  \
+        {                                                                            \
+            return INT_VALUE(left.as.integer c_op self->constant.as.integer);        \
+        }                                                                            \
+        return eval_binary_fallback(self, engine, left, self->constant);             \
+    }                                                                                \
+    static Value eval_##name##_slot_slot(ExprClosure *self, ClosureEngine *engine)   \
+    {                                                                                \
+        Value left = engine->slots[self->slot];                                      \
+        Value right = engine->slots[self->right_slot];                               \
+        if (left.type == VAL_INT && right.type == VAL_INT)                           \
+        {                                                                            \
+            return INT_VALUE(left.as.integer c_op right.as.integer);                 \
+        }                                                                            \
+        return eval_binary_fallback(self, engine, left, right);                      \
+    }                                                                                \
+    static Value eval_##name(ExprClosure *self, ClosureEngine *engine)               \
+    {                                                                                \
+        Value left = self->left->eval(self->left, engine);                           \
+        if (engine->failed)                                                          \
+        {                                                                            \
+            return left;                                                             \
+        }                                                                            \
+        Value right = self->right->eval(self->right, engine);                        \
+        if (engine->failed)                                                          \
+        {                                                                            \
+            return right;                                                            \
+        }                                                                            \
+        if (left.type == VAL_INT && right.type == VAL_INT)                           \
+        {                                                                            \
+            return INT_VALUE(left.as.integer c_op right.as.integer);                 \
+        }                                                                            \
+        return eval_binary_fallback(self, engine, left, right);                      \
+    }
+
+DEFINE_INT_BINARY(add, +)
+DEFINE_INT_BINARY(subtract, -)
+DEFINE_INT_BINARY(multiply, *)
+DEFINE_INT_BINARY(equal, ==)
+DEFINE_INT_BINARY(less, <)
+DEFINE_INT_BINARY(less_equal, <=)
+DEFINE_INT_BINARY(greater, >)
+DEFINE_INT_BINARY(greater_equal, >=)
+DEFINE_INT_BINARY(not_equal, !=)
+
+typedef Value (*EvalFunction)(ExprClosure *self, ClosureEngine *engine);
+
+typedef struct BinaryClosures
+{
+    EvalFunction slot_constant;
+    EvalFunction slot_slot;
+    EvalFunction any;
+} BinaryClosures;
+
+// Division has no entry, it always goes through value_binary_op() which
+// reports division by zero.
+#define INT_BINARY_CLOSURES(name) {eval_##name##_slot_constant, eval_##name##_slot_slot, eval_##name}
+static const BinaryClosures int_binary_closures[] = {
+    [ADD] = INT_BINARY_CLOSURES(add),
+    [SUBTRACT] = INT_BINARY_CLOSURES(subtract),
+    [MULTIPLY] = INT_BINARY_CLOSURES(multiply),
+    [IS_EQUAL] = INT_BINARY_CLOSURES(equal),
+    [IS_LESS_THAN] = INT_BINARY_CLOSURES(less),
+    [LESS_THAN_EQUAL] = INT_BINARY_CLOSURES(less_equal),
+    [IS_GREATER_THAN] = INT_BINARY_CLOSURES(greater),
+    [GREATER_THAN_EQUAL] = INT_BINARY_CLOSURES(greater_equal),
+    [IS_NOT_EQUAL] = INT_BINARY_CLOSURES(not_equal),
+};
+
+static Value eval_unary(ExprClosure *self, ClosureEngine *engine)
+{
+    Value right = self->right->eval(self->right, engine);
+    if (engine->failed)
+    {
+        return right;
+    }
+    Value result;
+    if (value_unary_op(self->unary_op, right, &result) == FAILURE)
+    {
+        engine->failed = 1;
+        return INT_VALUE(0);
+    }
+    return result;
+}
+
+// Statements
+
+static int exec_set(StmtClosure *self, ClosureEngine *engine)
+{
+    Value value = self->expression->eval(self->expression, engine);
+    if (engine->failed)
+    {
+        return FAILURE;
+    }
+    engine->slots[self->slot] = value;
+    if (value.type == VAL_STR)
+    {
+        string_store(value.as.string, &engine->slots[self->slot]);
+    }
+    return SUCCESS;
+}
+
+// "s = s + x": expression is x.
+static int exec_append(StmtClosure *self, ClosureEngine *engine)
+{
+    Value right = self->expression->eval(self->expression, engine);
+    if (engine->failed)
+    {
+        return FAILURE;
+    }
+    Value *slot = &engine->slots[self->slot];
+    if (slot->type == VAL_INT && right.type == VAL_INT)
+    {
+        slot->as.integer += right.as.integer;
+        return SUCCESS;
+    }
+    return value_append(engine->heap, slot, right);
+}
+
+// "s = s + x + y": every part is evaluated before any is appended.
+static int exec_append_all(StmtClosure *self, ClosureEngine *engine)
+{
+    Value parts[APPEND_MAX];
+    for (int i = 0; i < self->part_count; i++)
+    {
+        parts[i] = self->parts[i]->eval(self->parts[i], engine);
+        if (engine->failed)
+        {
+            return FAILURE;
+        }
+    }
+    return value_append_all(engine->heap, &engine->slots[self->slot], parts, self->part_count);
+}
+
+static int exec_print(StmtClosure *self, ClosureEngine *engine)
+{
+    Value value = self->expression->eval(self->expression, engine);
+    if (engine->failed)
+    {
+        return FAILURE;
+    }
+    print_value(value);
+    return SUCCESS;
+}
+
+static int exec_block(StmtClosure *self, ClosureEngine *engine)
+{
+    for (StmtClosure *statement = self->body; statement; statement = statement->next)
+    {
+        if (statement->exec(statement, engine) == FAILURE)
+        {
+            return FAILURE;
+        }
+    }
+    return SUCCESS;
+}
+
+static int exec_while(StmtClosure *self, ClosureEngine *engine)
+{
+    while (1)
+    {
+        // Safepoint: between statements every live value is in a slot.
+        if (heap_should_collect(engine->heap))
+        {
+            heap_collect(engine->heap, NULL, NULL);
+        }
+        Value condition = self->expression->eval(self->expression, engine);
+        if (engine->failed)
+        {
+            return FAILURE;
+        }
+        if (!value_is_truthy(condition))
+        {
+            return SUCCESS;
+        }
+        if (self->body->exec(self->body, engine) == FAILURE)
+        {
+            return FAILURE;
+        }
+    }
+}
+
+static int exec_jit_while(StmtClosure *self, ClosureEngine *engine)
+{
+    JitLoop *loop = self->jit_loop;
+    Value *variables[JIT_MAX_VARIABLES];
+    for (int i = 0; i < loop->variable_count; i++)
+    {
+        variables[i] = &engine->slots[self->jit_slots[i]];
+    }
+    if (jit_run_loop(loop, variables) == JIT_DONE)
+    {
+        return SUCCESS;
+    }
+    return exec_while(self, engine);
+}
+
+static int exec_if(StmtClosure *self, ClosureEngine *engine)
+{
+    Value condition = self->expression->eval(self->expression, engine);
+    if (engine->failed)
+    {
+        return FAILURE;
+    }
+    if (value_is_truthy(condition))
+    {
+        return self->body->exec(self->body, engine);
+    }
+    if (self->else_body)
+    {
+        return self->else_body->exec(self->else_body, engine);
+    }
+    return SUCCESS;
+}
+
+// Lowering
+
+static int push_scope(ClosureEngine *engine, int size)
+{
+    if (engine->scope_count == CLOSURE_SCOPE_MAX)
+    {
+        fprintf(stderr, "Compile Error: Blocks nested too deeply.\n");
+        return FAILURE;
+    }
+
+    int base = 0;
+    if (engine->scope_count > 0)
+    {
+        int outer = engine->scope_count - 1;
+        base = engine->scope_base[outer] + engine->scope_size[outer];
+    }
+    engine->scope_base[engine->scope_count] = base;
+    engine->scope_size[engine->scope_count] = size;
+    engine->scope_count++;
+
+    if (base + size > engine->max_slot_count)
+    {
+        engine->max_slot_count = base + size;
+    }
+    return SUCCESS;
+}
+
+// Returns the absolute slot of a resolved identifier.
+static int slot_of(ClosureEngine *engine, ASTNode *identifier)
+{
+    int scope = engine->scope_count - 1 - identifier->data.identifier.depth;
+    return engine->scope_base[scope] + identifier->data.identifier.slot;
+}
+
+static ExprClosure *create_expr_closure(ClosureEngine *engine, EvalFunction eval)
+{
+    ExprClosure *closure = (ExprClosure *)arena_alloc(engine->closure_arena, sizeof(ExprClosure));
+    closure->eval = eval;
+    closure->left = NULL;
+    closure->right = NULL;
+    return closure;
+}
+
+static StmtClosure *create_stmt_closure(ClosureEngine *engine, int (*exec)(StmtClosure *, ClosureEngine *))
+{
+    StmtClosure *closure = (StmtClosure *)arena_alloc(engine->closure_arena, sizeof(StmtClosure));
+    closure->exec = exec;
+    closure->expression = NULL;
+    closure->parts = NULL;
+    closure->part_count = 0;
+    closure->body = NULL;
+    closure->else_body = NULL;
+    closure->next = NULL;
+    closure->jit_loop = NULL;
+    closure->jit_slots = NULL;
+    return closure;
+}
+
+static ExprClosure *lower_expression(ClosureEngine *engine, ASTNode *node);
+
+static ExprClosure *lower_binary_op(ClosureEngine *engine, ASTNode *node)
+{
+    BinaryOp op = node->data.binary_op.op;
+    ASTNode *left = node->data.binary_op.left;
+    ASTNode *right = node->data.binary_op.right;
+
+    const BinaryClosures *closures = NULL;
+    if (op < (int)(sizeof(int_binary_closures) / sizeof(int_binary_closures[0])) && int_binary_closures[op].any)
+    {
+        closures = &int_binary_closures[op];
+    }
+
+    ExprClosure *closure = create_expr_closure(engine, eval_binary);
+    closure->op = op;
+
+    // Operands that are a variable or a literal are read in place.
+    if (closures && left->type == NODE_IDENTIFIER && right->type == NODE_INTEGER)
+    {
+        closure->eval = closures->slot_constant;
+        closure->slot = slot_of(engine, left);
+        closure->constant = INT_VALUE(right->data.integer_value);
+        return closure;
+    }
+    if (closures && left->type == NODE_IDENTIFIER && right->type == NODE_IDENTIFIER)
+    {
+        closure->eval = closures->slot_slot;
+        closure->slot = slot_of(engine, left);
+        closure->right_slot = slot_of(engine, right);
+        return closure;
+    }
+
+    if (closures)
+    {
+        closure->eval = closures->any;
+    }
+    closure->left = lower_expression(engine, left);
+    closure->right = lower_expression(engine, right);
+    if (closure->left == NULL || closure->right == NULL)
+    {
+        return NULL;
+    }
+    return closure;
+}
+
+static ExprClosure *lower_expression(ClosureEngine *engine, ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_INTEGER:
+    {
+        ExprClosure *closure = create_expr_closure(engine, eval_constant);
+        closure->constant = INT_VALUE(node->data.integer_value);
+        return closure;
+    }
+    case NODE_STRING:
+    {
+        ExprClosure *closure = create_expr_closure(engine, eval_constant);
+        closure->constant = STR_VALUE(node->data.string_value);
+        return closure;
+    }
+    case NODE_IDENTIFIER:
+    {
+        ExprClosure *closure = create_expr_closure(engine, eval_slot);
+        closure->slot = slot_of(engine, node);
+        return closure;
+    }
+    case NODE_BINARY_OP:
+        return lower_binary_op(engine, node);
+    case NODE_UNARY_OP:
+    {
+        ExprClosure *closure = create_expr_closure(engine, eval_unary);
+        closure->unary_op = node->data.unary_op.op;
+        closure->right = lower_expression(engine, node->data.unary_op.right);
+        return closure->right ? closure : NULL;
+    }
+    default:
+        fprintf(stderr, "Compile Error: Invalid Expression.\n");
+        return NULL;
+    }
+}
+
+static StmtClosure *lower_statement(ClosureEngine *engine, ASTNode *node);
+
+// Lowers a list of statements, returns FAILURE if any of them fails.
+static int lower_statements(ClosureEngine *engine, ASTNode *head, StmtClosure **first)
+{
+    StmtClosure **tail = first;
+    for (ASTNode *dummy = head; dummy && dummy->type == NODE_STATEMENT; dummy = dummy->next)
+    {
+        // Variables the statement may declare without running the
+        // declaration start out as -1, see conditional_declaration().
+        ASTNode *declaration;
+        for (int i = 0; (declaration = conditional_declaration(dummy, i)) != NULL; i++)
+        {
+            StmtClosure *reset = create_stmt_closure(engine, exec_set);
+            reset->slot = slot_of(engine, declaration->data.declaration.identifier);
+            reset->expression = create_expr_closure(engine, eval_constant);
+            reset->expression->constant = INT_VALUE(-1);
+            *tail = reset;
+            tail = &reset->next;
+        }
+
+        StmtClosure *statement = lower_statement(engine, dummy);
+        if (statement == NULL)
+        {
+            return FAILURE;
+        }
+        *tail = statement;
+        tail = &statement->next;
+    }
+    *tail = NULL;
+    return SUCCESS;
+}
+
+// Switches a while closure to machine code if the JIT can compile the loop.
+static void lower_jit_loop(ClosureEngine *engine, StmtClosure *closure, ASTNode *node)
+{
+    JitLoop *loop = jit_compile_loop(engine->jit, node);
+    if (loop->function == NULL)
+    {
+        return;
+    }
+
+    closure->jit_loop = loop;
+    closure->jit_slots = (int *)arena_alloc(engine->closure_arena, JIT_MAX_VARIABLES * sizeof(int));
+    for (int i = 0; i < loop->variable_count; i++)
+    {
+        int scope = engine->scope_count - 1 - loop->depths[i];
+        closure->jit_slots[i] = engine->scope_base[scope] + loop->slots[i];
+    }
+    closure->exec = exec_jit_while;
+}
+
+static StmtClosure *lower_statement(ClosureEngine *engine, ASTNode *node)
+{
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+    {
+        ASTNode *declaration = node->data.statement.data.declaration;
+        StmtClosure *closure = create_stmt_closure(engine, exec_set);
+        closure->slot = slot_of(engine, declaration->data.declaration.identifier);
+        if (declaration->data.declaration.right)
+        {
+            closure->expression = lower_expression(engine, declaration->data.declaration.right);
+        }
+        else
+        {
+            // Variables without an initializer start out as -1.
+            closure->expression = create_expr_closure(engine, eval_constant);
+            closure->expression->constant = INT_VALUE(-1);
+        }
+        return closure->expression ? closure : NULL;
+    }
+    case ASSIGNMENT:
+    {
+        ASTNode *assignment = node->data.statement.data.assignment;
+        ASTNode *right = assignment->data.assignment.right;
+        ASTNode *operands[APPEND_MAX];
+        int count = append_operands(assignment, operands);
+        StmtClosure *closure;
+        if (count > 1)
+        {
+            closure = create_stmt_closure(engine, exec_append_all);
+            closure->slot = slot_of(engine, assignment->data.assignment.identifier);
+            closure->parts = (ExprClosure **)arena_alloc(engine->closure_arena, count * sizeof(ExprClosure *));
+            closure->part_count = count;
+            for (int i = 0; i < count; i++)
+            {
+                closure->parts[i] = lower_expression(engine, operands[i]);
+                if (closure->parts[i] == NULL)
+                {
+                    return NULL;
+                }
+            }
+            return closure;
+        }
+        if (count == 1)
+        {
+            closure = create_stmt_closure(engine, exec_append);
+            right = operands[0];
+        }
+        else
+        {
+            closure = create_stmt_closure(engine, exec_set);
+        }
+        closure->slot = slot_of(engine, assignment->data.assignment.identifier);
+        closure->expression = lower_expression(engine, right);
+        return closure->expression ? closure : NULL;
+    }
+    case BLOCK_STATEMENT:
+    {
+        StmtClosure *closure = create_stmt_closure(engine, exec_block);
+        if (push_scope(engine, node->data.statement.slot_count) == FAILURE)
+        {
+            return NULL;
+        }
+        int status = lower_statements(engine, node->data.statement.data.head, &closure->body);
+        engine->scope_count--;
+        return status == SUCCESS ? closure : NULL;
+    }
+    case WHILE_STATEMENT:
+    case IF_STATEMENT:
+    {
+        // The condition is followed by the body (and the else branch).
+        ASTNode *condition = node->data.statement.data.expression;
+        ASTNode *body = condition->next;
+        StmtClosure *closure = create_stmt_closure(engine, node->data.statement.type == WHILE_STATEMENT ? exec_while : exec_if);
+        closure->expression = lower_expression(engine, condition);
+        closure->body = lower_statement(engine, body);
+        if (closure->expression == NULL || closure->body == NULL)
+        {
+            return NULL;
+        }
+        if (body->next)
+        {
+            closure->else_body = lower_statement(engine, body->next);
+            if (closure->else_body == NULL)
+            {
+                return NULL;
+            }
+        }
+        if (node->data.statement.type == WHILE_STATEMENT && engine->jit)
+        {
+            lower_jit_loop(engine, closure, node);
+        }
+        return closure;
+    }
+    case PRINT_STATEMENT:
+    {
+        StmtClosure *closure = create_stmt_closure(engine, exec_print);
+        closure->expression = lower_expression(engine, node->data.statement.data.expression);
+        return closure->expression ? closure : NULL;
+    }
+    default:
+        fprintf(stderr, "Compile Error: Unknown statement type %d!\n", node->data.statement.type);
+        return NULL;
+    }
+}
+
+static void reserve_slots(ClosureEngine *engine, int slot_count)
+{
+    if (slot_count <= engine->slot_count)
+    {
+        return;
+    }
+
+    engine->slots = (Value *)realloc(engine->slots, slot_count * sizeof(Value));
+    if (engine->slots == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for ClosureEngine->slots.\n");
+        exit(EXIT_FAILURE);
+    }
+    // Strings owned by the old slots can no longer be appended to in place.
+    for (int i = 0; i < engine->slot_count; i++)
+    {
+        if (engine->slots[i].type == VAL_STR)
+        {
+            string_store(engine->slots[i].as.string, NULL);
+        }
+    }
+    for (int i = engine->slot_count; i < slot_count; i++)
+    {
+        engine->slots[i] = INT_VALUE(-1);
+    }
+    engine->slot_count = slot_count;
+}
+
+// Lowers a resolved program into closures and runs it.
+int closure_run(ClosureEngine *engine, ASTNode *program)
+{
+    engine->scope_count = 0;
+    engine->max_slot_count = 0;
+    push_scope(engine, program->data.program.slot_count);
+
+    // The first node of a program is a dummy head.
+    StmtClosure *first;
+    int status = lower_statements(engine, program->data.program.head->next, &first);
+    if (status == SUCCESS)
+    {
+        reserve_slots(engine, engine->max_slot_count);
+        engine->failed = 0;
+        for (StmtClosure *statement = first; statement && status == SUCCESS; statement = statement->next)
+        {
+            status = statement->exec(statement, engine);
+        }
+    }
+
+    arena_reset(engine->closure_arena);
+    return status;
+}
+
+// Roots of the closure engine: the variables.
+static void mark_closure_engine(Heap *heap, void *context)
+{
+    ClosureEngine *engine = (ClosureEngine *)context;
+    heap_mark_values(heap, engine->slots, engine->slot_count);
+}
+
+ClosureEngine *create_closure_engine(Heap *heap)
+{
+    ClosureEngine *engine = (ClosureEngine *)malloc(sizeof(ClosureEngine));
+    if (engine == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for ClosureEngine.\n");
+        exit(EXIT_FAILURE);
+    }
+    engine->slots = NULL;
+    engine->slot_count = 0;
+    engine->failed = 0;
+    engine->heap = heap;
+    engine->closure_arena = create_arena("closures");
+    engine->jit = NULL;
+    engine->scope_count = 0;
+    engine->max_slot_count = 0;
+    heap_add_root(heap, mark_closure_engine, engine);
+    return engine;
+}
+
+void free_closure_engine(ClosureEngine *engine)
+{
+    free(engine->slots);
+    free_arena(engine->closure_arena);
+    free(engine);
+}
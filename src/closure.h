@@ -0,0 +1,87 @@
+#ifndef CLOSURE_H
+#define CLOSURE_H
+
+#include "arena.h"
+#include "gc.h"
+#include "jit.h"
+#include "parser.h"
+#include "value.h"
+
+#define CLOSURE_SCOPE_MAX 256
+
+struct ClosureEngine;
+
+// ExprClosure is an expression lowered to a function pointer and the
+// operands it needs, e.g. "add constant to slot 2". Which fields are used
+// depends on eval.
+typedef struct ExprClosure
+{
+    Value (*eval)(struct ExprClosure *self, struct ClosureEngine *engine);
+    BinaryOp op;
+    UnaryOp unary_op;
+    struct ExprClosure *left;
+    struct ExprClosure *right;
+    int slot;
+    int right_slot;
+    Value constant;
+} ExprClosure;
+
+// StmtClosure is a statement lowered the same way. exec returns FAILURE on
+// a runtime error.
+typedef struct StmtClosure
+{
+    int (*exec)(struct StmtClosure *self, struct ClosureEngine *engine);
+    ExprClosure *expression;
+    int slot;
+
+    // "s = s + x + y": the closures of x and y.
+    ExprClosure **parts;
+    int part_count;
+
+    // Body of a while or if (first statement of a block), else branch.
+    struct StmtClosure *body;
+    struct StmtClosure *else_body;
+
+    // Next statement of the enclosing block.
+    struct StmtClosure *next;
+
+    // A while loop compiled with --jit and the absolute slots of its
+    // variables. body still runs the loop when the machine code bails out.
+    JitLoop *jit_loop;
+    int *jit_slots;
+} StmtClosure;
+
+// ClosureEngine lowers a resolved AST into closures once, then runs them.
+// Like the VM, every variable lives in a fixed slot: the slots of a block
+// start right after the slots of the scope that encloses it. Slots outlive
+// a single run so a REPL session can keep its state.
+typedef struct ClosureEngine
+{
+    Value *slots;
+    int slot_count;
+
+    // Set when an expression fails, checked by the statement running it.
+    int failed;
+
+    // Strings built at runtime are allocated here.
+    Heap *heap;
+
+    // Closures of the program being run.
+    Arena *closure_arena;
+
+    // Compiles while loops to machine code when set (--jit).
+    Jit *jit;
+
+    // First slot and size of every open scope while lowering, globals first.
+    int scope_base[CLOSURE_SCOPE_MAX];
+    int scope_size[CLOSURE_SCOPE_MAX];
+    int scope_count;
+    int max_slot_count;
+} ClosureEngine;
+
+ClosureEngine *create_closure_engine(Heap *heap);
+void free_closure_engine(ClosureEngine *engine);
+
+int closure_run(ClosureEngine *engine, ASTNode *program);
+
+#endif // CLOSURE_H
@@ -0,0 +1,625 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "codegen.h"
+#include "value.h"
+
+/**
+ * Ahead-of-time compilation to x86-64 assembly (AT&T syntax, GNU as).
+ *
+ * An expression leaves its value in two registers: the type in %rdx and the
+ * int or string pointer in %rax. %rbx points at the variable slots for the
+ * whole program. Binary operations keep the left operand on the machine
+ * stack while the right one is evaluated, so the stack stays 16 byte
+ * aligned for calls into libc.
+ *
+ * Operations on two ints are inlined. Anything else calls mc_binary, part of
+ * a small runtime written in assembly that is appended to every program.
+ * Runtime errors print the interpreter's message and exit with status 1.
+ */
+
+// The runtime. Expects MC_* to be set to the values of BinaryOp.
+static const char *runtime_source =
+    "    .text\n"
+    "# mc_print(type %rdi, value %rsi)\n"
+    "mc_print:\n"
+    "    push %rbp\n"
+    "    mov %rsp, %rbp\n"
+    "    test %rdi, %rdi\n"
+    "    jnz .Lmc_print_string\n"
+    "    lea .Lmc_int_format(%rip), %rdi\n"
+    "    xor %eax, %eax\n"
+    "    call printf@PLT\n"
+    "    pop %rbp\n"
+    "    ret\n"
+    ".Lmc_print_string:\n"
+    "    mov %rsi, %rdi\n"
+    "    call puts@PLT\n"
+    "    pop %rbp\n"
+    "    ret\n"
+    "\n"
+    "# mc_fail(message %rdi): prints message to stderr and exits with status 1.\n"
+    "mc_fail:\n"
+    "    and $-16, %rsp\n"
+    "    mov stderr@GOTPCREL(%rip), %rsi\n"
+    "    mov (%rsi), %rsi\n"
+    "    call fputs@PLT\n"
+    "    mov $1, %edi\n"
+    "    call exit@PLT\n"
+    "\n"
+    "mc_division_by_zero:\n"
+    "    lea .Lmc_division_by_zero(%rip), %rdi\n"
+    "    jmp mc_fail\n"
+    "\n"
+    "mc_unary_type_error:\n"
+    "    lea .Lmc_unary_type_error(%rip), %rdi\n"
+    "    jmp mc_fail\n"
+    "\n"
+    "# mc_binary(op %edi, left type %rsi, left %rdx, right type %rcx, right %r8)\n"
+    "# Returns the type in %rdx and the value in %rax. Never called for two ints.\n"
+    "mc_binary:\n"
+    "    push %rbp\n"
+    "    mov %rsp, %rbp\n"
+    "    push %rbx\n"
+    "    push %r12\n"
+    "    push %r13\n"
+    "    push %r14\n"
+    "    mov %edi, %ebx\n"
+    "    mov %rdx, %r12\n"
+    "    mov %r8, %r13\n"
+    "    cmp %rsi, %rcx\n"
+    "    je .Lmc_binary_strings\n"
+    "    lea .Lmc_mixed_types(%rip), %rdi\n"
+    "    jmp mc_fail\n"
+    ".Lmc_binary_strings:\n"
+    "    cmp $MC_ADD, %ebx\n"
+    "    jne .Lmc_binary_subtract\n"
+    "    mov %r12, %rdi\n"
+    "    call strlen@PLT\n"
+    "    mov %rax, %r14\n"
+    "    mov %r13, %rdi\n"
+    "    call strlen@PLT\n"
+    "    mov %rax, %rbx\n"
+    "    lea 1(%r14,%rbx), %rdi\n"
+    "    call malloc@PLT\n"
+    "    test %rax, %rax\n"
+    "    jnz .Lmc_binary_concat\n"
+    "    lea .Lmc_out_of_memory(%rip), %rdi\n"
+    "    jmp mc_fail\n"
+    ".Lmc_binary_concat:\n"
+    "    mov %rax, %rdi\n"
+    "    mov %r12, %rsi\n"
+    "    mov %rax, %r12\n"
+    "    mov %r14, %rdx\n"
+    "    call memcpy@PLT\n"
+    "    lea (%r12,%r14), %rdi\n"
+    "    mov %r13, %rsi\n"
+    "    lea 1(%rbx), %rdx\n"
+    "    call memcpy@PLT\n"
+    "    mov %r12, %rax\n"
+    "    mov $1, %edx\n"
+    "    jmp .Lmc_binary_return\n"
+    ".Lmc_binary_subtract:\n"
+    "    cmp $MC_SUBTRACT, %ebx\n"
+    "    jne .Lmc_binary_multiply\n"
+    "    lea .Lmc_subtract(%rip), %rdi\n"
+    "    jmp mc_fail\n"
+    ".Lmc_binary_multiply:\n"
+    "    cmp $MC_MULTIPLY, %ebx\n"
+    "    jne .Lmc_binary_divide\n"
+    "    lea .Lmc_multiply(%rip), %rdi\n"
+    "    jmp mc_fail\n"
+    ".Lmc_binary_divide:\n"
+    "    cmp $MC_DIVIDE, %ebx\n"
+    "    jne .Lmc_binary_compare\n"
+    "    lea .Lmc_divide(%rip), %rdi\n"
+    "    jmp mc_fail\n"
+    ".Lmc_binary_compare:\n"
+    "    mov %r12, %rdi\n"
+    "    mov %r13, %rsi\n"
+    "    call strcmp@PLT\n"
+    "    mov %eax, %ecx\n"
+    "    xor %eax, %eax\n"
+    "    cmp $MC_IS_EQUAL, %ebx\n"
+    "    jne 1f\n"
+    "    test %ecx, %ecx\n"
+    "    sete %al\n"
+    "1:  cmp $MC_IS_NOT_EQUAL, %ebx\n"
+    "    jne 1f\n"
+    "    test %ecx, %ecx\n"
+    "    setne %al\n"
+    "1:  cmp $MC_IS_LESS_THAN, %ebx\n"
+    "    jne 1f\n"
+    "    test %ecx, %ecx\n"
+    "    setl %al\n"
+    "1:  cmp $MC_LESS_THAN_EQUAL, %ebx\n"
+    "    jne 1f\n"
+    "    test %ecx, %ecx\n"
+    "    setle %al\n"
+    "1:  cmp $MC_IS_GREATER_THAN, %ebx\n"
+    "    jne 1f\n"
+    "    test %ecx, %ecx\n"
+    "    setg %al\n"
+    "1:  cmp $MC_GREATER_THAN_EQUAL, %ebx\n"
+    "    jne 1f\n"
+    "    test %ecx, %ecx\n"
+    "    setge %al\n"
+    "1:  xor %edx, %edx\n"
+    ".Lmc_binary_return:\n"
+    "    pop %r14\n"
+    "    pop %r13\n"
+    "    pop %r12\n"
+    "    pop %rbx\n"
+    "    pop %rbp\n"
+    "    ret\n"
+    "\n"
+    "    .section .rodata\n"
+    ".Lmc_int_format:\n"
+    "    .string \"%d\\n\"\n"
+    ".Lmc_division_by_zero:\n"
+    "    .string \"Runtime Error: Division by zero.\\n\"\n"
+    ".Lmc_unary_type_error:\n"
+    "    .string \"Runtime Error: Unsupported Unary Operation on non-integer value.\\n\"\n"
+    ".Lmc_mixed_types:\n"
+    "    .string \"Runtime Error: Unsupported Binary Operation on two different types.\\n\"\n"
+    ".Lmc_subtract:\n"
+    "    .string \"Runtime Error: Cannot subtract strings.\\n\"\n"
+    ".Lmc_multiply:\n"
+    "    .string \"Runtime Error: Cannot multiply strings.\\n\"\n"
+    ".Lmc_divide:\n"
+    "    .string \"Runtime Error: Cannot divide strings.\\n\"\n"
+    ".Lmc_out_of_memory:\n"
+    "    .string \"Failed to allocate memory for string.\\n\"\n"
+    "    .section .note.GNU-stack,\"\",@progbits\n";
+
+static int new_label(CodeGen *gen)
+{
+    return gen->label_count++;
+}
+
+static int push_scope(CodeGen *gen, int size)
+{
+    if (gen->scope_count == CODEGEN_SCOPE_MAX)
+    {
+        fprintf(stderr, "Compile Error: Blocks nested too deeply.\n");
+        return FAILURE;
+    }
+
+    int base = 0;
+    if (gen->scope_count > 0)
+    {
+        int outer = gen->scope_count - 1;
+        base = gen->scope_base[outer] + gen->scope_size[outer];
+    }
+    gen->scope_base[gen->scope_count] = base;
+    gen->scope_size[gen->scope_count] = size;
+    gen->scope_count++;
+
+    if (base + size > gen->max_slot_count)
+    {
+        gen->max_slot_count = base + size;
+    }
+    return SUCCESS;
+}
+
+// Returns the offset of the slot of a resolved identifier from %rbx.
+static int slot_offset(CodeGen *gen, ASTNode *identifier)
+{
+    int scope = gen->scope_count - 1 - identifier->data.identifier.depth;
+    return 16 * (gen->scope_base[scope] + identifier->data.identifier.slot);
+}
+
+// Emits a string literal into .rodata. Escape sequences are kept as written
+// in the source, like the interpreter prints them.
+static void emit_string_literal(CodeGen *gen, int label, const char *string)
+{
+    fprintf(gen->out, "    .section .rodata\n.L%d:\n    .string \"", label);
+    for (const unsigned char *c = (const unsigned char *)string; *c; c++)
+    {
+        if (*c == '"' || *c == '\\' || *c < ' ' || *c > '~')
+        {
+            fprintf(gen->out, "\\%03o", *c);
+        }
+        else
+        {
+            fputc(*c, gen->out);
+        }
+    }
+    fprintf(gen->out, "\"\n    .text\n");
+}
+
+// Loads a literal or variable into the given registers without using the stack.
+static int emit_leaf(CodeGen *gen, ASTNode *node, const char *value, const char *type)
+{
+    switch (node->type)
+    {
+    case NODE_INTEGER:
+        fprintf(gen->out, "    mov $%d, %%%s\n", node->data.integer_value, value);
+        fprintf(gen->out, "    mov $%d, %%%s\n", VAL_INT, type);
+        return SUCCESS;
+    case NODE_STRING:
+    {
+        int label = new_label(gen);
+        emit_string_literal(gen, label, node->data.string_value);
+        fprintf(gen->out, "    lea .L%d(%%rip), %%%s\n", label, value);
+        fprintf(gen->out, "    mov $%d, %%%s\n", VAL_STR, type);
+        return SUCCESS;
+    }
+    case NODE_IDENTIFIER:
+    {
+        int offset = slot_offset(gen, node);
+        fprintf(gen->out, "    mov %d(%%rbx), %%%s\n", offset + 8, value);
+        fprintf(gen->out, "    mov %d(%%rbx), %%%s\n", offset, type);
+        return SUCCESS;
+    }
+    default:
+        return FAILURE;
+    }
+}
+
+static int is_leaf(ASTNode *node)
+{
+    return node->type == NODE_INTEGER || node->type == NODE_STRING || node->type == NODE_IDENTIFIER;
+}
+
+static const char *int_compare_instruction(BinaryOp op)
+{
+    switch (op)
+    {
+    case IS_EQUAL:
+        return "sete";
+    case IS_NOT_EQUAL:
+        return "setne";
+    case IS_LESS_THAN:
+        return "setl";
+    case LESS_THAN_EQUAL:
+        return "setle";
+    case IS_GREATER_THAN:
+        return "setg";
+    case GREATER_THAN_EQUAL:
+        return "setge";
+    default:
+        return NULL;
+    }
+}
+
+static int emit_expression(CodeGen *gen, ASTNode *node);
+
+// Left operand in %rdx:%rax, right operand in %rcx:%rsi.
+static int emit_binary_op(CodeGen *gen, ASTNode *node)
+{
+    BinaryOp op = node->data.binary_op.op;
+    ASTNode *right = node->data.binary_op.right;
+    FILE *out = gen->out;
+
+    if (emit_expression(gen, node->data.binary_op.left) == FAILURE)
+    {
+        return FAILURE;
+    }
+    if (is_leaf(right))
+    {
+        emit_leaf(gen, right, "rsi", "rcx");
+    }
+    else
+    {
+        fprintf(out, "    push %%rdx\n    push %%rax\n");
+        if (emit_expression(gen, right) == FAILURE)
+        {
+            return FAILURE;
+        }
+        fprintf(out, "    mov %%rax, %%rsi\n    mov %%rdx, %%rcx\n");
+        fprintf(out, "    pop %%rax\n    pop %%rdx\n");
+    }
+
+    int slow = new_label(gen);
+    int done = new_label(gen);
+    fprintf(out, "    mov %%edx, %%r8d\n    or %%ecx, %%r8d\n    jnz .L%d\n", slow);
+    switch (op)
+    {
+    case ADD:
+        fprintf(out, "    add %%esi, %%eax\n");
+        break;
+    case SUBTRACT:
+        fprintf(out, "    sub %%esi, %%eax\n");
+        break;
+    case MULTIPLY:
+        fprintf(out, "    imul %%esi, %%eax\n");
+        break;
+    case DIVIDE:
+        if (right->type != NODE_INTEGER || right->data.integer_value == 0)
+        {
+            int divide = new_label(gen);
+            fprintf(out, "    test %%esi, %%esi\n    jnz .L%d\n    call mc_division_by_zero\n.L%d:\n", divide, divide);
+        }
+        fprintf(out, "    cltd\n    idiv %%esi\n    xor %%edx, %%edx\n");
+        break;
+    default:
+    {
+        const char *set = int_compare_instruction(op);
+        if (set == NULL)
+        {
+            fprintf(stderr, "Compile Error: Unsupported Binary Operation.\n");
+            return FAILURE;
+        }
+        fprintf(out, "    cmp %%esi, %%eax\n    %s %%al\n    movzbl %%al, %%eax\n", set);
+        break;
+    }
+    }
+    fprintf(out, "    jmp .L%d\n", done);
+
+    fprintf(out, ".L%d:\n", slow);
+    fprintf(out, "    mov %%rsi, %%r8\n    mov %%rdx, %%rsi\n    mov %%rax, %%rdx\n");
+    fprintf(out, "    mov $%d, %%edi\n    call mc_binary\n", op);
+    fprintf(out, ".L%d:\n", done);
+    return SUCCESS;
+}
+
+// Leaves the value of an expression in %rdx (type) and %rax.
+static int emit_expression(CodeGen *gen, ASTNode *node)
+{
+    if (is_leaf(node))
+    {
+        return emit_leaf(gen, node, "rax", "rdx");
+    }
+
+    switch (node->type)
+    {
+    case NODE_BINARY_OP:
+        return emit_binary_op(gen, node);
+    case NODE_UNARY_OP:
+    {
+        if (emit_expression(gen, node->data.unary_op.right) == FAILURE)
+        {
+            return FAILURE;
+        }
+        int is_int = new_label(gen);
+        fprintf(gen->out, "    test %%rdx, %%rdx\n    jz .L%d\n    call mc_unary_type_error\n.L%d:\n", is_int, is_int);
+        switch (node->data.unary_op.op)
+        {
+        case NEGATE:
+            fprintf(gen->out, "    neg %%eax\n");
+            return SUCCESS;
+        case LOGICAL_NOT:
+            fprintf(gen->out, "    test %%eax, %%eax\n    sete %%al\n    movzbl %%al, %%eax\n");
+            return SUCCESS;
+        default:
+            fprintf(stderr, "Compile Error: Unsupported Unary Operation.\n");
+            return FAILURE;
+        }
+    }
+    default:
+        fprintf(stderr, "Compile Error: Invalid Expression.\n");
+        return FAILURE;
+    }
+}
+
+// Jumps to label if the value in %rdx:%rax is false. Strings are always true.
+static void emit_jump_if_false(CodeGen *gen, int label)
+{
+    int is_true = new_label(gen);
+    fprintf(gen->out, "    test %%rdx, %%rdx\n    jnz .L%d\n", is_true);
+    fprintf(gen->out, "    test %%eax, %%eax\n    jz .L%d\n", label);
+    fprintf(gen->out, ".L%d:\n", is_true);
+}
+
+static void emit_store(CodeGen *gen, ASTNode *identifier)
+{
+    int offset = slot_offset(gen, identifier);
+    fprintf(gen->out, "    mov %%rdx, %d(%%rbx)\n", offset);
+    fprintf(gen->out, "    mov %%rax, %d(%%rbx)\n", offset + 8);
+}
+
+// Sets the variables that node may declare without running the
+// declaration to -1, see conditional_declaration().
+static void emit_conditional_declarations(CodeGen *gen, ASTNode *node)
+{
+    ASTNode *declaration;
+    for (int i = 0; (declaration = conditional_declaration(node, i)) != NULL; i++)
+    {
+        fprintf(gen->out, "    mov $-1, %%eax\n    mov $%d, %%edx\n", VAL_INT);
+        emit_store(gen, declaration->data.declaration.identifier);
+    }
+}
+
+static int emit_statement(CodeGen *gen, ASTNode *node)
+{
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+    {
+        ASTNode *declaration = node->data.statement.data.declaration;
+        if (declaration->data.declaration.right)
+        {
+            if (emit_expression(gen, declaration->data.declaration.right) == FAILURE)
+            {
+                return FAILURE;
+            }
+        }
+        else
+        {
+            // Uninitialized variables hold -1, same as the interpreter.
+            fprintf(gen->out, "    mov $-1, %%eax\n    mov $%d, %%edx\n", VAL_INT);
+        }
+        emit_store(gen, declaration->data.declaration.identifier);
+        return SUCCESS;
+    }
+    case ASSIGNMENT:
+    {
+        ASTNode *assignment = node->data.statement.data.assignment;
+        if (emit_expression(gen, assignment->data.assignment.right) == FAILURE)
+        {
+            return FAILURE;
+        }
+        emit_store(gen, assignment->data.assignment.identifier);
+        return SUCCESS;
+    }
+    case BLOCK_STATEMENT:
+        if (push_scope(gen, node->data.statement.slot_count) == FAILURE)
+        {
+            return FAILURE;
+        }
+        for (ASTNode *dummy = node->data.statement.data.head; dummy; dummy = dummy->next)
+        {
+            emit_conditional_declarations(gen, dummy);
+            if (emit_statement(gen, dummy) == FAILURE)
+            {
+                return FAILURE;
+            }
+        }
+        gen->scope_count--;
+        return SUCCESS;
+    case WHILE_STATEMENT:
+    {
+        ASTNode *condition = node->data.statement.data.expression;
+        int start = new_label(gen);
+        int end = new_label(gen);
+        fprintf(gen->out, ".L%d:\n", start);
+        if (emit_expression(gen, condition) == FAILURE)
+        {
+            return FAILURE;
+        }
+        emit_jump_if_false(gen, end);
+        if (emit_statement(gen, condition->next) == FAILURE)
+        {
+            return FAILURE;
+        }
+        fprintf(gen->out, "    jmp .L%d\n.L%d:\n", start, end);
+        return SUCCESS;
+    }
+    case IF_STATEMENT:
+    {
+        ASTNode *condition = node->data.statement.data.expression;
+        ASTNode *else_body = condition->next->next;
+        int otherwise = new_label(gen);
+        int end = new_label(gen);
+        if (emit_expression(gen, condition) == FAILURE)
+        {
+            return FAILURE;
+        }
+        emit_jump_if_false(gen, otherwise);
+        if (emit_statement(gen, condition->next) == FAILURE)
+        {
+            return FAILURE;
+        }
+        fprintf(gen->out, "    jmp .L%d\n.L%d:\n", end, otherwise);
+        if (else_body && emit_statement(gen, else_body) == FAILURE)
+        {
+            return FAILURE;
+        }
+        fprintf(gen->out, ".L%d:\n", end);
+        return SUCCESS;
+    }
+    case PRINT_STATEMENT:
+        if (emit_expression(gen, node->data.statement.data.expression) == FAILURE)
+        {
+            return FAILURE;
+        }
+        fprintf(gen->out, "    mov %%rdx, %%rdi\n    mov %%rax, %%rsi\n    call mc_print\n");
+        return SUCCESS;
+    default:
+        fprintf(stderr, "Compile Error: Unknown statement type %d!\n", node->data.statement.type);
+        return FAILURE;
+    }
+}
+
+// Writes a resolved program as a complete assembly file, runtime included.
+int codegen_emit(FILE *out, ASTNode *program)
+{
+    CodeGen gen;
+    gen.out = out;
+    gen.label_count = 0;
+    gen.scope_count = 0;
+    gen.max_slot_count = 0;
+    push_scope(&gen, program->data.program.slot_count);
+
+    fprintf(out, "    .set MC_ADD, %d\n", ADD);
+    fprintf(out, "    .set MC_SUBTRACT, %d\n", SUBTRACT);
+    fprintf(out, "    .set MC_MULTIPLY, %d\n", MULTIPLY);
+    fprintf(out, "    .set MC_DIVIDE, %d\n", DIVIDE);
+    fprintf(out, "    .set MC_IS_EQUAL, %d\n", IS_EQUAL);
+    fprintf(out, "    .set MC_IS_NOT_EQUAL, %d\n", IS_NOT_EQUAL);
+    fprintf(out, "    .set MC_IS_LESS_THAN, %d\n", IS_LESS_THAN);
+    fprintf(out, "    .set MC_LESS_THAN_EQUAL, %d\n", LESS_THAN_EQUAL);
+    fprintf(out, "    .set MC_IS_GREATER_THAN, %d\n", IS_GREATER_THAN);
+    fprintf(out, "    .set MC_GREATER_THAN_EQUAL, %d\n", GREATER_THAN_EQUAL);
+
+    // main keeps %rbx (the slots) and the stack aligned for calls.
+    fprintf(out, "\n    .text\n    .globl main\nmain:\n");
+    fprintf(out, "    push %%rbp\n    mov %%rsp, %%rbp\n    push %%rbx\n    sub $8, %%rsp\n");
+    fprintf(out, "    lea mc_slots(%%rip), %%rbx\n");
+
+    // The first node of a program is a dummy head.
+    for (ASTNode *dummy = program->data.program.head->next; dummy; dummy = dummy->next)
+    {
+        if (dummy->type == NODE_EOF)
+        {
+            break;
+        }
+        emit_conditional_declarations(&gen, dummy);
+        if (emit_statement(&gen, dummy) == FAILURE)
+        {
+            return FAILURE;
+        }
+    }
+
+    fprintf(out, "    xor %%eax, %%eax\n    add $8, %%rsp\n    pop %%rbx\n    pop %%rbp\n    ret\n\n");
+    fprintf(out, "    .lcomm mc_slots, %d\n\n", 16 * (gen.max_slot_count > 0 ? gen.max_slot_count : 1));
+    fputs(runtime_source, out);
+    return SUCCESS;
+}
+
+// Compiles a resolved program into an executable at output_path. The
+// assembly goes to a temporary file that $CC (cc by default) assembles and
+// links against libc.
+int codegen_build(ASTNode *program, const char *output_path)
+{
+    char assembly_path[] = "/tmp/mccp-XXXXXX.s";
+    int fd = mkstemps(assembly_path, 2);
+    if (fd == -1)
+    {
+        perror("Compile Error: Unable to create assembly file");
+        return FAILURE;
+    }
+    FILE *out = fdopen(fd, "w");
+    if (out == NULL)
+    {
+        perror("Compile Error: Unable to create assembly file");
+        close(fd);
+        unlink(assembly_path);
+        return FAILURE;
+    }
+
+    int status = codegen_emit(out, program);
+    fclose(out);
+    if (status == FAILURE)
+    {
+        unlink(assembly_path);
+        return FAILURE;
+    }
+
+    const char *cc = getenv("CC");
+    if (cc == NULL || *cc == '\0')
+    {
+        cc = "cc";
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execlp(cc, cc, "-o", output_path, assembly_path, (char *)NULL);
+        perror("Compile Error: Unable to run the assembler");
+        _exit(127);
+    }
+
+    int exit_status = -1;
+    if (pid == -1 || waitpid(pid, &exit_status, 0) == -1 || !WIFEXITED(exit_status) || WEXITSTATUS(exit_status) != 0)
+    {
+        fprintf(stderr, "Compile Error: Unable to build '%s'.\n", output_path);
+        status = FAILURE;
+    }
+    unlink(assembly_path);
+    return status;
+}
@@ -0,0 +1,29 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <stdio.h>
+
+#include "parser.h"
+
+#define CODEGEN_SCOPE_MAX 256
+
+// CodeGen lowers a resolved AST into GNU assembler source for x86-64 Linux.
+// Like the VM, every variable gets a fixed slot: the slots of a block start
+// right after the slots of the scope that encloses it. Slots are 16 bytes in
+// .bss, the type at offset 0 and the int or string pointer at offset 8.
+typedef struct CodeGen
+{
+    FILE *out;
+    int label_count;
+
+    // First slot and size of every open scope, globals first.
+    int scope_base[CODEGEN_SCOPE_MAX];
+    int scope_size[CODEGEN_SCOPE_MAX];
+    int scope_count;
+    int max_slot_count;
+} CodeGen;
+
+int codegen_emit(FILE *out, ASTNode *program);
+int codegen_build(ASTNode *program, const char *output_path);
+
+#endif // CODEGEN_H
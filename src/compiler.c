@@ -0,0 +1,454 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "compiler.h"
+
+static void emit_byte(Compiler *compiler, uint8_t byte)
+{
+    chunk_write(compiler->chunk, byte);
+}
+
+static void emit_short_op(Compiler *compiler, OpCode op, uint16_t operand)
+{
+    chunk_write(compiler->chunk, op);
+    chunk_write_short(compiler->chunk, operand);
+}
+
+// Tracks the operand stack depth so programs that would overflow the VM stack
+// are rejected at compile time instead of being checked on every push.
+static int adjust_stack(Compiler *compiler, int delta)
+{
+    compiler->stack_depth += delta;
+    if (compiler->stack_depth > STACK_MAX)
+    {
+        fprintf(stderr, "Compile Error: Expression nested too deeply.\n");
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+static int emit_constant(Compiler *compiler, Value value)
+{
+    int index = chunk_add_constant(compiler->chunk, value);
+    if (index > UINT16_MAX)
+    {
+        fprintf(stderr, "Compile Error: Too many constants in one program.\n");
+        return FAILURE;
+    }
+    emit_short_op(compiler, OP_CONSTANT, index);
+    return adjust_stack(compiler, 1);
+}
+
+// Emits an instruction that addresses the VM slot of a resolved identifier.
+static int emit_slot_op(Compiler *compiler, OpCode op, ASTNode *identifier)
+{
+    int scope = compiler->scope_count - 1 - identifier->data.identifier.depth;
+    int slot = compiler->scope_base[scope] + identifier->data.identifier.slot;
+    if (slot > UINT16_MAX)
+    {
+        fprintf(stderr, "Compile Error: Too many variables in one program.\n");
+        return FAILURE;
+    }
+    emit_short_op(compiler, op, slot);
+    return SUCCESS;
+}
+
+static int push_scope(Compiler *compiler, int size)
+{
+    if (compiler->scope_count == SCOPE_MAX)
+    {
+        fprintf(stderr, "Compile Error: Blocks nested too deeply.\n");
+        return FAILURE;
+    }
+
+    int base = 0;
+    if (compiler->scope_count > 0)
+    {
+        int outer = compiler->scope_count - 1;
+        base = compiler->scope_base[outer] + compiler->scope_size[outer];
+    }
+    compiler->scope_base[compiler->scope_count] = base;
+    compiler->scope_size[compiler->scope_count] = size;
+    compiler->scope_count++;
+
+    if (base + size > compiler->chunk->slot_count)
+    {
+        compiler->chunk->slot_count = base + size;
+    }
+    return SUCCESS;
+}
+
+// Emits a forward jump with a placeholder offset and returns where the offset lives.
+static int emit_jump(Compiler *compiler, OpCode op)
+{
+    emit_short_op(compiler, op, 0xffff);
+    return compiler->chunk->count - 2;
+}
+
+static int patch_jump(Compiler *compiler, int offset)
+{
+    int jump = compiler->chunk->count - offset - 2;
+    if (jump > UINT16_MAX)
+    {
+        fprintf(stderr, "Compile Error: Too much code to jump over.\n");
+        return FAILURE;
+    }
+    compiler->chunk->code[offset] = (jump >> 8) & 0xff;
+    compiler->chunk->code[offset + 1] = jump & 0xff;
+    return SUCCESS;
+}
+
+static int emit_loop(Compiler *compiler, int loop_start)
+{
+    int jump = compiler->chunk->count + 3 - loop_start;
+    if (jump > UINT16_MAX)
+    {
+        fprintf(stderr, "Compile Error: Loop body too large.\n");
+        return FAILURE;
+    }
+    emit_short_op(compiler, OP_LOOP, jump);
+    return SUCCESS;
+}
+
+static OpCode binary_op_to_opcode(BinaryOp op)
+{
+    switch (op)
+    {
+    case ADD:
+        return OP_ADD;
+    case SUBTRACT:
+        return OP_SUBTRACT;
+    case MULTIPLY:
+        return OP_MULTIPLY;
+    case DIVIDE:
+        return OP_DIVIDE;
+    case IS_EQUAL:
+        return OP_EQUAL;
+    case IS_LESS_THAN:
+        return OP_LESS;
+    case LESS_THAN_EQUAL:
+        return OP_LESS_EQUAL;
+    case IS_GREATER_THAN:
+        return OP_GREATER;
+    case GREATER_THAN_EQUAL:
+        return OP_GREATER_EQUAL;
+    case IS_NOT_EQUAL:
+        return OP_NOT_EQUAL;
+    default:
+        return OP_HALT;
+    }
+}
+
+int compile_expression(Compiler *compiler, ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_STRING:
+        return emit_constant(compiler, STR_VALUE(node->data.string_value));
+    case NODE_INTEGER:
+        return emit_constant(compiler, INT_VALUE(node->data.integer_value));
+    case NODE_IDENTIFIER:
+        if (emit_slot_op(compiler, OP_GET, node) == FAILURE)
+        {
+            return FAILURE;
+        }
+        return adjust_stack(compiler, 1);
+    case NODE_BINARY_OP:
+    {
+        OpCode op = binary_op_to_opcode(node->data.binary_op.op);
+        if (op == OP_HALT)
+        {
+            fprintf(stderr, "Compile Error: Unsupported Binary Operation.\n");
+            return FAILURE;
+        }
+        if (compile_expression(compiler, node->data.binary_op.left) == FAILURE ||
+            compile_expression(compiler, node->data.binary_op.right) == FAILURE)
+        {
+            return FAILURE;
+        }
+        emit_byte(compiler, op);
+        return adjust_stack(compiler, -1);
+    }
+    case NODE_UNARY_OP:
+        if (compile_expression(compiler, node->data.unary_op.right) == FAILURE)
+        {
+            return FAILURE;
+        }
+        switch (node->data.unary_op.op)
+        {
+        case NEGATE:
+            emit_byte(compiler, OP_NEGATE);
+            return SUCCESS;
+        case LOGICAL_NOT:
+            emit_byte(compiler, OP_NOT);
+            return SUCCESS;
+        default:
+            fprintf(stderr, "Compile Error: Unsupported Unary Operation.\n");
+            return FAILURE;
+        }
+    default:
+        fprintf(stderr, "Compile Error: Invalid Expression.\n");
+        return FAILURE;
+    }
+}
+
+static int compile_declaration(Compiler *compiler, ASTNode *node)
+{
+    int status;
+    if (node->data.declaration.right)
+    {
+        status = compile_expression(compiler, node->data.declaration.right);
+    }
+    else
+    {
+        // Uninitialized variables hold -1, same as the tree-walking interpreter.
+        status = emit_constant(compiler, INT_VALUE(-1));
+    }
+    if (status == FAILURE)
+    {
+        return FAILURE;
+    }
+    compiler->stack_depth--;
+
+    ASTNode *identifier = node->data.declaration.identifier;
+    int slot = compiler->scope_base[compiler->scope_count - 1] + identifier->data.identifier.slot;
+    name_table_set(&compiler->names, slot, identifier->data.identifier.value);
+    return emit_slot_op(compiler, OP_SET, identifier);
+}
+
+static int compile_assignment(Compiler *compiler, ASTNode *node)
+{
+    // "s = s + x + y" only pushes x and y and appends them to s.
+    ASTNode *operands[APPEND_MAX];
+    int count = append_operands(node, operands);
+    if (count > 0)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (compile_expression(compiler, operands[i]) == FAILURE)
+            {
+                return FAILURE;
+            }
+        }
+        compiler->stack_depth -= count;
+        if (emit_slot_op(compiler, OP_APPEND, node->data.assignment.identifier) == FAILURE)
+        {
+            return FAILURE;
+        }
+        chunk_write_short(compiler->chunk, count);
+        return SUCCESS;
+    }
+
+    if (compile_expression(compiler, node->data.assignment.right) == FAILURE)
+    {
+        return FAILURE;
+    }
+    compiler->stack_depth--;
+    return emit_slot_op(compiler, OP_SET, node->data.assignment.identifier);
+}
+
+// Sets the variables that node may declare without running the
+// declaration to -1, see conditional_declaration().
+static int compile_conditional_declarations(Compiler *compiler, ASTNode *node)
+{
+    ASTNode *declaration;
+    for (int i = 0; (declaration = conditional_declaration(node, i)) != NULL; i++)
+    {
+        if (emit_constant(compiler, INT_VALUE(-1)) == FAILURE)
+        {
+            return FAILURE;
+        }
+        compiler->stack_depth--;
+        if (emit_slot_op(compiler, OP_SET, declaration->data.declaration.identifier) == FAILURE)
+        {
+            return FAILURE;
+        }
+    }
+    return SUCCESS;
+}
+
+static int compile_block(Compiler *compiler, ASTNode *node)
+{
+    if (push_scope(compiler, node->data.statement.slot_count) == FAILURE)
+    {
+        return FAILURE;
+    }
+    for (ASTNode *dummy = node->data.statement.data.head; dummy; dummy = dummy->next)
+    {
+        if (compile_conditional_declarations(compiler, dummy) == FAILURE ||
+            compile_statement(compiler, dummy) == FAILURE)
+        {
+            return FAILURE;
+        }
+    }
+    compiler->scope_count--;
+    return SUCCESS;
+}
+
+// Emits a JIT_LOOP in front of a loop the JIT compiles. Returns where its
+// jump offset lives, or -1 if the loop only runs as bytecode.
+static int compile_jit_loop(Compiler *compiler, ASTNode *statement)
+{
+    JitLoop *loop = jit_compile_loop(compiler->jit, statement);
+    if (loop->function == NULL)
+    {
+        return -1;
+    }
+
+    JitSite site;
+    site.loop = loop;
+    for (int i = 0; i < loop->variable_count; i++)
+    {
+        int scope = compiler->scope_count - 1 - loop->depths[i];
+        site.slots[i] = compiler->scope_base[scope] + loop->slots[i];
+    }
+    int index = chunk_add_jit_site(compiler->chunk, site);
+    if (index > UINT16_MAX)
+    {
+        return -1;
+    }
+    emit_short_op(compiler, OP_JIT_LOOP, index);
+    chunk_write_short(compiler->chunk, 0xffff);
+    return compiler->chunk->count - 2;
+}
+
+// WHILE:   [JIT_LOOP site end] condition; JUMP_IF_FALSE exit; body; LOOP start
+// The bytecode of a loop with a JIT_LOOP only runs when the machine code bails out.
+static int compile_while(Compiler *compiler, ASTNode *statement)
+{
+    ASTNode *node = statement->data.statement.data.expression;
+    int jit_jump = compiler->jit ? compile_jit_loop(compiler, statement) : -1;
+
+    int loop_start = compiler->chunk->count;
+    if (compile_expression(compiler, node) == FAILURE)
+    {
+        return FAILURE;
+    }
+    compiler->stack_depth--;
+    int exit_jump = emit_jump(compiler, OP_JUMP_IF_FALSE);
+    if (compile_statement(compiler, node->next) == FAILURE ||
+        emit_loop(compiler, loop_start) == FAILURE)
+    {
+        return FAILURE;
+    }
+    if (patch_jump(compiler, exit_jump) == FAILURE)
+    {
+        return FAILURE;
+    }
+    return jit_jump == -1 ? SUCCESS : patch_jump(compiler, jit_jump);
+}
+
+// IF:      condition; JUMP_IF_FALSE else; then; JUMP end; else
+static int compile_if(Compiler *compiler, ASTNode *node)
+{
+    if (compile_expression(compiler, node) == FAILURE)
+    {
+        return FAILURE;
+    }
+    compiler->stack_depth--;
+    int else_jump = emit_jump(compiler, OP_JUMP_IF_FALSE);
+    if (compile_statement(compiler, node->next) == FAILURE)
+    {
+        return FAILURE;
+    }
+
+    if (node->next->next == NULL)
+    {
+        return patch_jump(compiler, else_jump);
+    }
+
+    int end_jump = emit_jump(compiler, OP_JUMP);
+    if (patch_jump(compiler, else_jump) == FAILURE ||
+        compile_statement(compiler, node->next->next) == FAILURE)
+    {
+        return FAILURE;
+    }
+    return patch_jump(compiler, end_jump);
+}
+
+int compile_statement(Compiler *compiler, ASTNode *node)
+{
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+        return compile_declaration(compiler, node->data.statement.data.declaration);
+    case ASSIGNMENT:
+        return compile_assignment(compiler, node->data.statement.data.assignment);
+    case BLOCK_STATEMENT:
+        return compile_block(compiler, node);
+    case WHILE_STATEMENT:
+        return compile_while(compiler, node);
+    case PRINT_STATEMENT:
+        if (compile_expression(compiler, node->data.statement.data.expression) == FAILURE)
+        {
+            return FAILURE;
+        }
+        compiler->stack_depth--;
+        emit_byte(compiler, OP_PRINT);
+        return SUCCESS;
+    case IF_STATEMENT:
+        return compile_if(compiler, node->data.statement.data.expression);
+    default:
+        fprintf(stderr, "Compile Error: Unknown statement type %d!\n", node->data.statement.type);
+        return FAILURE;
+    }
+}
+
+// Compiles a NODE_PROGRAM that has been through resolve() into a new chunk.
+// Returns NULL (after reporting the error) if the program cannot be compiled.
+Chunk *compile(Compiler *compiler, ASTNode *program)
+{
+    compiler->chunk = create_chunk(&compiler->names);
+    compiler->stack_depth = 0;
+    compiler->scope_count = 0;
+    push_scope(compiler, program->data.program.slot_count);
+
+    // The first node of a program is a dummy head.
+    for (ASTNode *dummy = program->data.program.head->next; dummy; dummy = dummy->next)
+    {
+        if (dummy->type == NODE_EOF)
+        {
+            break;
+        }
+        if (compile_conditional_declarations(compiler, dummy) == FAILURE ||
+            compile_statement(compiler, dummy) == FAILURE)
+        {
+            free_chunk(compiler->chunk);
+            compiler->chunk = NULL;
+            return NULL;
+        }
+    }
+    emit_byte(compiler, OP_HALT);
+
+    Chunk *chunk = compiler->chunk;
+    compiler->chunk = NULL;
+    return chunk;
+}
+
+Compiler *create_compiler()
+{
+    Compiler *compiler = (Compiler *)malloc(sizeof(Compiler));
+    if (compiler == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for Compiler.\n");
+        exit(EXIT_FAILURE);
+    }
+    compiler->chunk = NULL;
+    compiler->stack_depth = 0;
+    compiler->scope_count = 0;
+    compiler->jit = NULL;
+    compiler->names.names = NULL;
+    compiler->names.count = 0;
+    compiler->names.capacity = 0;
+    return compiler;
+}
+
+void free_compiler(Compiler *compiler)
+{
+    for (int i = 0; i < compiler->names.count; i++)
+    {
+        free(compiler->names.names[i]);
+    }
+    free(compiler->names.names);
+    free(compiler);
+}
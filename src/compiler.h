@@ -0,0 +1,34 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "parser.h"
+#include "bytecode.h"
+
+#define SCOPE_MAX 256
+
+// Compiler lowers a resolved AST into bytecode for the VM.
+// Every variable gets a fixed VM slot: the slots of a block start right
+// after the slots of the scope that encloses it.
+typedef struct Compiler
+{
+    Chunk *chunk;
+    NameTable names;
+    int stack_depth;
+
+    // First VM slot and size of every open scope, globals first.
+    int scope_base[SCOPE_MAX];
+    int scope_size[SCOPE_MAX];
+    int scope_count;
+
+    // Compiles while loops to machine code when set (--jit).
+    Jit *jit;
+} Compiler;
+
+Compiler *create_compiler();
+void free_compiler(Compiler *compiler);
+
+Chunk *compile(Compiler *compiler, ASTNode *program);
+int compile_statement(Compiler *compiler, ASTNode *node);
+int compile_expression(Compiler *compiler, ASTNode *node);
+
+#endif // COMPILER_H
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "gc.h"
+
+#define HEAP_INITIAL_CAPACITY 256
+
+static size_t hash_address(void *data)
+{
+    uintptr_t address = (uintptr_t)data;
+    return (size_t)((address >> 3) * 0x9E3779B97F4A7C15ull);
+}
+
+static HeapObject **allocate_table(size_t capacity)
+{
+    HeapObject **table = (HeapObject **)calloc(capacity, sizeof(HeapObject *));
+    if (table == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for Heap->table.\n");
+        exit(EXIT_FAILURE);
+    }
+    return table;
+}
+
+static void table_insert(HeapObject **table, size_t capacity, HeapObject *object)
+{
+    size_t index = hash_address(object->data) & (capacity - 1);
+    while (table[index] != NULL)
+    {
+        index = (index + 1) & (capacity - 1);
+    }
+    table[index] = object;
+}
+
+// Rebuilds the address set for the objects in the list, sized for count.
+static void rebuild_table(Heap *heap, size_t count)
+{
+    size_t capacity = HEAP_INITIAL_CAPACITY;
+    while (count * 2 > capacity)
+    {
+        capacity *= 2;
+    }
+
+    free(heap->table);
+    heap->table = allocate_table(capacity);
+    heap->table_capacity = capacity;
+    for (HeapObject *object = heap->objects; object; object = object->next)
+    {
+        table_insert(heap->table, capacity, object);
+    }
+}
+
+// Returns the object whose data starts at data, NULL for anything else.
+static HeapObject *find_object(Heap *heap, void *data)
+{
+    size_t mask = heap->table_capacity - 1;
+    for (size_t index = hash_address(data) & mask; heap->table[index] != NULL; index = (index + 1) & mask)
+    {
+        if (heap->table[index]->data == (char *)data)
+        {
+            return heap->table[index];
+        }
+    }
+    return NULL;
+}
+
+Heap *create_heap()
+{
+    Heap *heap = (Heap *)malloc(sizeof(Heap));
+    if (heap == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for Heap.\n");
+        exit(EXIT_FAILURE);
+    }
+    heap->objects = NULL;
+    heap->table = allocate_table(HEAP_INITIAL_CAPACITY);
+    heap->table_capacity = HEAP_INITIAL_CAPACITY;
+    heap->object_count = 0;
+    heap->root_count = 0;
+    heap->bytes_allocated = 0;
+    heap->next_collection = HEAP_MIN_THRESHOLD;
+    heap->collections = 0;
+    heap->bytes_reclaimed = 0;
+    heap->peak_bytes = 0;
+    heap->total_pause = 0;
+    heap->longest_pause = 0;
+    return heap;
+}
+
+void free_heap(Heap *heap)
+{
+    HeapObject *object = heap->objects;
+    while (object)
+    {
+        HeapObject *next = object->next;
+        free(object);
+        object = next;
+    }
+    free(heap->table);
+    free(heap);
+}
+
+// Allocates size bytes that live until a collection finds them unreachable.
+// Never collects by itself, see heap_should_collect().
+void *heap_alloc(Heap *heap, size_t size)
+{
+    HeapObject *object = (HeapObject *)malloc(sizeof(HeapObject) + size);
+    if (object == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for HeapObject.\n");
+        exit(EXIT_FAILURE);
+    }
+    object->size = size;
+    object->marked = 0;
+    object->next = heap->objects;
+    heap->objects = object;
+
+    heap->object_count++;
+    if (heap->object_count * 2 > heap->table_capacity)
+    {
+        rebuild_table(heap, heap->object_count);
+    }
+    else
+    {
+        table_insert(heap->table, heap->table_capacity, object);
+    }
+
+    heap->bytes_allocated += size;
+    if (heap->bytes_allocated > heap->peak_bytes)
+    {
+        heap->peak_bytes = heap->bytes_allocated;
+    }
+    return object->data;
+}
+
+// Registers a root that is marked by every collection.
+void heap_add_root(Heap *heap, HeapMarkFunction mark, void *context)
+{
+    if (heap->root_count == HEAP_ROOT_MAX)
+    {
+        fprintf(stderr, "Runtime Error: Too many heap roots.\n");
+        exit(EXIT_FAILURE);
+    }
+    heap->roots[heap->root_count].mark = mark;
+    heap->roots[heap->root_count].context = context;
+    heap->root_count++;
+}
+
+// Marks the object at data. Pointers that are not heap objects are ignored.
+void heap_mark(Heap *heap, void *data)
+{
+    if (data == NULL)
+    {
+        return;
+    }
+    HeapObject *object = find_object(heap, data);
+    if (object)
+    {
+        object->marked = 1;
+    }
+}
+
+void heap_mark_value(Heap *heap, Value value)
+{
+    if (value.type == VAL_STR)
+    {
+        heap_mark(heap, string_of(value.as.string));
+    }
+}
+
+void heap_mark_values(Heap *heap, Value *values, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        heap_mark_value(heap, values[i]);
+    }
+}
+
+int heap_should_collect(Heap *heap)
+{
+    return heap->bytes_allocated >= heap->next_collection;
+}
+
+static double seconds_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Frees every object that neither the registered roots nor mark reach.
+// The next collection starts once the heap has doubled.
+void heap_collect(Heap *heap, HeapMarkFunction mark, void *context)
+{
+    double start = seconds_now();
+
+    for (int i = 0; i < heap->root_count; i++)
+    {
+        heap->roots[i].mark(heap, heap->roots[i].context);
+    }
+    if (mark)
+    {
+        mark(heap, context);
+    }
+
+    size_t freed = 0;
+    size_t live_count = 0;
+    HeapObject **link = &heap->objects;
+    while (*link)
+    {
+        HeapObject *object = *link;
+        if (object->marked)
+        {
+            object->marked = 0;
+            live_count++;
+            link = &object->next;
+            continue;
+        }
+        *link = object->next;
+        freed += object->size;
+        free(object);
+    }
+    // The set keeps its size, the heap is about to fill up again.
+    heap->object_count = live_count;
+    rebuild_table(heap, heap->table_capacity / 2);
+
+    heap->bytes_allocated -= freed;
+    heap->next_collection = heap->bytes_allocated * 2;
+    if (heap->next_collection < HEAP_MIN_THRESHOLD)
+    {
+        heap->next_collection = HEAP_MIN_THRESHOLD;
+    }
+
+    double pause = seconds_now() - start;
+    heap->collections++;
+    heap->bytes_reclaimed += freed;
+    heap->total_pause += pause;
+    if (pause > heap->longest_pause)
+    {
+        heap->longest_pause = pause;
+    }
+}
+
+void print_heap_stats(Heap *heap)
+{
+    fprintf(stderr, "GC %10zu collections, %zu bytes reclaimed\n", heap->collections, heap->bytes_reclaimed);
+    fprintf(stderr, "GC %10zu bytes live in %zu objects, peak %zu bytes\n", heap->bytes_allocated, heap->object_count, heap->peak_bytes);
+    fprintf(stderr, "GC %10.3f ms paused, longest %.3f ms\n", heap->total_pause * 1e3, heap->longest_pause * 1e3);
+}
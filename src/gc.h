@@ -0,0 +1,79 @@
+#ifndef GC_H
+#define GC_H
+
+#include <stddef.h>
+
+#include "value.h"
+
+// Collections start once this many bytes were allocated, and never earlier
+// than after this many bytes since the previous one.
+#define HEAP_MIN_THRESHOLD (1024 * 1024)
+#define HEAP_ROOT_MAX 8
+
+struct Heap;
+
+// Marks the objects a root can reach with heap_mark() and heap_mark_value().
+typedef void (*HeapMarkFunction)(struct Heap *heap, void *context);
+
+typedef struct HeapRoot
+{
+    HeapMarkFunction mark;
+    void *context;
+} HeapRoot;
+
+// Every heap object starts with this header, the caller gets data.
+typedef struct HeapObject
+{
+    struct HeapObject *next;
+    size_t size;
+    size_t marked;
+    char data[];
+} HeapObject;
+
+// Heap is a precise mark-sweep collector for the strings and environments
+// built at runtime. Objects are malloc'd one by one and kept in a list, and
+// a hash set of their addresses tells which values point into the heap;
+// strings from the source are never heap objects.
+//
+// Collections only happen at safepoints chosen by the engines, where no
+// value lives outside of the roots: the registered roots (slots that
+// outlive a run) and the roots of the running engine.
+typedef struct Heap
+{
+    HeapObject *objects;
+
+    // Open-addressing set of the data of every object, at most half full.
+    HeapObject **table;
+    size_t table_capacity;
+    size_t object_count;
+
+    HeapRoot roots[HEAP_ROOT_MAX];
+    int root_count;
+
+    size_t bytes_allocated;
+    size_t next_collection;
+
+    // Counters for --gc-stats.
+    size_t collections;
+    size_t bytes_reclaimed;
+    size_t peak_bytes;
+    double total_pause;
+    double longest_pause;
+} Heap;
+
+Heap *create_heap();
+void free_heap(Heap *heap);
+
+void *heap_alloc(Heap *heap, size_t size);
+void heap_add_root(Heap *heap, HeapMarkFunction mark, void *context);
+
+void heap_mark(Heap *heap, void *data);
+void heap_mark_value(Heap *heap, Value value);
+void heap_mark_values(Heap *heap, Value *values, int count);
+
+int heap_should_collect(Heap *heap);
+void heap_collect(Heap *heap, HeapMarkFunction mark, void *context);
+
+void print_heap_stats(Heap *heap);
+
+#endif // GC_H
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+
+#define INTERN_INITIAL_CAPACITY 256
+
+static String **allocate_entries(size_t capacity)
+{
+    String **entries = (String **)calloc(capacity, sizeof(String *));
+    if (entries == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for InternTable->entries.\n");
+        exit(EXIT_FAILURE);
+    }
+    return entries;
+}
+
+static void grow(InternTable *table)
+{
+    size_t capacity = table->capacity * 2;
+    String **entries = allocate_entries(capacity);
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        String *entry = table->entries[i];
+        if (entry == NULL)
+        {
+            continue;
+        }
+        size_t index = entry->hash & (capacity - 1);
+        while (entries[index] != NULL)
+        {
+            index = (index + 1) & (capacity - 1);
+        }
+        entries[index] = entry;
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+}
+
+// Returns the handle of the string of length bytes at chars, adding it to
+// the table the first time it is seen.
+char *intern(InternTable *table, const char *chars, size_t length)
+{
+    unsigned int hash = hash_chars(chars, length);
+    size_t mask = table->capacity - 1;
+    size_t index = hash & mask;
+    for (String *entry; (entry = table->entries[index]) != NULL; index = (index + 1) & mask)
+    {
+        if (entry->hash == hash && entry->length == length && memcmp(entry->chars, chars, length) == 0)
+        {
+            return entry->chars;
+        }
+    }
+
+    String *entry = string_of(string_init(arena_alloc(table->arena, string_size(length)), chars, length));
+    entry->hash = hash;
+    table->entries[index] = entry;
+    table->count++;
+
+    if (table->count * 2 > table->capacity)
+    {
+        grow(table);
+    }
+    return entry->chars;
+}
+
+InternTable *create_intern_table()
+{
+    InternTable *table = (InternTable *)malloc(sizeof(InternTable));
+    if (table == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for InternTable.\n");
+        exit(EXIT_FAILURE);
+    }
+    table->arena = create_arena("interned");
+    table->entries = allocate_entries(INTERN_INITIAL_CAPACITY);
+    table->count = 0;
+    table->capacity = INTERN_INITIAL_CAPACITY;
+    return table;
+}
+
+void free_intern_table(InternTable *table)
+{
+    free_arena(table->arena);
+    free(table->entries);
+    free(table);
+}
+
+void print_intern_stats(InternTable *table)
+{
+    print_arena_stats(table->arena);
+    fprintf(stderr, "Interned %10zu strings in %zu buckets\n", table->count, table->capacity);
+}
@@ -0,0 +1,29 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "str.h"
+
+// InternTable stores every distinct string once, so interned strings are
+// equal exactly when their handles are. Interned strings are Strings with
+// their hash computed, see str.h; the table is the constant pool of the
+// string literals and identifiers of every program of a run. The table is an open-addressing
+// hash set, at most half full. Strings live in arena until
+// free_intern_table().
+typedef struct InternTable
+{
+    Arena *arena;
+    String **entries;
+    size_t count;
+    size_t capacity;
+} InternTable;
+
+InternTable *create_intern_table();
+void free_intern_table(InternTable *table);
+
+char *intern(InternTable *table, const char *chars, size_t length);
+void print_intern_stats(InternTable *table);
+
+#endif // INTERN_H
@@ -1,6 +1,5 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
 
 #include "parser.h"
 #include "interpreter.h"
@@ -8,125 +7,245 @@
 
 // Variable management functions
 
-#define FAILURE -1
-#define SUCCESS 0
+// Returns the slot an identifier was bound to by resolve().
+// O(depth), no string comparisons.
+Value *lookup(Environment *environment, ASTNode *identifier)
+{
+    return lookup_slot(environment, identifier->data.identifier.depth, identifier->data.identifier.slot);
+}
 
-// Analysis of get()
-// O(m*n)
-// n = number of states
-// m = length of strings
-// Pretty bad...
-// Returns:
-// -1 = no value
-// K>=0 = depth of environments
-int get(Environment *environment, char *name, Variable *value)
+// Returns slot of the environment depth levels up.
+Value *lookup_slot(Environment *environment, int depth, int slot)
 {
-    if (environment == NULL)
+    for (; depth > 0; depth--)
     {
-        return FAILURE;
+        environment = environment->outer;
     }
-    State *dummy = environment->state;
-    while (dummy != NULL)
+    return &environment->slots[slot];
+}
+
+// Grows an environment to hold slot_count slots.
+// Only the global environment grows, when a REPL line declares new variables.
+void environment_reserve(Environment *environment, int slot_count)
+{
+    if (slot_count <= environment->slot_count)
     {
-        if (strcmp(name, dummy->data.name) == 0)
-        {
-            value->data = dummy->data.data;
-            value->type = dummy->data.type;
-            value->name = dummy->data.name;
-            return SUCCESS;
-        }
-        dummy = dummy->next;
+        return;
     }
 
-    // The only way you get here is if you didn't find it in the current environment.
-    // That means you must check outer.
-    int exists = get(environment->outer, name, value);
-    if (exists == -1)
+    Value *slots = (Value *)heap_alloc(environment->heap, slot_count * sizeof(Value));
+    for (int i = 0; i < environment->slot_count; i++)
     {
-        return FAILURE;
+        slots[i] = environment->slots[i];
+        // The string can no longer be appended to in place by its old slot.
+        if (slots[i].type == VAL_STR)
+        {
+            string_store(slots[i].as.string, NULL);
+        }
     }
-    else
+    environment->slots = slots;
+    for (int i = environment->slot_count; i < slot_count; i++)
     {
-        // Return the depth of the find.
-        return exists + 1;
+        environment->slots[i] = INT_VALUE(-1);
     }
+    environment->slot_count = slot_count;
 }
 
-int set(Environment *environment, char *name, void *data)
+static FrameStack *create_frame_stack()
 {
-    Variable temp;
-    int exists = get(environment, name, &temp);
-    if (exists == -1)
+    FrameStack *frames = (FrameStack *)malloc(sizeof(FrameStack));
+    if (frames == NULL)
     {
-        // If it doesn't exist, we CANNOT set it.
-        return FAILURE;
+        fprintf(stderr, "Failed to allocate memory for FrameStack.\n");
+        exit(EXIT_FAILURE);
+    }
+    frames->values = (Value *)malloc(FRAME_STACK_MAX * sizeof(Value));
+    if (frames->values == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for FrameStack->values.\n");
+        exit(EXIT_FAILURE);
     }
+    frames->top = frames->values;
+    for (int i = 0; i < LOOP_REGION_MAX; i++)
+    {
+        frames->regions[i] = NULL;
+    }
+    frames->region_count = 0;
+    return frames;
+}
 
-    Environment *env = environment;
-    while (exists)
+// Creates an environment on heap. An environment without an outer one
+// starts a run and gets the frame stack its blocks push their slots onto.
+Environment *create_empty_environment(Heap *heap, Environment *outer, int slot_count)
+{
+    // The slots are allocated right after the environment, so it costs a
+    // single heap object. Only the global environment grows later.
+    Environment *env = (Environment *)heap_alloc(heap, sizeof(Environment) + slot_count * sizeof(Value));
+    env->heap = heap;
+    env->outer = outer;
+    env->frames = outer ? outer->frames : create_frame_stack();
+    env->jit = outer ? outer->jit : NULL;
+    env->slots = (Value *)(env + 1);
+    env->slot_count = slot_count;
+    for (int i = 0; i < slot_count; i++)
     {
-        env = env->outer;
-        exists--;
+        env->slots[i] = INT_VALUE(-1);
     }
 
-    State *dummy = env->state->next;
-    while (dummy)
+    return env;
+}
+
+// Releases the frame stack of a global environment. The environment itself
+// is freed with its heap.
+void free_environment(Environment *environment)
+{
+    if (environment->outer == NULL)
     {
-        if (strcmp(name, dummy->data.name) == 0)
+        FrameStack *frames = environment->frames;
+        for (int i = 0; i < LOOP_REGION_MAX && frames->regions[i]; i++)
         {
-            dummy->data.data = data;
-            return SUCCESS;
+            free_arena(frames->regions[i]);
         }
-        dummy = dummy->next;
+        free(frames->values);
+        free(frames);
     }
-
-    return FAILURE;
 }
 
-// Declares the variable in the current (lowest) environment.
-int declare(Environment *environment, char *name, char *type, void *data)
+// Pushes the frame of a block running in env. The slots start as -1, like
+// the variables of a declaration without a value.
+static int enter_block(Environment *env, Environment *block, int slot_count)
 {
-    // Declare is either called when "int NAME (= VALUE)?;" is written.
-    // As such, it cannot be used when a variable already exists.
-    Variable temp;
-    int exists = get(environment, name, &temp);
-    if (exists != -1)
+    FrameStack *frames = env->frames;
+    if (frames->top + slot_count > frames->values + FRAME_STACK_MAX)
     {
+        fprintf(stderr, "Runtime Error: Too many variables in nested blocks.\n");
         return FAILURE;
     }
 
-    State *new = (State *)malloc(sizeof(State));
-    new->data.name = (char *)malloc(strlen(name));
-    strcpy(new->data.name, name);
-    new->data.type = (char *)malloc(strlen(type));
-    strcpy(new->data.type, type);
-    new->data.data = data;
-    new->next = NULL;
+    block->outer = env;
+    block->slots = frames->top;
+    block->slot_count = slot_count;
+    block->heap = env->heap;
+    block->frames = frames;
+    block->jit = env->jit;
+    frames->top += slot_count;
+    for (int i = 0; i < slot_count; i++)
+    {
+        block->slots[i] = INT_VALUE(-1);
+    }
+    return SUCCESS;
+}
 
-    State *dummy = environment->state;
-    while (dummy && dummy->next != NULL)
+// Pops the frame of a block, releasing all of its slots.
+static void leave_block(Environment *block)
+{
+    block->frames->top = block->slots;
+}
+
+// Starts the region of a while loop. Returns NULL when loops are nested
+// too deeply, the loop then uses the region of the loop around it.
+static Arena *push_region(Environment *env)
+{
+    FrameStack *frames = env->frames;
+    if (frames->region_count == LOOP_REGION_MAX)
     {
-        dummy = dummy->next;
+        return NULL;
     }
-    dummy->next = new;
+    int index = frames->region_count++;
+    if (frames->regions[index] == NULL)
+    {
+        frames->regions[index] = create_arena("loop");
+    }
+    frames->region_bases[index] = frames->top;
+    return frames->regions[index];
+}
 
-    return SUCCESS;
+static void pop_region(Environment *env, Arena *region)
+{
+    if (region)
+    {
+        arena_clear(region);
+        env->frames->region_count--;
+    }
 }
 
-Environment *create_empty_environment(Environment *outer)
+// Region the strings built right now are allocated in, NULL outside of loops.
+static Arena *current_region(Environment *env)
 {
-    Environment *env = (Environment *)malloc(sizeof(Environment));
-    env->outer = outer;
-    State *state = (State *)malloc(sizeof(State));
+    FrameStack *frames = env->frames;
+    return frames->region_count > 0 ? frames->regions[frames->region_count - 1] : NULL;
+}
 
-    state->data.name = (char *)malloc(1 * sizeof(char));
-    strcpy(state->data.name, "");
-    int val = -1;
-    state->data.data = (int *)&val;
-    state->next = NULL;
-    env->state = state;
+// Returns whether slot still exists after an iteration of the loop that
+// started region index: it belongs to a block around the loop, or to the
+// global environment.
+static int outlives_region(FrameStack *frames, Value *slot, int index)
+{
+    return slot < frames->region_bases[index] || slot >= frames->values + FRAME_STACK_MAX;
+}
 
-    return env;
+// Stores value in slot. A string from the region of a loop is promoted to
+// the heap when the slot outlives the iteration that built it.
+static void store(Environment *env, Value *slot, Value value)
+{
+    FrameStack *frames = env->frames;
+    if (value.type == VAL_STR)
+    {
+        for (int i = frames->region_count - 1; i >= 0; i--)
+        {
+            if (!arena_contains(frames->regions[i], value.as.string))
+            {
+                continue;
+            }
+            if (outlives_region(frames, slot, i))
+            {
+                size_t length = string_length(value.as.string);
+                value = STR_VALUE(string_init(heap_alloc(env->heap, string_size(length)), value.as.string, length));
+            }
+            break;
+        }
+        string_store(value.as.string, slot);
+    }
+    *slot = value;
+}
+
+// Evaluates the value of a declaration or assignment to slot. When the slot
+// outlives the current iteration, new strings are built on the heap right
+// away instead of being promoted by store().
+static Value visit_stored_expression(Environment *env, Value *slot, ASTNode *node)
+{
+    FrameStack *frames = env->frames;
+    int region_count = frames->region_count;
+    if (region_count > 0 && node->type == NODE_BINARY_OP && outlives_region(frames, slot, region_count - 1))
+    {
+        frames->region_count = 0;
+        Value value = visit_expression(env, node);
+        frames->region_count = region_count;
+        return value;
+    }
+    return visit_expression(env, node);
+}
+
+// Marks an environment, its slots and the values in them, then the
+// environments around it.
+void mark_environment(Heap *heap, void *environment)
+{
+    for (Environment *env = (Environment *)environment; env; env = env->outer)
+    {
+        heap_mark(heap, env);
+        heap_mark(heap, env->slots);
+        heap_mark_values(heap, env->slots, env->slot_count);
+    }
+}
+
+// Safepoint, called between statements: no value is held outside of the
+// environment chain there, so it is all the collector has to mark.
+static void collect_garbage(Environment *env)
+{
+    if (heap_should_collect(env->heap))
+    {
+        heap_collect(env->heap, mark_environment, env);
+    }
 }
 
 // INT as in STATUS
@@ -142,12 +261,18 @@ int interpret(Environment *environment, ASTNode *node)
     }
 
     if (environment == NULL)
-        environment = create_empty_environment(NULL);
+    {
+        fprintf(stderr, "Runtime Error: Attempting to interpret without an environment.\n");
+        return FAILURE;
+    }
+    environment_reserve(environment, node->data.program.slot_count);
 
-    ASTNode *dummy = node->data.program.head;
+    // The first node of a program is a dummy head.
+    ASTNode *dummy = node->data.program.head->next;
     int status = SUCCESS;
     while (dummy)
     {
+        collect_garbage(environment);
         switch (dummy->type)
         {
         case NODE_PROGRAM:
@@ -176,194 +301,108 @@ int interpret(Environment *environment, ASTNode *node)
     return SUCCESS;
 }
 
-Variable *visit_string(Environment *env, ASTNode *node)
+// String literals are never modified, so the AST's copy is shared.
+Value visit_string(Environment *env, ASTNode *node)
 {
-    Variable *res = (Variable *)malloc(sizeof(Variable));
-    res->type = "str";
-    res->name = "dummy";
-
-    char *value = (char *)malloc(sizeof(char) * (strlen(node->data.string_value) + 1));
-    strcpy(value, node->data.string_value);
-    res->data = value;
-
-    return res;
+    return STR_VALUE(node->data.string_value);
 }
 
-Variable *visit_integer(Environment *env, ASTNode *node)
+Value visit_integer(Environment *env, ASTNode *node)
 {
-    Variable *res = (Variable *)malloc(sizeof(Variable));
-    res->type = "int";
-    res->name = "dummy";
-
-    int *value = (int *)malloc(sizeof(int));
-    *value = node->data.integer_value;
-    res->data = value;
-
-    return res;
+    return INT_VALUE(node->data.integer_value);
 }
 
-Variable *visit_identifier(Environment *env, ASTNode *node)
+Value visit_identifier(Environment *env, ASTNode *node)
 {
-    Variable *res = (Variable *)malloc(sizeof(Variable));
-    int status = get(env, node->data.identifier_value, res);
-    if (status == FAILURE)
-    {
-        fprintf(stderr, "Runtime Error: Unknown variable '%s'\n", node->data.identifier_value);
-        exit(EXIT_FAILURE); // TODO: handle this
-    }
-    return res;
+    return *lookup(env, node);
 }
 
-Variable *visit_binary_op(Environment *env, ASTNode *node)
+// Runs the specialized handler of an int operation, or deoptimizes when
+// an operand is not an int.
+#define INT_HANDLER(handler, expr)                             \
+    case handler:                                              \
+        if (left.type == VAL_INT && right.type == VAL_INT)     \
+        {                                                      \
+            int lhs = left.as.integer;                         \
+            int rhs = right.as.integer;                        \
+            return INT_VALUE(expr);                            \
+        }                                                      \
+        goto deoptimize;
+
+Value visit_binary_op(Environment *env, ASTNode *node)
 {
-    Variable *res = (Variable *)malloc(sizeof(Variable));
-    res->name = "dummy";
-
-    Variable *left = visit_expression(env, node->data.binary_op.left);
-    Variable *right = visit_expression(env, node->data.binary_op.right);
-
-    if (strcmp(left->type, right->type) != 0)
-    {
-        fprintf(stderr, "Runtime Error: Unsupported Binary Operation on two different types.\n");
-        exit(EXIT_FAILURE); // TODO: handle this
-    }
+    Value left = visit_expression(env, node->data.binary_op.left);
+    Value right = visit_expression(env, node->data.binary_op.right);
+    Value res;
 
-    if (strcmp(left->type, "str") == 0)
+    switch (node->data.binary_op.handler)
     {
-        res->type = "int";
-        int *lhs = malloc(sizeof(int));
-        switch (node->data.binary_op.op)
+        INT_HANDLER(HANDLER_INT_ADD, lhs + rhs)
+        INT_HANDLER(HANDLER_INT_SUBTRACT, lhs - rhs)
+        INT_HANDLER(HANDLER_INT_MULTIPLY, lhs * rhs)
+        INT_HANDLER(HANDLER_INT_EQUAL, lhs == rhs)
+        INT_HANDLER(HANDLER_INT_LESS, lhs < rhs)
+        INT_HANDLER(HANDLER_INT_LESS_EQUAL, lhs <= rhs)
+        INT_HANDLER(HANDLER_INT_GREATER, lhs > rhs)
+        INT_HANDLER(HANDLER_INT_GREATER_EQUAL, lhs >= rhs)
+        INT_HANDLER(HANDLER_INT_NOT_EQUAL, lhs != rhs)
+    case HANDLER_INT_DIVIDE:
+        if (left.type == VAL_INT && right.type == VAL_INT)
         {
-        case ADD:
-            res->type = "str";
-            lhs = malloc(strlen(left->data) + strlen(right->data) + 1);
-            strcpy((char *)lhs, left->data);
-            strcat((char *)lhs, right->data);
-            break;
-        case SUBTRACT:
-            fprintf(stderr, "Runtime Error: Cannot subtract strings.\n");
-            exit(EXIT_FAILURE); // TODO: handle this
-            break;
-        case MULTIPLY:
-            fprintf(stderr, "Runtime Error: Cannot multiply strings.\n");
-            exit(EXIT_FAILURE); // TODO: handle this
-            break;
-        case DIVIDE:
-            fprintf(stderr, "Cannot divide strings.\n");
-            exit(EXIT_FAILURE); // TODO: handle this
-            break;
-        case IS_EQUAL:
-            *lhs = (strcmp(left->data, right->data) == 0);
-            break;
-        case IS_LESS_THAN:
-            *lhs = (strcmp(left->data, right->data) < 0);
-            break;
-        case LESS_THAN_EQUAL:
-            *lhs = (strcmp(left->data, right->data) <= 0);
-            break;
-        case IS_GREATER_THAN:
-            *lhs = (strcmp(left->data, right->data) > 0);
-            break;
-        case GREATER_THAN_EQUAL:
-            *lhs = (strcmp(left->data, right->data) >= 0);
-            break;
-        case IS_NOT_EQUAL:
-            *lhs = (strcmp(left->data, right->data) != 0);
-            break;
-        default:
-            fprintf(stderr, "Runtime Error: Unsupported Binary Operation.\n");
-            exit(EXIT_FAILURE); // TODO: handle this
+            // Division by zero is reported by value_binary_op().
+            if (right.as.integer != 0)
+            {
+                return INT_VALUE(left.as.integer / right.as.integer);
+            }
             break;
         }
-        res->data = lhs;
-    }
-    else if (strcmp(left->type, "int") == 0)
-    {
-        res->type = "int";
-        char *lhs = malloc(sizeof(int));
-        switch (node->data.binary_op.op)
+        goto deoptimize;
+    case HANDLER_STR_ADD:
+    case HANDLER_STR_COMPARE:
+        if (left.type == VAL_STR && right.type == VAL_STR)
         {
-        case ADD:
-            *lhs = *(int *)left->data + *(int *)right->data;
-            break;
-        case SUBTRACT:
-            *lhs = *(int *)left->data - *(int *)right->data;
-            break;
-        case MULTIPLY:
-            *lhs = *(int *)left->data * *(int *)right->data;
-            break;
-        case DIVIDE:
-            *lhs = *(int *)left->data / *(int *)right->data;
-            break;
-        case IS_EQUAL:
-            *lhs = *(int *)left->data == *(int *)right->data;
-            break;
-        case IS_LESS_THAN:
-            *lhs = *(int *)left->data < *(int *)right->data;
-            break;
-        case LESS_THAN_EQUAL:
-            *lhs = *(int *)left->data <= *(int *)right->data;
-            break;
-        case IS_GREATER_THAN:
-            *lhs = *(int *)left->data > *(int *)right->data;
-            break;
-        case GREATER_THAN_EQUAL:
-            *lhs = *(int *)left->data >= *(int *)right->data;
-            break;
-        case IS_NOT_EQUAL:
-            *lhs = *(int *)left->data != *(int *)right->data;
-            break;
-        default:
-            fprintf(stderr, "Runtime Error: Unsupported Binary Operation.\n");
-            exit(EXIT_FAILURE); // TODO: handle this
             break;
         }
-        res->data = lhs;
+        goto deoptimize;
+    case HANDLER_UNQUICKENED:
+        node->data.binary_op.handler = binary_handler_for(node->data.binary_op.op, left.type, right.type);
+        break;
+    case HANDLER_GENERIC:
+        break;
+    deoptimize:
+        node->data.binary_op.handler = HANDLER_GENERIC;
+        break;
     }
-    else
+
+    // Strings built inside a loop go to its region, see store().
+    Arena *region = current_region(env);
+    if (region && node->data.binary_op.op == ADD && left.type == VAL_STR && right.type == VAL_STR)
     {
-        fprintf(stderr, "Runtime Error: Unexpected type '%s'.\n", left->type);
-        exit(EXIT_FAILURE); // TODO: handle this
+        size_t length = string_length(left.as.string) + string_length(right.as.string);
+        return STR_VALUE(string_concat(arena_alloc(region, string_size(length)), left.as.string, right.as.string));
     }
 
+    if (value_binary_op(env->heap, node->data.binary_op.op, left, right, &res) == FAILURE)
+    {
+        exit(EXIT_FAILURE); // TODO: handle this
+    }
     return res;
 }
 
-Variable *visit_unary_op(Environment *env, ASTNode *node)
+Value visit_unary_op(Environment *env, ASTNode *node)
 {
-    Variable *res = (Variable *)malloc(sizeof(Variable));
-    res->type = "int";
-    res->name = "dummy";
-
-    Variable *right = visit_expression(env, node->data.unary_op.right);
+    Value right = visit_expression(env, node->data.unary_op.right);
 
-    if (strcmp(right->type, "int") != 0)
+    Value res;
+    if (value_unary_op(node->data.unary_op.op, right, &res) == FAILURE)
     {
-        fprintf(stderr, "Runtime Error: Unsupported Unary Operation on non-integer value.\n");
         exit(EXIT_FAILURE); // TODO: handle this
     }
-
-    int *lhs = malloc(sizeof(int));
-    switch (node->data.unary_op.op)
-    {
-    case NEGATE:
-        *lhs = 0 - (*(int *)right->data);
-        break;
-    case LOGICAL_NOT:
-        *lhs = !*(int *)right->data;
-        break;
-    default:
-        fprintf(stderr, "Runtime Error: Unsupported Unary Operation.\n");
-        exit(EXIT_FAILURE); // TODO: handle this
-        break;
-    }
-    res->data = lhs;
-
     return res;
 }
 
-// Integer will set variable.data to the value of the integer
-Variable *visit_expression(Environment *env, ASTNode *node)
+// Evaluates an expression node. Values are returned by copy, nothing is allocated for integers.
+Value visit_expression(Environment *env, ASTNode *node)
 {
     switch (node->type)
     {
@@ -384,66 +423,57 @@ Variable *visit_expression(Environment *env, ASTNode *node)
         break;
     default:
         fprintf(stderr, "Runtime Error: Invalid Expression.\n");
-        return NULL;
+        exit(EXIT_FAILURE); // TODO: handle this
         break;
     }
 }
 
 int visit_declaration(Environment *env, ASTNode *node)
 {
-    Variable *data;
+    // The declared type is not checked yet, the variable takes the type of its value.
+    Value *slot = lookup(env, node->data.declaration.identifier);
+    Value data = INT_VALUE(-1);
     if (node->data.declaration.right)
     {
-        data = visit_expression(env, node->data.declaration.right);
+        data = visit_stored_expression(env, slot, node->data.declaration.right);
     }
-    else
-    {
-        data = (Variable *)malloc(sizeof(Variable));
 
-        int *value = (int *)malloc(sizeof(int));
-        *value = -1;
-        data->data = value;
+    store(env, slot, data);
+    return SUCCESS;
+}
 
-        data->name = "dummy";
-        data->type = "void";
+// Runs "s = s + x + y" for the slot of s and the expressions x and y.
+static int visit_append(Environment *env, Value *slot, ASTNode **operands, int count)
+{
+    Value parts[APPEND_MAX];
+    for (int i = 0; i < count; i++)
+    {
+        parts[i] = visit_expression(env, operands[i]);
     }
-
-    int status = declare(
-        env,
-        node->data.declaration.identifier->data.identifier_value,
-        node->data.declaration.type->data.type.identifier->data.identifier_value,
-        data->data);
-
-    if (status == FAILURE)
+    if (count == 1 && slot->type == VAL_INT && parts[0].type == VAL_INT)
     {
-        fprintf(stderr, "Runtime Error: Unable to declare variable '%s'. Has it already been declared?\n", node->data.declaration.identifier->data.identifier_value);
-        return FAILURE;
+        slot->as.integer += parts[0].as.integer;
+        return SUCCESS;
     }
-
-    return SUCCESS;
+    return value_append_all(env->heap, slot, parts, count);
 }
 
 int visit_assignment(Environment *env, ASTNode *node)
 {
-    Variable *data = visit_expression(env, node->data.assignment.right);
-
-    int status = set(
-        env,
-        node->data.assignment.identifier->data.identifier_value,
-        data->data);
-
-    if (status == FAILURE)
+    Value *slot = lookup(env, node->data.assignment.identifier);
+    ASTNode *operands[APPEND_MAX];
+    int count = append_operands(node, operands);
+    if (count > 0)
     {
-        fprintf(stderr, "Runtime Error: Unable to update variable '%s'. Has it been declared yet?\n", node->data.assignment.identifier->data.identifier_value);
-        exit(EXIT_FAILURE); // TODO: handle this
+        return visit_append(env, slot, operands, count);
     }
-
+    store(env, slot, visit_stored_expression(env, slot, node->data.assignment.right));
     return SUCCESS;
 }
 
 int visit_statement(Environment *env, ASTNode *node)
 {
-    Environment *new_env;
+    Environment block;
     // int status = SUCCESS;
     switch (node->data.statement.type)
     {
@@ -454,12 +484,19 @@ int visit_statement(Environment *env, ASTNode *node)
         return visit_assignment(env, node->data.statement.data.assignment);
         break;
     case BLOCK_STATEMENT:
-        new_env = create_empty_environment(env);
-        int status = visit_block_statement(new_env, node->data.statement.data.head);
-        // TODO: free env
+        if (enter_block(env, &block, node->data.statement.slot_count) == FAILURE)
+        {
+            return FAILURE;
+        }
+        int status = visit_block_statement(&block, node->data.statement.data.head);
+        leave_block(&block);
         return status;
         break;
     case WHILE_STATEMENT:
+        if (env->jit && visit_jit_loop(env, node) == JIT_DONE)
+        {
+            return SUCCESS;
+        }
         return visit_while_statement(env, node->data.statement.data.expression);
         break;
     // case FOR_STATEMENT:
@@ -483,6 +520,7 @@ int visit_block_statement(Environment *env, ASTNode *node)
     ASTNode *dummy = node;
     while (dummy)
     {
+        collect_garbage(env);
         int status = visit_statement(env, dummy);
         if (status == FAILURE)
         {
@@ -493,24 +531,56 @@ int visit_block_statement(Environment *env, ASTNode *node)
     return SUCCESS;
 }
 
+// Runs a while statement as machine code, compiling it the first time.
+// Returns JIT_BAILOUT if the loop has to be interpreted instead.
+int visit_jit_loop(Environment *env, ASTNode *node)
+{
+    if (node->data.statement.jit_loop == NULL)
+    {
+        node->data.statement.jit_loop = jit_compile_loop(env->jit, node);
+    }
+
+    JitLoop *loop = node->data.statement.jit_loop;
+    if (loop->function == NULL)
+    {
+        return JIT_BAILOUT;
+    }
+
+    Value *variables[JIT_MAX_VARIABLES];
+    for (int i = 0; i < loop->variable_count; i++)
+    {
+        variables[i] = lookup_slot(env, loop->depths[i], loop->slots[i]);
+    }
+    return jit_run_loop(loop, variables);
+}
+
 int visit_while_statement(Environment *env, ASTNode *node)
 {
-    Variable *data;
-    while (data = visit_expression(env, node), *(int *)data->data)
+    Arena *region = push_region(env);
+    int status = SUCCESS;
+    while (value_is_truthy(visit_expression(env, node)))
     {
-        int status = visit_statement(env, node->next);
+        collect_garbage(env);
+        status = visit_statement(env, node->next);
         if (status == FAILURE)
         {
-            return FAILURE;
+            break;
+        }
+
+        // Back edge: whatever the iteration built and did not store in an
+        // outer slot is dropped at once.
+        if (region)
+        {
+            arena_clear(region);
         }
     }
-    return SUCCESS;
+    pop_region(env, region);
+    return status;
 }
 
 int visit_if_statement(Environment *env, ASTNode *node)
 {
-    Variable *data = visit_expression(env, node);
-    if (*(int *)data->data)
+    if (value_is_truthy(visit_expression(env, node)))
     {
         return visit_statement(env, node->next);
     }
@@ -531,23 +601,7 @@ int visit_for_statement(Environment *env, ASTNode *node)
 
 int visit_print_statement(Environment *env, ASTNode *node)
 {
-    Variable *data = visit_expression(env, node);
-    if (strcmp(data->type, "int") == 0)
-    {
-        int *int_ptr = (int *)data->data;
-        printf("%d\n", *int_ptr);
-    }
-    else if (strcmp(data->type, "str") == 0)
-    {
-        char *str_ptr = (char *)data->data;
-        printf("%s\n", str_ptr);
-    }
-    else
-    {
-        // SHOULD NOT HAPPEN?
-        fprintf(stderr, "Runtime Error: Cannot print invalid type\n");
-        return FAILURE;
-    }
+    print_value(visit_expression(env, node));
     return SUCCESS;
 }
 
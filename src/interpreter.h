@@ -1,45 +1,74 @@
+#include "gc.h"
+#include "jit.h"
 #include "parser.h"
+#include "value.h"
 
-typedef struct
-{
-    char *name;
-    char *type;
-    void *data;
-} Variable;
-
-// State is a linked list of Variables
-// Ex. int x = 5;
-// type: int; name: x; value: 5
-typedef struct State
+// Slots of all block frames of a run.
+#define FRAME_STACK_MAX (64 * 1024)
+// While loops nested deeper share the region of the loop around them.
+#define LOOP_REGION_MAX 64
+
+// FrameStack holds the slots of every open block, innermost last. Entering
+// a block pushes its slots and leaving it pops them again, so nothing is
+// allocated per block.
+//
+// Every running while loop also gets a scratch region for the strings its
+// iterations build, emptied at the end of each iteration. A string stored
+// in a slot that outlives the iteration is copied to the heap first.
+typedef struct FrameStack
 {
-    Variable data;
-    struct State *next;
-} State;
+    Value *values;
+    Value *top;
+
+    // Regions of the running loops, innermost last, and the top of the
+    // frame stack when each loop started. Regions are kept for reuse.
+    Arena *regions[LOOP_REGION_MAX];
+    Value *region_bases[LOOP_REGION_MAX];
+    int region_count;
+} FrameStack;
 
-// Environment holds a list of states and its outer environment
+// Environment holds the slots of one scope and its outer environment.
+// Slot numbers are assigned by resolve().
+// The global environment and the strings built at runtime are allocated on
+// heap. Block environments live on the C stack while the block runs, and
+// their slots on the frame stack.
 typedef struct Environment
 {
     struct Environment *outer;
-    State *state;
+    Value *slots;
+    int slot_count;
+    Heap *heap;
+
+    // Shared by every environment of a run.
+    FrameStack *frames;
+
+    // Set with --jit, shared by every environment of a run.
+    Jit *jit;
 } Environment;
 
-Environment *create_empty_environment(Environment *outer);
+Environment *create_empty_environment(Heap *heap, Environment *outer, int slot_count);
+void free_environment(Environment *environment);
+void mark_environment(Heap *heap, void *environment);
+void environment_reserve(Environment *environment, int slot_count);
+Value *lookup(Environment *environment, ASTNode *identifier);
+Value *lookup_slot(Environment *environment, int depth, int slot);
 
 int interpret(Environment *environment, ASTNode *node);
 int visit_declaration(Environment *env, ASTNode *node);
 int visit_assignment(Environment *env, ASTNode *node);
 int visit_statement(Environment *env, ASTNode *node);
 int visit_block_statement(Environment *env, ASTNode *node);
+int visit_jit_loop(Environment *env, ASTNode *node);
 int visit_while_statement(Environment *env, ASTNode *node);
 int visit_for_statement(Environment *env, ASTNode *node);
 int visit_print_statement(Environment *env, ASTNode *node);
 int visit_if_statement(Environment *env, ASTNode *node);
 
-Variable *visit_string(Environment *env, ASTNode *node);
-Variable *visit_integer(Environment *env, ASTNode *node);
-Variable *visit_identifier(Environment *env, ASTNode *node);
-Variable *visit_binary_op(Environment *env, ASTNode *node);
-Variable *visit_unary_op(Environment *env, ASTNode *node);
-Variable *visit_expression(Environment *env, ASTNode *node);
+Value visit_string(Environment *env, ASTNode *node);
+Value visit_integer(Environment *env, ASTNode *node);
+Value visit_identifier(Environment *env, ASTNode *node);
+Value visit_binary_op(Environment *env, ASTNode *node);
+Value visit_unary_op(Environment *env, ASTNode *node);
+Value visit_expression(Environment *env, ASTNode *node);
 
 int visit_eof(Environment *env, ASTNode *node);
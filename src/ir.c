@@ -0,0 +1,1284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ir.h"
+
+#define IR_SCOPE_MAX 256
+
+// IrBuilder turns statements into blocks, numbering variables like the VM
+// numbers its slots. SSA form is built on the fly: reading a variable looks
+// up its definition in the current block, then in the predecessors, adding
+// phis where control flow joins (Braun et al., "Simple and Efficient
+// Construction of Static Single Assignment Form").
+typedef struct IrBuilder
+{
+    IrFunction *function;
+    IrBlock *current;
+
+    int scope_base[IR_SCOPE_MAX];
+    int scope_size[IR_SCOPE_MAX];
+    int scope_count;
+    int failed;
+} IrBuilder;
+
+// Instructions and blocks
+
+static IrInstr *create_instr(IrFunction *function, IrOp op)
+{
+    IrInstr *instr = (IrInstr *)arena_alloc(function->arena, sizeof(IrInstr));
+    memset(instr, 0, sizeof(IrInstr));
+    instr->op = op;
+    instr->id = function->instr_count++;
+    return instr;
+}
+
+static void add_operand(IrFunction *function, IrInstr *instr, IrInstr *operand)
+{
+    if (instr->operand_count == instr->operand_capacity)
+    {
+        int capacity = instr->operand_capacity < 2 ? 2 : instr->operand_capacity * 2;
+        IrInstr **operands = (IrInstr **)arena_alloc(function->arena, capacity * sizeof(IrInstr *));
+        for (int i = 0; i < instr->operand_count; i++)
+        {
+            operands[i] = instr->operands[i];
+        }
+        instr->operands = operands;
+        instr->operand_capacity = capacity;
+    }
+    instr->operands[instr->operand_count++] = operand;
+}
+
+static void append_instr(IrBlock *block, IrInstr *instr)
+{
+    instr->block = block;
+    instr->prev = block->last;
+    instr->next = NULL;
+    if (block->last)
+    {
+        block->last->next = instr;
+    }
+    else
+    {
+        block->first = instr;
+    }
+    block->last = instr;
+}
+
+// Phis go before every other instruction of a block.
+static void prepend_instr(IrBlock *block, IrInstr *instr)
+{
+    instr->block = block;
+    instr->prev = NULL;
+    instr->next = block->first;
+    if (block->first)
+    {
+        block->first->prev = instr;
+    }
+    else
+    {
+        block->last = instr;
+    }
+    block->first = instr;
+}
+
+void ir_insert_before(IrInstr *position, IrInstr *instr)
+{
+    IrBlock *block = position->block;
+    instr->block = block;
+    instr->prev = position->prev;
+    instr->next = position;
+    if (position->prev)
+    {
+        position->prev->next = instr;
+    }
+    else
+    {
+        block->first = instr;
+    }
+    position->prev = instr;
+}
+
+void ir_remove_instr(IrInstr *instr)
+{
+    IrBlock *block = instr->block;
+    if (instr->prev)
+    {
+        instr->prev->next = instr->next;
+    }
+    else
+    {
+        block->first = instr->next;
+    }
+    if (instr->next)
+    {
+        instr->next->prev = instr->prev;
+    }
+    else
+    {
+        block->last = instr->prev;
+    }
+    instr->prev = NULL;
+    instr->next = NULL;
+}
+
+static IrBlock *create_block(IrFunction *function)
+{
+    IrBlock *block = (IrBlock *)arena_alloc(function->arena, sizeof(IrBlock));
+    memset(block, 0, sizeof(IrBlock));
+    block->id = function->block_count;
+
+    if (function->block_count == function->block_capacity)
+    {
+        function->block_capacity = function->block_capacity < 16 ? 16 : function->block_capacity * 2;
+        function->blocks = (IrBlock **)realloc(function->blocks, function->block_capacity * sizeof(IrBlock *));
+        if (function->blocks == NULL)
+        {
+            fprintf(stderr, "Failed to allocate memory for IrFunction->blocks.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    function->blocks[function->block_count++] = block;
+    return block;
+}
+
+static void add_predecessor(IrFunction *function, IrBlock *block, IrBlock *predecessor)
+{
+    if (block->predecessor_count == block->predecessor_capacity)
+    {
+        int capacity = block->predecessor_capacity < 2 ? 2 : block->predecessor_capacity * 2;
+        IrBlock **predecessors = (IrBlock **)arena_alloc(function->arena, capacity * sizeof(IrBlock *));
+        for (int i = 0; i < block->predecessor_count; i++)
+        {
+            predecessors[i] = block->predecessors[i];
+        }
+        block->predecessors = predecessors;
+        block->predecessor_capacity = capacity;
+    }
+    block->predecessors[block->predecessor_count++] = predecessor;
+}
+
+// Follows the replacements set by the passes.
+IrInstr *ir_resolve(IrInstr *instr)
+{
+    while (instr->replacement)
+    {
+        instr = instr->replacement;
+    }
+    return instr;
+}
+
+// Points every operand at the instruction that replaced it, then removes
+// the replaced instructions.
+void ir_apply_replacements(IrFunction *function)
+{
+    for (int b = 0; b < function->block_count; b++)
+    {
+        IrInstr *instr = function->blocks[b]->first;
+        while (instr)
+        {
+            IrInstr *next = instr->next;
+            if (instr->replacement)
+            {
+                ir_remove_instr(instr);
+            }
+            else
+            {
+                for (int i = 0; i < instr->operand_count; i++)
+                {
+                    instr->operands[i] = ir_resolve(instr->operands[i]);
+                }
+            }
+            instr = next;
+        }
+    }
+}
+
+// Building
+
+static IrInstr *emit(IrBuilder *builder, IrOp op)
+{
+    IrInstr *instr = create_instr(builder->function, op);
+    append_instr(builder->current, instr);
+    return instr;
+}
+
+static IrInstr *emit_constant(IrBuilder *builder, Value value)
+{
+    IrInstr *instr = emit(builder, IR_CONSTANT);
+    instr->constant = value;
+    return instr;
+}
+
+static void emit_jump(IrBuilder *builder, IrBlock *target)
+{
+    emit(builder, IR_JUMP);
+    builder->current->successors[0] = target;
+    builder->current->successor_count = 1;
+    add_predecessor(builder->function, target, builder->current);
+}
+
+static void emit_branch(IrBuilder *builder, IrInstr *condition, IrBlock *if_true, IrBlock *if_false)
+{
+    IrInstr *branch = emit(builder, IR_BRANCH);
+    add_operand(builder->function, branch, condition);
+    builder->current->successors[0] = if_true;
+    builder->current->successors[1] = if_false;
+    builder->current->successor_count = 2;
+    add_predecessor(builder->function, if_true, builder->current);
+    add_predecessor(builder->function, if_false, builder->current);
+}
+
+static void write_variable(IrBuilder *builder, IrBlock *block, int variable, IrInstr *value)
+{
+    if (block->definitions == NULL)
+    {
+        size_t size = builder->function->variable_count * sizeof(IrInstr *);
+        block->definitions = (IrInstr **)arena_alloc(builder->function->arena, size);
+        memset(block->definitions, 0, size);
+    }
+    block->definitions[variable] = value;
+}
+
+static IrInstr *read_variable(IrBuilder *builder, IrBlock *block, int variable);
+
+static IrInstr *create_phi(IrBuilder *builder, IrBlock *block)
+{
+    IrInstr *phi = create_instr(builder->function, IR_PHI);
+    prepend_instr(block, phi);
+    return phi;
+}
+
+static void add_phi_operands(IrBuilder *builder, IrBlock *block, IrInstr *phi, int variable)
+{
+    for (int i = 0; i < block->predecessor_count; i++)
+    {
+        add_operand(builder->function, phi, read_variable(builder, block->predecessors[i], variable));
+    }
+}
+
+static IrInstr *read_variable(IrBuilder *builder, IrBlock *block, int variable)
+{
+    if (block->definitions && block->definitions[variable])
+    {
+        return block->definitions[variable];
+    }
+
+    IrInstr *value;
+    if (!block->sealed)
+    {
+        // Operands are added once every predecessor is known.
+        value = create_phi(builder, block);
+        if (block->incomplete_phis == NULL)
+        {
+            size_t size = builder->function->variable_count * sizeof(IrInstr *);
+            block->incomplete_phis = (IrInstr **)arena_alloc(builder->function->arena, size);
+            memset(block->incomplete_phis, 0, size);
+        }
+        block->incomplete_phis[variable] = value;
+    }
+    else if (block->predecessor_count == 0)
+    {
+        // Only the entry block has no predecessors. resolve() makes sure
+        // variables are declared first, but a slot reused by another scope
+        // may still be read here; it starts out as -1 like every slot.
+        value = create_instr(builder->function, IR_CONSTANT);
+        value->constant = INT_VALUE(-1);
+        prepend_instr(block, value);
+    }
+    else if (block->predecessor_count == 1)
+    {
+        value = read_variable(builder, block->predecessors[0], variable);
+    }
+    else
+    {
+        // Defining the phi first breaks cycles through loops.
+        value = create_phi(builder, block);
+        write_variable(builder, block, variable, value);
+        add_phi_operands(builder, block, value, variable);
+    }
+    write_variable(builder, block, variable, value);
+    return value;
+}
+
+// Called once every predecessor of block has been added.
+static void seal_block(IrBuilder *builder, IrBlock *block)
+{
+    if (block->incomplete_phis)
+    {
+        for (int variable = 0; variable < builder->function->variable_count; variable++)
+        {
+            if (block->incomplete_phis[variable])
+            {
+                add_phi_operands(builder, block, block->incomplete_phis[variable], variable);
+            }
+        }
+    }
+    block->sealed = 1;
+}
+
+static int variable_of(IrBuilder *builder, ASTNode *identifier)
+{
+    int scope = builder->scope_count - 1 - identifier->data.identifier.depth;
+    return builder->scope_base[scope] + identifier->data.identifier.slot;
+}
+
+static int push_scope(IrBuilder *builder, int size)
+{
+    if (builder->scope_count == IR_SCOPE_MAX)
+    {
+        fprintf(stderr, "Compile Error: Blocks nested too deeply.\n");
+        builder->failed = 1;
+        return FAILURE;
+    }
+
+    int base = 0;
+    if (builder->scope_count > 0)
+    {
+        int outer = builder->scope_count - 1;
+        base = builder->scope_base[outer] + builder->scope_size[outer];
+    }
+    builder->scope_base[builder->scope_count] = base;
+    builder->scope_size[builder->scope_count] = size;
+    builder->scope_count++;
+    return SUCCESS;
+}
+
+static IrInstr *build_expression(IrBuilder *builder, ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_INTEGER:
+        return emit_constant(builder, INT_VALUE(node->data.integer_value));
+    case NODE_STRING:
+        return emit_constant(builder, STR_VALUE(node->data.string_value));
+    case NODE_IDENTIFIER:
+        return read_variable(builder, builder->current, variable_of(builder, node));
+    case NODE_BINARY_OP:
+    {
+        IrInstr *left = build_expression(builder, node->data.binary_op.left);
+        IrInstr *right = build_expression(builder, node->data.binary_op.right);
+        IrInstr *instr = emit(builder, IR_BINARY);
+        instr->binary_op = node->data.binary_op.op;
+        add_operand(builder->function, instr, left);
+        add_operand(builder->function, instr, right);
+        return instr;
+    }
+    case NODE_UNARY_OP:
+    {
+        IrInstr *right = build_expression(builder, node->data.unary_op.right);
+        IrInstr *instr = emit(builder, IR_UNARY);
+        instr->unary_op = node->data.unary_op.op;
+        add_operand(builder->function, instr, right);
+        return instr;
+    }
+    default:
+        fprintf(stderr, "Compile Error: Invalid Expression.\n");
+        builder->failed = 1;
+        return emit_constant(builder, INT_VALUE(-1));
+    }
+}
+
+// Every assignment is a copy; copy propagation removes them.
+static void build_store(IrBuilder *builder, ASTNode *identifier, IrInstr *value)
+{
+    IrInstr *copy = emit(builder, IR_COPY);
+    add_operand(builder->function, copy, value);
+    write_variable(builder, builder->current, variable_of(builder, identifier), copy);
+}
+
+// Sets the variables that node may declare without running the
+// declaration to -1, see conditional_declaration().
+static void build_conditional_declarations(IrBuilder *builder, ASTNode *node)
+{
+    ASTNode *declaration;
+    for (int i = 0; (declaration = conditional_declaration(node, i)) != NULL; i++)
+    {
+        build_store(builder, declaration->data.declaration.identifier, emit_constant(builder, INT_VALUE(-1)));
+    }
+}
+
+static void build_statement(IrBuilder *builder, ASTNode *node)
+{
+    IrFunction *function = builder->function;
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+    {
+        ASTNode *declaration = node->data.statement.data.declaration;
+        IrInstr *value = declaration->data.declaration.right
+                             ? build_expression(builder, declaration->data.declaration.right)
+                             : emit_constant(builder, INT_VALUE(-1));
+        build_store(builder, declaration->data.declaration.identifier, value);
+        break;
+    }
+    case ASSIGNMENT:
+    {
+        ASTNode *assignment = node->data.statement.data.assignment;
+        build_store(builder, assignment->data.assignment.identifier, build_expression(builder, assignment->data.assignment.right));
+        break;
+    }
+    case BLOCK_STATEMENT:
+        if (push_scope(builder, node->data.statement.slot_count) == FAILURE)
+        {
+            return;
+        }
+        for (ASTNode *dummy = node->data.statement.data.head; dummy && !builder->failed; dummy = dummy->next)
+        {
+            build_conditional_declarations(builder, dummy);
+            build_statement(builder, dummy);
+        }
+        builder->scope_count--;
+        break;
+    case PRINT_STATEMENT:
+    {
+        IrInstr *value = build_expression(builder, node->data.statement.data.expression);
+        add_operand(function, emit(builder, IR_PRINT), value);
+        break;
+    }
+    case IF_STATEMENT:
+    {
+        ASTNode *condition = node->data.statement.data.expression;
+        ASTNode *else_body = condition->next->next;
+        IrBlock *then_block = create_block(function);
+        IrBlock *else_block = else_body ? create_block(function) : NULL;
+        IrBlock *join = create_block(function);
+
+        emit_branch(builder, build_expression(builder, condition), then_block, else_block ? else_block : join);
+        seal_block(builder, then_block);
+        builder->current = then_block;
+        build_statement(builder, condition->next);
+        emit_jump(builder, join);
+
+        if (else_block)
+        {
+            seal_block(builder, else_block);
+            builder->current = else_block;
+            build_statement(builder, else_body);
+            emit_jump(builder, join);
+        }
+        seal_block(builder, join);
+        builder->current = join;
+        break;
+    }
+    case WHILE_STATEMENT:
+    {
+        // The header is sealed once the back edge from the body is known.
+        ASTNode *condition = node->data.statement.data.expression;
+        IrBlock *header = create_block(function);
+        IrBlock *body = create_block(function);
+        IrBlock *exit = create_block(function);
+
+        emit_jump(builder, header);
+        builder->current = header;
+        emit_branch(builder, build_expression(builder, condition), body, exit);
+        seal_block(builder, body);
+        builder->current = body;
+        build_statement(builder, condition->next);
+        emit_jump(builder, header);
+        seal_block(builder, header);
+        seal_block(builder, exit);
+        builder->current = exit;
+        break;
+    }
+    default:
+        fprintf(stderr, "Compile Error: Unknown statement type %d!\n", node->data.statement.type);
+        builder->failed = 1;
+        break;
+    }
+}
+
+// Returns the number of slots a statement needs when the blocks it opens
+// start at first_slot.
+static int count_variables(ASTNode *node, int first_slot)
+{
+    int count = first_slot;
+    switch (node->data.statement.type)
+    {
+    case BLOCK_STATEMENT:
+    {
+        int end = first_slot + node->data.statement.slot_count;
+        count = end;
+        for (ASTNode *dummy = node->data.statement.data.head; dummy; dummy = dummy->next)
+        {
+            int inner = count_variables(dummy, end);
+            count = inner > count ? inner : count;
+        }
+        break;
+    }
+    case WHILE_STATEMENT:
+    case IF_STATEMENT:
+        for (ASTNode *body = node->data.statement.data.expression->next; body; body = body->next)
+        {
+            int inner = count_variables(body, first_slot);
+            count = inner > count ? inner : count;
+        }
+        break;
+    default:
+        break;
+    }
+    return count;
+}
+
+// Builds the SSA graph of a resolved program. Returns NULL on failure.
+IrFunction *ir_build(ASTNode *program)
+{
+    IrFunction *function = (IrFunction *)malloc(sizeof(IrFunction));
+    if (function == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for IrFunction.\n");
+        exit(EXIT_FAILURE);
+    }
+    function->arena = create_arena("ir");
+    function->blocks = NULL;
+    function->block_count = 0;
+    function->block_capacity = 0;
+    function->rpo = NULL;
+    function->rpo_count = 0;
+    function->instr_count = 0;
+
+    // The first node of a program is a dummy head.
+    ASTNode *head = program->data.program.head->next;
+    int global_count = program->data.program.slot_count;
+    function->variable_count = global_count;
+    for (ASTNode *dummy = head; dummy && dummy->type == NODE_STATEMENT; dummy = dummy->next)
+    {
+        int count = count_variables(dummy, global_count);
+        function->variable_count = count > function->variable_count ? count : function->variable_count;
+    }
+
+    IrBuilder builder;
+    builder.function = function;
+    builder.current = create_block(function);
+    builder.current->sealed = 1;
+    builder.scope_count = 0;
+    builder.failed = 0;
+    push_scope(&builder, global_count);
+
+    for (ASTNode *dummy = head; dummy && dummy->type == NODE_STATEMENT && !builder.failed; dummy = dummy->next)
+    {
+        build_conditional_declarations(&builder, dummy);
+        build_statement(&builder, dummy);
+    }
+    emit(&builder, IR_RETURN);
+
+    if (builder.failed)
+    {
+        free_ir(function);
+        return NULL;
+    }
+    return function;
+}
+
+void free_ir(IrFunction *function)
+{
+    free(function->blocks);
+    free(function->rpo);
+    free_arena(function->arena);
+    free(function);
+}
+
+// Analyses
+
+// Depth-first search from the entry block, iterative because straight-line
+// programs make long chains of blocks.
+static int postorder(IrFunction *function, IrBlock **order)
+{
+    int *next_successor = (int *)calloc(function->block_count, sizeof(int));
+    char *visited = (char *)calloc(function->block_count, sizeof(char));
+    IrBlock **stack = (IrBlock **)malloc(function->block_count * sizeof(IrBlock *));
+    if (next_successor == NULL || visited == NULL || stack == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for dominators.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int count = 0;
+    int depth = 0;
+    stack[depth++] = function->blocks[0];
+    visited[0] = 1;
+    while (depth > 0)
+    {
+        IrBlock *block = stack[depth - 1];
+        if (next_successor[block->id] < block->successor_count)
+        {
+            IrBlock *successor = block->successors[next_successor[block->id]++];
+            if (!visited[successor->id])
+            {
+                visited[successor->id] = 1;
+                stack[depth++] = successor;
+            }
+            continue;
+        }
+        order[count++] = block;
+        depth--;
+    }
+
+    free(next_successor);
+    free(visited);
+    free(stack);
+    return count;
+}
+
+static IrBlock *intersect(IrBlock *a, IrBlock *b)
+{
+    while (a != b)
+    {
+        while (a->rpo_index > b->rpo_index)
+        {
+            a = a->idom;
+        }
+        while (b->rpo_index > a->rpo_index)
+        {
+            b = b->idom;
+        }
+    }
+    return a;
+}
+
+// Links every block to its children in the dominator tree and numbers the
+// tree in depth-first order, so that a block dominates another if its
+// interval contains the other's.
+static void number_dominator_tree(IrFunction *function)
+{
+    for (int i = 0; i < function->rpo_count; i++)
+    {
+        function->rpo[i]->first_child = NULL;
+        function->rpo[i]->next_sibling = NULL;
+    }
+    for (int i = function->rpo_count - 1; i > 0; i--)
+    {
+        IrBlock *block = function->rpo[i];
+        block->next_sibling = block->idom->first_child;
+        block->idom->first_child = block;
+    }
+
+    IrBlock **stack = (IrBlock **)malloc(function->rpo_count * sizeof(IrBlock *));
+    char *entered = (char *)calloc(function->block_count, sizeof(char));
+    if (stack == NULL || entered == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for dominators.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int counter = 0;
+    int depth = 0;
+    stack[depth++] = function->rpo[0];
+    while (depth > 0)
+    {
+        IrBlock *block = stack[depth - 1];
+        if (!entered[block->id])
+        {
+            entered[block->id] = 1;
+            block->dom_enter = counter++;
+            for (IrBlock *child = block->first_child; child; child = child->next_sibling)
+            {
+                stack[depth++] = child;
+            }
+            continue;
+        }
+        block->dom_exit = counter++;
+        depth--;
+    }
+
+    free(stack);
+    free(entered);
+}
+
+// Computes the reverse postorder and the dominator tree (Cooper, Harvey and
+// Kennedy, "A Simple, Fast Dominance Algorithm"). Unreachable blocks get
+// rpo_index -1.
+void ir_compute_dominators(IrFunction *function)
+{
+    IrBlock **order = (IrBlock **)malloc(function->block_count * sizeof(IrBlock *));
+    if (order == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for dominators.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int count = postorder(function, order);
+    free(function->rpo);
+    function->rpo = order;
+    function->rpo_count = count;
+    for (int i = 0; i < count / 2; i++)
+    {
+        IrBlock *swap = order[i];
+        order[i] = order[count - 1 - i];
+        order[count - 1 - i] = swap;
+    }
+    for (int b = 0; b < function->block_count; b++)
+    {
+        function->blocks[b]->rpo_index = -1;
+        function->blocks[b]->idom = NULL;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        order[i]->rpo_index = i;
+    }
+
+    IrBlock *entry = order[0];
+    entry->idom = entry;
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+        for (int i = 1; i < count; i++)
+        {
+            IrBlock *block = order[i];
+            IrBlock *idom = NULL;
+            for (int p = 0; p < block->predecessor_count; p++)
+            {
+                IrBlock *predecessor = block->predecessors[p];
+                if (predecessor->idom == NULL)
+                {
+                    continue;
+                }
+                idom = idom ? intersect(predecessor, idom) : predecessor;
+            }
+            if (block->idom != idom)
+            {
+                block->idom = idom;
+                changed = 1;
+            }
+        }
+    }
+
+    number_dominator_tree(function);
+}
+
+int ir_dominates(IrBlock *dominator, IrBlock *block)
+{
+    return dominator->dom_enter <= block->dom_enter && block->dom_exit <= dominator->dom_exit;
+}
+
+static IrType join_types(IrType a, IrType b)
+{
+    if (a == IR_TYPE_NONE)
+    {
+        return b;
+    }
+    if (b == IR_TYPE_NONE || a == b)
+    {
+        return a;
+    }
+    return IR_TYPE_ANY;
+}
+
+static IrType transfer_type(IrInstr *instr)
+{
+    switch (instr->op)
+    {
+    case IR_CONSTANT:
+        return instr->constant.type == VAL_INT ? IR_TYPE_INT : IR_TYPE_STR;
+    case IR_COPY:
+        return instr->operands[0]->type;
+    case IR_PHI:
+    {
+        IrType type = IR_TYPE_NONE;
+        for (int i = 0; i < instr->operand_count; i++)
+        {
+            type = join_types(type, instr->operands[i]->type);
+        }
+        return type;
+    }
+    case IR_BINARY:
+    {
+        IrType left = instr->operands[0]->type;
+        IrType right = instr->operands[1]->type;
+        if (left == IR_TYPE_NONE || right == IR_TYPE_NONE)
+        {
+            return IR_TYPE_NONE;
+        }
+        if (left == IR_TYPE_STR && right == IR_TYPE_STR && instr->binary_op == ADD)
+        {
+            return IR_TYPE_STR;
+        }
+        // Everything else either produces an int or fails.
+        return left == right && left != IR_TYPE_ANY ? IR_TYPE_INT : IR_TYPE_ANY;
+    }
+    case IR_UNARY:
+        return IR_TYPE_INT;
+    default:
+        return IR_TYPE_NONE;
+    }
+}
+
+// Infers the type of every value, optimistically: phis start out as NONE
+// and only widen when an operand needs it.
+void ir_infer_types(IrFunction *function)
+{
+    for (int b = 0; b < function->block_count; b++)
+    {
+        for (IrInstr *instr = function->blocks[b]->first; instr; instr = instr->next)
+        {
+            instr->type = IR_TYPE_NONE;
+        }
+    }
+
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+        for (int b = 0; b < function->block_count; b++)
+        {
+            for (IrInstr *instr = function->blocks[b]->first; instr; instr = instr->next)
+            {
+                IrType type = transfer_type(instr);
+                if (type != instr->type)
+                {
+                    instr->type = type;
+                    changed = 1;
+                }
+            }
+        }
+    }
+}
+
+// Whether an instruction may report a runtime error. Needs ir_infer_types().
+int ir_can_fail(IrInstr *instr)
+{
+    switch (instr->op)
+    {
+    case IR_BINARY:
+    {
+        IrType left = instr->operands[0]->type;
+        IrType right = instr->operands[1]->type;
+        if (left == IR_TYPE_INT && right == IR_TYPE_INT)
+        {
+            // Division by zero, and INT_MIN / -1 which traps.
+            IrInstr *divisor = instr->operands[1];
+            return instr->binary_op == DIVIDE &&
+                   !(divisor->op == IR_CONSTANT && divisor->constant.as.integer != 0 && divisor->constant.as.integer != -1);
+        }
+        if (left == IR_TYPE_STR && right == IR_TYPE_STR)
+        {
+            return instr->binary_op == SUBTRACT || instr->binary_op == MULTIPLY || instr->binary_op == DIVIDE;
+        }
+        return 1;
+    }
+    case IR_UNARY:
+        return instr->operands[0]->type != IR_TYPE_INT;
+    default:
+        return 0;
+    }
+}
+
+// Whether an instruction has to stay even if its value is unused.
+int ir_has_side_effects(IrInstr *instr)
+{
+    switch (instr->op)
+    {
+    case IR_PRINT:
+    case IR_JUMP:
+    case IR_BRANCH:
+    case IR_RETURN:
+        return 1;
+    default:
+        return ir_can_fail(instr);
+    }
+}
+
+int ir_count_instructions(IrFunction *function)
+{
+    int count = 0;
+    for (int b = 0; b < function->block_count; b++)
+    {
+        for (IrInstr *instr = function->blocks[b]->first; instr; instr = instr->next)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Dumping
+
+static const char *binary_op_name(BinaryOp op)
+{
+    switch (op)
+    {
+    case ADD:
+        return "add";
+    case SUBTRACT:
+        return "sub";
+    case MULTIPLY:
+        return "mul";
+    case DIVIDE:
+        return "div";
+    case IS_EQUAL:
+        return "eq";
+    case IS_NOT_EQUAL:
+        return "ne";
+    case IS_LESS_THAN:
+        return "lt";
+    case LESS_THAN_EQUAL:
+        return "le";
+    case IS_GREATER_THAN:
+        return "gt";
+    case GREATER_THAN_EQUAL:
+        return "ge";
+    default:
+        return "?";
+    }
+}
+
+void ir_dump(IrFunction *function)
+{
+    for (int b = 0; b < function->block_count; b++)
+    {
+        IrBlock *block = function->blocks[b];
+        if (block->first == NULL)
+        {
+            continue;
+        }
+        printf("block%d:", block->id);
+        if (block->predecessor_count > 0)
+        {
+            printf("    ; preds");
+            for (int p = 0; p < block->predecessor_count; p++)
+            {
+                printf(" block%d", block->predecessors[p]->id);
+            }
+        }
+        printf("\n");
+
+        for (IrInstr *instr = block->first; instr; instr = instr->next)
+        {
+            printf("    ");
+            switch (instr->op)
+            {
+            case IR_CONSTANT:
+                if (instr->constant.type == VAL_INT)
+                {
+                    printf("v%d = const %d\n", instr->id, instr->constant.as.integer);
+                }
+                else
+                {
+                    printf("v%d = const \"%s\"\n", instr->id, instr->constant.as.string);
+                }
+                break;
+            case IR_COPY:
+                printf("v%d = copy v%d\n", instr->id, instr->operands[0]->id);
+                break;
+            case IR_BINARY:
+                printf("v%d = %s v%d, v%d\n", instr->id, binary_op_name(instr->binary_op),
+                       instr->operands[0]->id, instr->operands[1]->id);
+                break;
+            case IR_UNARY:
+                printf("v%d = %s v%d\n", instr->id, instr->unary_op == NEGATE ? "neg" : "not", instr->operands[0]->id);
+                break;
+            case IR_PHI:
+                printf("v%d = phi", instr->id);
+                for (int i = 0; i < instr->operand_count; i++)
+                {
+                    printf("%s v%d", i ? "," : "", instr->operands[i]->id);
+                }
+                printf("\n");
+                break;
+            case IR_PRINT:
+                printf("print v%d\n", instr->operands[0]->id);
+                break;
+            case IR_JUMP:
+                printf("jump block%d\n", block->successors[0]->id);
+                break;
+            case IR_BRANCH:
+                printf("branch v%d, block%d, block%d\n", instr->operands[0]->id,
+                       block->successors[0]->id, block->successors[1]->id);
+                break;
+            case IR_RETURN:
+                printf("return\n");
+                break;
+            }
+        }
+    }
+}
+
+// Running
+
+// Values of the instructions of a running graph.
+typedef struct IrValues
+{
+    Value *values;
+    int count;
+} IrValues;
+
+static void mark_ir_values(Heap *heap, void *context)
+{
+    IrValues *values = (IrValues *)context;
+    heap_mark_values(heap, values->values, values->count);
+}
+
+// Returns how many operands refer to each instruction.
+static int *count_uses(IrFunction *function)
+{
+    int *uses = (int *)calloc(function->instr_count + 1, sizeof(int));
+    if (uses == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for IR uses.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < function->block_count; i++)
+    {
+        for (IrInstr *instr = function->blocks[i]->first; instr; instr = instr->next)
+        {
+            for (int j = 0; j < instr->operand_count; j++)
+            {
+                uses[instr->operands[j]->id]++;
+            }
+        }
+    }
+    return uses;
+}
+
+// Adds every operand a block reads to live: the operands of its own
+// instructions and those its successors' phis take on the edges from it.
+// A value defined in the block is only live before it if it is read there
+// before it is defined, which SSA rules out except through phis.
+static void add_live_in(IrBlock *block, unsigned char *live, unsigned char *defined)
+{
+    for (IrInstr *instr = block->first; instr; instr = instr->next)
+    {
+        if (instr->op == IR_PHI)
+        {
+            continue;
+        }
+        for (int i = 0; i < instr->operand_count; i++)
+        {
+            if (!defined[instr->operands[i]->id])
+            {
+                live[instr->operands[i]->id] = 1;
+            }
+        }
+    }
+}
+
+// Marks the additions whose left operand is not read again before it is
+// redefined, found with a backward liveness analysis over the blocks.
+static unsigned char *find_last_uses(IrFunction *function)
+{
+    int count = function->instr_count + 1;
+    unsigned char *last_uses = (unsigned char *)calloc(count, 1);
+    unsigned char *live_out = (unsigned char *)calloc((size_t)function->block_count * count, 1);
+    unsigned char *live = (unsigned char *)malloc(count);
+    unsigned char *defined = (unsigned char *)calloc((size_t)function->block_count * count, 1);
+    if (last_uses == NULL || live_out == NULL || live == NULL || defined == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for IR liveness.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < function->block_count; i++)
+    {
+        for (IrInstr *instr = function->blocks[i]->first; instr; instr = instr->next)
+        {
+            defined[(size_t)i * count + instr->id] = 1;
+        }
+    }
+
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+        for (int i = function->block_count - 1; i >= 0; i--)
+        {
+            IrBlock *block = function->blocks[i];
+            unsigned char *out = &live_out[(size_t)i * count];
+            memset(live, 0, count);
+            for (int j = 0; j < block->successor_count; j++)
+            {
+                IrBlock *successor = block->successors[j];
+                unsigned char *successor_out = &live_out[(size_t)successor->id * count];
+                unsigned char *successor_defined = &defined[(size_t)successor->id * count];
+                for (int k = 0; k < count; k++)
+                {
+                    live[k] |= successor_out[k] && !successor_defined[k];
+                }
+                add_live_in(successor, live, successor_defined);
+                for (int edge = 0; edge < successor->predecessor_count; edge++)
+                {
+                    if (successor->predecessors[edge] != block)
+                    {
+                        continue;
+                    }
+                    for (IrInstr *phi = successor->first; phi && phi->op == IR_PHI; phi = phi->next)
+                    {
+                        live[phi->operands[edge]->id] = 1;
+                    }
+                }
+            }
+            for (int k = 0; k < count; k++)
+            {
+                if (live[k] && !out[k])
+                {
+                    out[k] = 1;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    // Walk each block backwards from its live-out set.
+    for (int i = 0; i < function->block_count; i++)
+    {
+        IrBlock *block = function->blocks[i];
+        memcpy(live, &live_out[(size_t)i * count], count);
+        for (IrInstr *instr = block->last; instr; instr = instr->prev)
+        {
+            if (instr->op == IR_PHI)
+            {
+                break;
+            }
+            if (instr->op == IR_BINARY && instr->binary_op == ADD && instr->operands[0] != instr->operands[1] &&
+                !live[instr->operands[0]->id])
+            {
+                last_uses[instr->id] = 1;
+            }
+            for (int j = 0; j < instr->operand_count; j++)
+            {
+                live[instr->operands[j]->id] = 1;
+            }
+        }
+    }
+
+    free(live_out);
+    free(live);
+    free(defined);
+    return last_uses;
+}
+
+// The string of source was copied to the value of destination. A string
+// can only be appended to in place by the one value that holds it, so it
+// stays appendable only if source has no other use and is computed again
+// before the copy runs again. For a phi, source must then be defined in
+// the phi's block or a block it dominates, so not before a loop that
+// reads it on every back edge. A copy needs source in its own block.
+static void move_string(Value *values, int *uses, IrInstr *source, IrInstr *destination, const char *string)
+{
+    IrBlock *block = destination->block;
+    int recomputed = destination->op == IR_PHI ? ir_dominates(block, source->block) : source->block == block;
+    if (uses[source->id] == 1 && recomputed)
+    {
+        string_move(string, &values[source->id], &values[destination->id]);
+    }
+    else
+    {
+        string_store(string, &values[destination->id]);
+    }
+}
+
+// Runs the graph directly. Values are kept per instruction; entering a
+// block first evaluates all of its phis for the edge that was taken.
+int ir_run(IrFunction *function, Heap *heap)
+{
+    Value *values = (Value *)malloc((function->instr_count + 1) * sizeof(Value));
+    Value *phi_values = (Value *)malloc((function->instr_count + 1) * sizeof(Value));
+    if (values == NULL || phi_values == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for IR values.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i <= function->instr_count; i++)
+    {
+        values[i] = INT_VALUE(0);
+    }
+    IrValues roots = {values, function->instr_count + 1};
+    ir_compute_dominators(function);
+    int *uses = count_uses(function);
+    unsigned char *last_uses = find_last_uses(function);
+
+    int status = SUCCESS;
+    IrBlock *previous = NULL;
+    IrBlock *block = function->blocks[0];
+    while (block && status == SUCCESS)
+    {
+        IrInstr *instr = block->first;
+        if (previous)
+        {
+            int edge = 0;
+            while (block->predecessors[edge] != previous)
+            {
+                edge++;
+            }
+            int count = 0;
+            for (IrInstr *phi = instr; phi && phi->op == IR_PHI; phi = phi->next)
+            {
+                phi_values[count++] = values[phi->operands[edge]->id];
+            }
+            count = 0;
+            for (; instr && instr->op == IR_PHI; instr = instr->next)
+            {
+                Value value = phi_values[count++];
+                values[instr->id] = value;
+                if (value.type == VAL_STR)
+                {
+                    move_string(values, uses, instr->operands[edge], instr, value.as.string);
+                }
+            }
+        }
+
+        // Safepoint: between blocks every live value is in values. Values
+        // that are no longer used are kept until they are overwritten.
+        if (heap_should_collect(heap))
+        {
+            heap_collect(heap, mark_ir_values, &roots);
+        }
+
+        IrBlock *next = NULL;
+        for (; instr && status == SUCCESS; instr = instr->next)
+        {
+            switch (instr->op)
+            {
+            case IR_CONSTANT:
+                values[instr->id] = instr->constant;
+                break;
+            case IR_COPY:
+                values[instr->id] = values[instr->operands[0]->id];
+                if (values[instr->id].type == VAL_STR)
+                {
+                    move_string(values, uses, instr->operands[0], instr, values[instr->id].as.string);
+                }
+                break;
+            case IR_BINARY:
+                if (last_uses[instr->id])
+                {
+                    // The left operand is not read again: append to it.
+                    values[instr->id] = values[instr->operands[0]->id];
+                    if (values[instr->id].type == VAL_STR)
+                    {
+                        string_move(values[instr->id].as.string, &values[instr->operands[0]->id], &values[instr->id]);
+                    }
+                    status = value_append(heap, &values[instr->id], values[instr->operands[1]->id]);
+                    break;
+                }
+                status = value_binary_op(heap, instr->binary_op, values[instr->operands[0]->id],
+                                         values[instr->operands[1]->id], &values[instr->id]);
+                break;
+            case IR_UNARY:
+                status = value_unary_op(instr->unary_op, values[instr->operands[0]->id], &values[instr->id]);
+                break;
+            case IR_PHI:
+                break;
+            case IR_PRINT:
+                print_value(values[instr->operands[0]->id]);
+                break;
+            case IR_JUMP:
+                next = block->successors[0];
+                break;
+            case IR_BRANCH:
+                next = block->successors[value_is_truthy(values[instr->operands[0]->id]) ? 0 : 1];
+                break;
+            case IR_RETURN:
+                next = NULL;
+                break;
+            }
+        }
+        previous = block;
+        block = next;
+    }
+
+    free(values);
+    free(phi_values);
+    free(uses);
+    free(last_uses);
+    return status;
+}
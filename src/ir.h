@@ -0,0 +1,132 @@
+#ifndef IR_H
+#define IR_H
+
+#include "arena.h"
+#include "gc.h"
+#include "parser.h"
+#include "value.h"
+
+/**
+ * A control-flow graph in SSA form, built from a resolved program.
+ *
+ * Every instruction that produces a value is that value; variables only
+ * exist while the graph is built. Blocks start with their phi nodes, which
+ * have one operand per predecessor, and end with a JUMP, BRANCH or RETURN.
+ */
+typedef enum IrOp
+{
+    IR_CONSTANT,
+    IR_COPY,
+    IR_BINARY,
+    IR_UNARY,
+    IR_PHI,
+    IR_PRINT,
+    IR_JUMP,
+    IR_BRANCH,
+    IR_RETURN,
+} IrOp;
+
+// What an instruction is known to produce, see ir_infer_types().
+typedef enum IrType
+{
+    IR_TYPE_NONE,
+    IR_TYPE_INT,
+    IR_TYPE_STR,
+    IR_TYPE_ANY,
+} IrType;
+
+struct IrBlock;
+
+typedef struct IrInstr
+{
+    IrOp op;
+    int id;
+    BinaryOp binary_op;
+    UnaryOp unary_op;
+    Value constant;
+    IrType type;
+
+    struct IrInstr **operands;
+    int operand_count;
+    int operand_capacity;
+
+    // Set by a pass that replaces every use of this instruction.
+    struct IrInstr *replacement;
+
+    struct IrBlock *block;
+    struct IrInstr *prev;
+    struct IrInstr *next;
+} IrInstr;
+
+typedef struct IrBlock
+{
+    int id;
+    IrInstr *first;
+    IrInstr *last;
+
+    struct IrBlock **predecessors;
+    int predecessor_count;
+    int predecessor_capacity;
+
+    // Targets of the terminator: the jump target, or the two branch targets.
+    struct IrBlock *successors[2];
+    int successor_count;
+
+    // SSA construction: the value of each variable at the end of the block,
+    // and the phis added before all predecessors were known.
+    IrInstr **definitions;
+    IrInstr **incomplete_phis;
+    int sealed;
+
+    // Dominator tree, computed by ir_compute_dominators().
+    struct IrBlock *idom;
+    struct IrBlock *first_child;
+    struct IrBlock *next_sibling;
+    int rpo_index;
+    int dom_enter;
+    int dom_exit;
+} IrBlock;
+
+typedef struct IrFunction
+{
+    // Blocks and instructions are allocated in arena.
+    Arena *arena;
+
+    IrBlock **blocks;
+    int block_count;
+    int block_capacity;
+
+    // Reverse postorder, computed by ir_compute_dominators().
+    IrBlock **rpo;
+    int rpo_count;
+
+    int instr_count;
+    int variable_count;
+} IrFunction;
+
+IrFunction *ir_build(ASTNode *program);
+void free_ir(IrFunction *function);
+
+void ir_dump(IrFunction *function);
+int ir_count_instructions(IrFunction *function);
+int ir_run(IrFunction *function, Heap *heap);
+
+// Helpers shared with the passes.
+void ir_remove_instr(IrInstr *instr);
+void ir_insert_before(IrInstr *position, IrInstr *instr);
+IrInstr *ir_resolve(IrInstr *instr);
+void ir_apply_replacements(IrFunction *function);
+void ir_compute_dominators(IrFunction *function);
+int ir_dominates(IrBlock *dominator, IrBlock *block);
+void ir_infer_types(IrFunction *function);
+int ir_can_fail(IrInstr *instr);
+int ir_has_side_effects(IrInstr *instr);
+
+// Passes, see ir_passes.c.
+void ir_copy_propagation(IrFunction *function);
+void ir_value_numbering(IrFunction *function);
+void ir_hoist_loop_invariants(IrFunction *function);
+void ir_eliminate_dead_code(IrFunction *function);
+void ir_optimize(IrFunction *function, int print_timing);
+
+#endif // IR_H
@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ir.h"
+
+// Copy propagation: uses of a copy use its operand instead, and so do uses
+// of a phi whose operands are all the same value (or the phi itself).
+void ir_copy_propagation(IrFunction *function)
+{
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+        for (int b = 0; b < function->block_count; b++)
+        {
+            for (IrInstr *instr = function->blocks[b]->first; instr; instr = instr->next)
+            {
+                if (instr->replacement)
+                {
+                    continue;
+                }
+                if (instr->op == IR_COPY)
+                {
+                    instr->replacement = ir_resolve(instr->operands[0]);
+                    changed = 1;
+                }
+                else if (instr->op == IR_PHI)
+                {
+                    IrInstr *same = NULL;
+                    int trivial = 1;
+                    for (int i = 0; i < instr->operand_count && trivial; i++)
+                    {
+                        IrInstr *operand = ir_resolve(instr->operands[i]);
+                        if (operand == instr || operand == same)
+                        {
+                            continue;
+                        }
+                        trivial = same == NULL;
+                        same = operand;
+                    }
+                    if (trivial && same)
+                    {
+                        instr->replacement = same;
+                        changed = 1;
+                    }
+                }
+            }
+        }
+    }
+    ir_apply_replacements(function);
+}
+
+// Global value numbering
+
+typedef struct ValueEntry
+{
+    IrInstr *instr;
+    struct ValueEntry *next;
+} ValueEntry;
+
+static int is_numbered(IrInstr *instr)
+{
+    return instr->op == IR_CONSTANT || instr->op == IR_BINARY || instr->op == IR_UNARY;
+}
+
+static unsigned int value_hash(IrInstr *instr)
+{
+    unsigned int hash = instr->op * 31u;
+    switch (instr->op)
+    {
+    case IR_CONSTANT:
+        if (instr->constant.type == VAL_INT)
+        {
+            hash = hash * 31u + (unsigned int)instr->constant.as.integer;
+        }
+        else
+        {
+            hash = hash * 31u + (unsigned int)(size_t)instr->constant.as.string;
+        }
+        break;
+    case IR_BINARY:
+        hash = hash * 31u + instr->binary_op;
+        break;
+    case IR_UNARY:
+        hash = hash * 31u + instr->unary_op;
+        break;
+    default:
+        break;
+    }
+    for (int i = 0; i < instr->operand_count; i++)
+    {
+        hash = hash * 31u + (unsigned int)instr->operands[i]->id;
+    }
+
+    // Operand ids are small and sequential, mix them into the high bits.
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3bu;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static int same_value(IrInstr *a, IrInstr *b)
+{
+    if (a->op != b->op || a->operand_count != b->operand_count)
+    {
+        return 0;
+    }
+    for (int i = 0; i < a->operand_count; i++)
+    {
+        if (a->operands[i] != b->operands[i])
+        {
+            return 0;
+        }
+    }
+    switch (a->op)
+    {
+    case IR_CONSTANT:
+        if (a->constant.type != b->constant.type)
+        {
+            return 0;
+        }
+        return a->constant.type == VAL_INT ? a->constant.as.integer == b->constant.as.integer
+                                           : a->constant.as.string == b->constant.as.string;
+    case IR_BINARY:
+        return a->binary_op == b->binary_op;
+    case IR_UNARY:
+        return a->unary_op == b->unary_op;
+    default:
+        return 0;
+    }
+}
+
+// Looks up or adds an instruction in the table of available values.
+// Returns the equal instruction that is available, or NULL.
+static IrInstr *find_value(ValueEntry **table, unsigned int mask, IrInstr *instr, Arena *arena, unsigned int *undo, int *undo_count)
+{
+    unsigned int bucket = value_hash(instr) & mask;
+    for (ValueEntry *entry = table[bucket]; entry; entry = entry->next)
+    {
+        if (same_value(entry->instr, instr))
+        {
+            return entry->instr;
+        }
+    }
+
+    ValueEntry *entry = (ValueEntry *)arena_alloc(arena, sizeof(ValueEntry));
+    entry->instr = instr;
+    entry->next = table[bucket];
+    table[bucket] = entry;
+    undo[(*undo_count)++] = bucket;
+    return NULL;
+}
+
+// Replaces an instruction by an equal one that dominates it.
+// The dominator tree is walked depth first, and the values of a block are
+// only available while its subtree is visited, so everything in the table
+// dominates the current block. Definitions dominate their uses, so
+// operands are numbered before the instructions using them. Strings are
+// immutable, so two equal concatenations can share their result; an
+// operation that fails stops the program before the one it replaces runs.
+void ir_value_numbering(IrFunction *function)
+{
+    ir_compute_dominators(function);
+
+    unsigned int table_size = 64;
+    while (table_size < (unsigned int)function->instr_count)
+    {
+        table_size *= 2;
+    }
+    ValueEntry **table = (ValueEntry **)calloc(table_size, sizeof(ValueEntry *));
+    unsigned int *undo = (unsigned int *)malloc((function->instr_count + 1) * sizeof(unsigned int));
+    int *undo_marks = (int *)malloc(function->block_count * sizeof(int));
+    IrBlock **stack = (IrBlock **)malloc(function->rpo_count * sizeof(IrBlock *));
+    char *entered = (char *)calloc(function->block_count, sizeof(char));
+    if (table == NULL || undo == NULL || undo_marks == NULL || stack == NULL || entered == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for value table.\n");
+        exit(EXIT_FAILURE);
+    }
+    Arena *arena = create_arena("gvn");
+
+    int undo_count = 0;
+    int depth = 0;
+    stack[depth++] = function->rpo[0];
+    while (depth > 0)
+    {
+        IrBlock *block = stack[depth - 1];
+        if (entered[block->id])
+        {
+            // Leaving the subtree: its values are no longer available.
+            while (undo_count > undo_marks[block->id])
+            {
+                unsigned int bucket = undo[--undo_count];
+                table[bucket] = table[bucket]->next;
+            }
+            depth--;
+            continue;
+        }
+
+        entered[block->id] = 1;
+        undo_marks[block->id] = undo_count;
+        for (IrInstr *instr = block->first; instr; instr = instr->next)
+        {
+            for (int o = 0; o < instr->operand_count; o++)
+            {
+                instr->operands[o] = ir_resolve(instr->operands[o]);
+            }
+            if (is_numbered(instr))
+            {
+                instr->replacement = find_value(table, table_size - 1, instr, arena, undo, &undo_count);
+            }
+        }
+        for (IrBlock *child = block->first_child; child; child = child->next_sibling)
+        {
+            stack[depth++] = child;
+        }
+    }
+
+    free_arena(arena);
+    free(table);
+    free(undo);
+    free(undo_marks);
+    free(stack);
+    free(entered);
+    ir_apply_replacements(function);
+}
+
+// Loop-invariant code motion
+
+// Collects the blocks of the natural loop of a back edge from latch to
+// header into blocks, marking them in in_loop. Returns how many there are.
+static int collect_loop(IrBlock *header, IrBlock *latch, char *in_loop, IrBlock **blocks)
+{
+    int count = 0;
+    in_loop[header->id] = 1;
+    blocks[count++] = header;
+    if (!in_loop[latch->id])
+    {
+        in_loop[latch->id] = 1;
+        blocks[count++] = latch;
+    }
+
+    // blocks doubles as the worklist: everything after header is visited.
+    for (int i = 1; i < count; i++)
+    {
+        IrBlock *block = blocks[i];
+        for (int p = 0; p < block->predecessor_count; p++)
+        {
+            IrBlock *predecessor = block->predecessors[p];
+            if (!in_loop[predecessor->id] && predecessor->rpo_index != -1)
+            {
+                in_loop[predecessor->id] = 1;
+                blocks[count++] = predecessor;
+            }
+        }
+    }
+    return count;
+}
+
+static int compare_rpo(const void *a, const void *b)
+{
+    return (*(IrBlock *const *)a)->rpo_index - (*(IrBlock *const *)b)->rpo_index;
+}
+
+static int is_invariant(IrInstr *instr, char *in_loop)
+{
+    if (!is_numbered(instr) || ir_can_fail(instr))
+    {
+        return 0;
+    }
+    for (int i = 0; i < instr->operand_count; i++)
+    {
+        if (in_loop[instr->operands[i]->block->id])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Moves instructions whose operands are all defined outside of a loop into
+// the block that enters the loop. Only instructions that cannot fail are
+// moved, because the loop body may never run.
+void ir_hoist_loop_invariants(IrFunction *function)
+{
+    ir_compute_dominators(function);
+    ir_infer_types(function);
+
+    char *in_loop = (char *)calloc(function->block_count, sizeof(char));
+    IrBlock **blocks = (IrBlock **)malloc(function->block_count * sizeof(IrBlock *));
+    if (in_loop == NULL || blocks == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for loops.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // An outer loop's header comes before the headers nested in it in
+    // reverse postorder, so inner loops are hoisted first and outer loops
+    // can hoist the result further.
+    for (int i = function->rpo_count - 1; i >= 0; i--)
+    {
+        IrBlock *header = function->rpo[i];
+        for (int p = 0; p < header->predecessor_count; p++)
+        {
+            IrBlock *latch = header->predecessors[p];
+            if (latch->rpo_index == -1 || !ir_dominates(header, latch))
+            {
+                continue;
+            }
+
+            int count = collect_loop(header, latch, in_loop, blocks);
+
+            // The loop must be entered from a single block.
+            IrBlock *preheader = NULL;
+            int entries = 0;
+            for (int q = 0; q < header->predecessor_count; q++)
+            {
+                if (!in_loop[header->predecessors[q]->id])
+                {
+                    preheader = header->predecessors[q];
+                    entries++;
+                }
+            }
+
+            // In reverse postorder definitions come before their uses.
+            qsort(blocks, count, sizeof(IrBlock *), compare_rpo);
+            for (int b = 0; b < count && entries == 1; b++)
+            {
+                IrInstr *instr = blocks[b]->first;
+                while (instr)
+                {
+                    IrInstr *next = instr->next;
+                    if (is_invariant(instr, in_loop))
+                    {
+                        ir_remove_instr(instr);
+                        ir_insert_before(preheader->last, instr);
+                    }
+                    instr = next;
+                }
+            }
+
+            for (int b = 0; b < count; b++)
+            {
+                in_loop[blocks[b]->id] = 0;
+            }
+        }
+    }
+
+    free(in_loop);
+    free(blocks);
+}
+
+// Dead code elimination: keeps the instructions with side effects and the
+// values they use, directly or through other instructions.
+void ir_eliminate_dead_code(IrFunction *function)
+{
+    ir_infer_types(function);
+
+    char *live = (char *)calloc(function->instr_count, sizeof(char));
+    IrInstr **worklist = (IrInstr **)malloc(function->instr_count * sizeof(IrInstr *));
+    if (live == NULL || worklist == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for dead code elimination.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int count = 0;
+    for (int b = 0; b < function->block_count; b++)
+    {
+        for (IrInstr *instr = function->blocks[b]->first; instr; instr = instr->next)
+        {
+            if (ir_has_side_effects(instr))
+            {
+                live[instr->id] = 1;
+                worklist[count++] = instr;
+            }
+        }
+    }
+    while (count > 0)
+    {
+        IrInstr *instr = worklist[--count];
+        for (int i = 0; i < instr->operand_count; i++)
+        {
+            IrInstr *operand = instr->operands[i];
+            if (!live[operand->id])
+            {
+                live[operand->id] = 1;
+                worklist[count++] = operand;
+            }
+        }
+    }
+
+    for (int b = 0; b < function->block_count; b++)
+    {
+        IrInstr *instr = function->blocks[b]->first;
+        while (instr)
+        {
+            IrInstr *next = instr->next;
+            if (!live[instr->id])
+            {
+                ir_remove_instr(instr);
+            }
+            instr = next;
+        }
+    }
+
+    free(live);
+    free(worklist);
+}
+
+static double seconds_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+typedef struct IrPass
+{
+    const char *name;
+    void (*run)(IrFunction *function);
+} IrPass;
+
+static const IrPass passes[] = {
+    {"copy-prop", ir_copy_propagation},
+    {"gvn", ir_value_numbering},
+    {"licm", ir_hoist_loop_invariants},
+    {"dce", ir_eliminate_dead_code},
+};
+
+// Runs every pass in order. With print_timing, reports how long each pass
+// took and how many instructions are left after it.
+void ir_optimize(IrFunction *function, int print_timing)
+{
+    if (print_timing)
+    {
+        fprintf(stderr, "Pass %-10s %10s %8d instructions\n", "build", "", ir_count_instructions(function));
+    }
+    for (size_t i = 0; i < sizeof(passes) / sizeof(passes[0]); i++)
+    {
+        double start = seconds_now();
+        passes[i].run(function);
+        double elapsed = seconds_now() - start;
+        if (print_timing)
+        {
+            fprintf(stderr, "Pass %-10s %7.3f ms %8d instructions\n", passes[i].name, elapsed * 1e3, ir_count_instructions(function));
+        }
+    }
+}
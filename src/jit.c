@@ -0,0 +1,554 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+
+/**
+ * A template JIT for while loops that only compute with ints.
+ *
+ * Every variable the loop uses gets a register for the whole loop. The
+ * generated function takes an array of pointers to the variables, checks
+ * that they all hold ints (returning JIT_BAILOUT otherwise, before anything
+ * ran), loads them, runs the loop and stores them back:
+ *
+ *      push callee-saved registers
+ *      for each variable: load it, or bail out if it is not an int
+ *      loop
+ *      for each variable: store it
+ *      return JIT_DONE
+ *
+ * Expressions are evaluated into eax with one template per node, spilling
+ * the left operand to the machine stack when the right one is not a leaf.
+ * Anything the templates do not cover (strings, print, declarations,
+ * division by something other than a safe constant) rejects the loop.
+ */
+
+// Registers the variables are kept in. rdi holds the argument, rax, rcx
+// and rdx are scratch registers for the templates.
+#define RAX 0
+#define RCX 1
+#define RBX 3
+#define RSI 6
+
+static const int variable_registers[JIT_MAX_VARIABLES] = {RBX, RSI, 8, 9, 10, 11, 12, 13, 14, 15};
+
+// Callee-saved registers among them.
+static const int saved_registers[] = {RBX, 12, 13, 14, 15};
+#define SAVED_REGISTER_COUNT ((int)(sizeof(saved_registers) / sizeof(saved_registers[0])))
+
+// Condition codes of setcc/jcc.
+#define CC_EQUAL 0x4
+#define CC_NOT_EQUAL 0x5
+#define CC_LESS 0xC
+#define CC_GREATER_EQUAL 0xD
+#define CC_LESS_EQUAL 0xE
+#define CC_GREATER 0xF
+
+typedef struct CodeBuffer
+{
+    uint8_t *code;
+    size_t count;
+    size_t capacity;
+} CodeBuffer;
+
+typedef struct JitCompiler
+{
+    CodeBuffer buffer;
+    JitLoop *loop;
+
+    // Blocks opened inside the loop. They declare nothing, so an identifier
+    // inside block_depth blocks is block_depth levels further away.
+    int block_depth;
+    int failed;
+} JitCompiler;
+
+static void emit_byte(CodeBuffer *buffer, uint8_t byte)
+{
+    if (buffer->count == buffer->capacity)
+    {
+        buffer->capacity = buffer->capacity < 256 ? 256 : buffer->capacity * 2;
+        buffer->code = (uint8_t *)realloc(buffer->code, buffer->capacity);
+        if (buffer->code == NULL)
+        {
+            fprintf(stderr, "Failed to allocate memory for CodeBuffer->code.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    buffer->code[buffer->count++] = byte;
+}
+
+static void emit_int32(CodeBuffer *buffer, int32_t value)
+{
+    uint32_t bits = (uint32_t)value;
+    for (int i = 0; i < 4; i++)
+    {
+        emit_byte(buffer, (bits >> (8 * i)) & 0xFF);
+    }
+}
+
+static void patch_int32(CodeBuffer *buffer, size_t offset, int32_t value)
+{
+    uint32_t bits = (uint32_t)value;
+    for (int i = 0; i < 4; i++)
+    {
+        buffer->code[offset + i] = (bits >> (8 * i)) & 0xFF;
+    }
+}
+
+// REX prefix for 32 bit operations, only when an extended register is used.
+static void emit_rex(CodeBuffer *buffer, int reg, int rm)
+{
+    if (reg >= 8 || rm >= 8)
+    {
+        emit_byte(buffer, 0x40 | ((reg >> 3) << 2) | (rm >> 3));
+    }
+}
+
+static void emit_modrm(CodeBuffer *buffer, int mod, int reg, int rm)
+{
+    emit_byte(buffer, (mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+// op r/m32, r32 with both operands registers (mov, add, sub, cmp, ...).
+static void emit_op_reg_reg(CodeBuffer *buffer, uint8_t opcode, int destination, int source)
+{
+    emit_rex(buffer, source, destination);
+    emit_byte(buffer, opcode);
+    emit_modrm(buffer, 3, source, destination);
+}
+
+// mov r32, imm32
+static void emit_mov_imm(CodeBuffer *buffer, int destination, int32_t value)
+{
+    emit_rex(buffer, 0, destination);
+    emit_byte(buffer, 0xB8 + (destination & 7));
+    emit_int32(buffer, value);
+}
+
+// setcc al; movzx eax, al
+static void emit_set_condition(CodeBuffer *buffer, int condition)
+{
+    emit_byte(buffer, 0x0F);
+    emit_byte(buffer, 0x90 + condition);
+    emit_byte(buffer, 0xC0);
+    emit_byte(buffer, 0x0F);
+    emit_byte(buffer, 0xB6);
+    emit_byte(buffer, 0xC0);
+}
+
+// test eax, eax; jz rel32. Returns the offset of rel32 for patch_jump().
+static size_t emit_jump_if_zero(CodeBuffer *buffer)
+{
+    emit_op_reg_reg(buffer, 0x85, RAX, RAX);
+    emit_byte(buffer, 0x0F);
+    emit_byte(buffer, 0x84);
+    emit_int32(buffer, 0);
+    return buffer->count - 4;
+}
+
+// jmp rel32. Returns the offset of rel32 for patch_jump().
+static size_t emit_jump(CodeBuffer *buffer)
+{
+    emit_byte(buffer, 0xE9);
+    emit_int32(buffer, 0);
+    return buffer->count - 4;
+}
+
+// Points the jump whose rel32 is at offset to the end of the buffer.
+static void patch_jump(CodeBuffer *buffer, size_t offset)
+{
+    patch_int32(buffer, offset, (int32_t)(buffer->count - (offset + 4)));
+}
+
+// jmp rel32 back to target.
+static void emit_loop(CodeBuffer *buffer, size_t target)
+{
+    emit_byte(buffer, 0xE9);
+    emit_int32(buffer, (int32_t)(target - (buffer->count + 4)));
+}
+
+// Returns the register of a variable, assigning one on first use.
+static int variable_register(JitCompiler *jc, ASTNode *identifier)
+{
+    JitLoop *loop = jc->loop;
+    int depth = identifier->data.identifier.depth - jc->block_depth;
+    int slot = identifier->data.identifier.slot;
+    if (depth < 0)
+    {
+        jc->failed = 1;
+        return RAX;
+    }
+
+    for (int i = 0; i < loop->variable_count; i++)
+    {
+        if (loop->depths[i] == depth && loop->slots[i] == slot)
+        {
+            return variable_registers[i];
+        }
+    }
+
+    if (loop->variable_count == JIT_MAX_VARIABLES)
+    {
+        jc->failed = 1;
+        return RAX;
+    }
+    loop->depths[loop->variable_count] = depth;
+    loop->slots[loop->variable_count] = slot;
+    return variable_registers[loop->variable_count++];
+}
+
+static int condition_code(BinaryOp op)
+{
+    switch (op)
+    {
+    case IS_EQUAL:
+        return CC_EQUAL;
+    case IS_NOT_EQUAL:
+        return CC_NOT_EQUAL;
+    case IS_LESS_THAN:
+        return CC_LESS;
+    case LESS_THAN_EQUAL:
+        return CC_LESS_EQUAL;
+    case IS_GREATER_THAN:
+        return CC_GREATER;
+    case GREATER_THAN_EQUAL:
+        return CC_GREATER_EQUAL;
+    default:
+        return -1;
+    }
+}
+
+// Evaluates an expression into eax.
+static void jit_expression(JitCompiler *jc, ASTNode *node)
+{
+    CodeBuffer *buffer = &jc->buffer;
+    switch (node->type)
+    {
+    case NODE_INTEGER:
+        emit_mov_imm(buffer, RAX, node->data.integer_value);
+        break;
+    case NODE_IDENTIFIER:
+        emit_op_reg_reg(buffer, 0x89, RAX, variable_register(jc, node));
+        break;
+    case NODE_UNARY_OP:
+        jit_expression(jc, node->data.unary_op.right);
+        if (node->data.unary_op.op == NEGATE)
+        {
+            // neg eax
+            emit_byte(buffer, 0xF7);
+            emit_byte(buffer, 0xD8);
+        }
+        else
+        {
+            emit_op_reg_reg(buffer, 0x85, RAX, RAX);
+            emit_set_condition(buffer, CC_EQUAL);
+        }
+        break;
+    case NODE_BINARY_OP:
+    {
+        BinaryOp op = node->data.binary_op.op;
+        ASTNode *right = node->data.binary_op.right;
+
+        if (op == DIVIDE)
+        {
+            // Division by zero and INT_MIN / -1 are left to the interpreter,
+            // so the divisor has to be a constant that cannot cause either.
+            if (right->type != NODE_INTEGER || right->data.integer_value == 0 || right->data.integer_value == -1)
+            {
+                jc->failed = 1;
+                return;
+            }
+            jit_expression(jc, node->data.binary_op.left);
+            emit_mov_imm(buffer, RCX, right->data.integer_value);
+            // cdq; idiv ecx
+            emit_byte(buffer, 0x99);
+            emit_byte(buffer, 0xF7);
+            emit_byte(buffer, 0xF9);
+            break;
+        }
+
+        jit_expression(jc, node->data.binary_op.left);
+        int operand = RCX;
+        if (right->type == NODE_IDENTIFIER)
+        {
+            operand = variable_register(jc, right);
+        }
+        else if (right->type == NODE_INTEGER)
+        {
+            emit_mov_imm(buffer, RCX, right->data.integer_value);
+        }
+        else
+        {
+            // push rax; right; mov ecx, eax; pop rax
+            emit_byte(buffer, 0x50);
+            jit_expression(jc, right);
+            emit_op_reg_reg(buffer, 0x89, RCX, RAX);
+            emit_byte(buffer, 0x58);
+        }
+
+        switch (op)
+        {
+        case ADD:
+            emit_op_reg_reg(buffer, 0x01, RAX, operand);
+            break;
+        case SUBTRACT:
+            emit_op_reg_reg(buffer, 0x29, RAX, operand);
+            break;
+        case MULTIPLY:
+            // imul eax, r/m32
+            emit_rex(buffer, 0, operand);
+            emit_byte(buffer, 0x0F);
+            emit_byte(buffer, 0xAF);
+            emit_modrm(buffer, 3, RAX, operand);
+            break;
+        default:
+            emit_op_reg_reg(buffer, 0x39, RAX, operand);
+            emit_set_condition(buffer, condition_code(op));
+            break;
+        }
+        break;
+    }
+    default:
+        // Strings, or anything else the templates do not know.
+        jc->failed = 1;
+        break;
+    }
+}
+
+static void jit_statement(JitCompiler *jc, ASTNode *node);
+
+// WHILE:   condition; jz end; body; jmp condition
+static void jit_while(JitCompiler *jc, ASTNode *condition)
+{
+    CodeBuffer *buffer = &jc->buffer;
+    size_t loop_start = buffer->count;
+    jit_expression(jc, condition);
+    size_t exit_jump = emit_jump_if_zero(buffer);
+    jit_statement(jc, condition->next);
+    emit_loop(buffer, loop_start);
+    patch_jump(buffer, exit_jump);
+}
+
+// IF:      condition; jz else; then; jmp end; else
+static void jit_if(JitCompiler *jc, ASTNode *condition)
+{
+    CodeBuffer *buffer = &jc->buffer;
+    jit_expression(jc, condition);
+    size_t else_jump = emit_jump_if_zero(buffer);
+    jit_statement(jc, condition->next);
+    if (condition->next->next == NULL)
+    {
+        patch_jump(buffer, else_jump);
+        return;
+    }
+    size_t end_jump = emit_jump(buffer);
+    patch_jump(buffer, else_jump);
+    jit_statement(jc, condition->next->next);
+    patch_jump(buffer, end_jump);
+}
+
+static void jit_statement(JitCompiler *jc, ASTNode *node)
+{
+    if (jc->failed)
+    {
+        return;
+    }
+
+    switch (node->data.statement.type)
+    {
+    case ASSIGNMENT:
+    {
+        ASTNode *assignment = node->data.statement.data.assignment;
+        jit_expression(jc, assignment->data.assignment.right);
+        emit_op_reg_reg(&jc->buffer, 0x89, variable_register(jc, assignment->data.assignment.identifier), RAX);
+        break;
+    }
+    case BLOCK_STATEMENT:
+        // Declarations would need fresh variables on every iteration.
+        if (node->data.statement.slot_count > 0)
+        {
+            jc->failed = 1;
+            return;
+        }
+        jc->block_depth++;
+        for (ASTNode *dummy = node->data.statement.data.head; dummy && !jc->failed; dummy = dummy->next)
+        {
+            jit_statement(jc, dummy);
+        }
+        jc->block_depth--;
+        break;
+    case WHILE_STATEMENT:
+        jit_while(jc, node->data.statement.data.expression);
+        break;
+    case IF_STATEMENT:
+        jit_if(jc, node->data.statement.data.expression);
+        break;
+    default:
+        // Declarations and print.
+        jc->failed = 1;
+        break;
+    }
+}
+
+// mov rax, [rdi + 8 * index]
+static void emit_load_variable_pointer(CodeBuffer *buffer, int index)
+{
+    emit_byte(buffer, 0x48);
+    emit_byte(buffer, 0x8B);
+    emit_modrm(buffer, 1, RAX, 7);
+    emit_byte(buffer, 8 * index);
+}
+
+static void emit_return(CodeBuffer *buffer, int32_t status)
+{
+    emit_mov_imm(buffer, RAX, status);
+    for (int i = SAVED_REGISTER_COUNT - 1; i >= 0; i--)
+    {
+        emit_rex(buffer, 0, saved_registers[i]);
+        emit_byte(buffer, 0x58 + (saved_registers[i] & 7));
+    }
+    emit_byte(buffer, 0xC3);
+}
+
+// Wraps the compiled loop body into a function, see the top of the file.
+static void emit_function(CodeBuffer *function, JitLoop *loop, CodeBuffer *body)
+{
+    for (int i = 0; i < SAVED_REGISTER_COUNT; i++)
+    {
+        emit_rex(function, 0, saved_registers[i]);
+        emit_byte(function, 0x50 + (saved_registers[i] & 7));
+    }
+
+    size_t bailouts[JIT_MAX_VARIABLES];
+    for (int i = 0; i < loop->variable_count; i++)
+    {
+        int reg = variable_registers[i];
+        emit_load_variable_pointer(function, i);
+        // cmp dword [rax], VAL_INT; jne bailout
+        emit_byte(function, 0x83);
+        emit_modrm(function, 0, 7, RAX);
+        emit_byte(function, VAL_INT);
+        emit_byte(function, 0x0F);
+        emit_byte(function, 0x85);
+        emit_int32(function, 0);
+        bailouts[i] = function->count - 4;
+        // mov reg, [rax + offsetof(Value, as)]
+        emit_rex(function, reg, RAX);
+        emit_byte(function, 0x8B);
+        emit_modrm(function, 1, reg, RAX);
+        emit_byte(function, offsetof(Value, as));
+    }
+
+    for (size_t i = 0; i < body->count; i++)
+    {
+        emit_byte(function, body->code[i]);
+    }
+
+    for (int i = 0; i < loop->variable_count; i++)
+    {
+        int reg = variable_registers[i];
+        emit_load_variable_pointer(function, i);
+        // mov [rax + offsetof(Value, as)], reg
+        emit_rex(function, reg, RAX);
+        emit_byte(function, 0x89);
+        emit_modrm(function, 1, reg, RAX);
+        emit_byte(function, offsetof(Value, as));
+    }
+    emit_return(function, JIT_DONE);
+
+    for (int i = 0; i < loop->variable_count; i++)
+    {
+        patch_jump(function, bailouts[i]);
+    }
+    emit_return(function, JIT_BAILOUT);
+}
+
+// Copies code into memory that is mapped writable, then made executable.
+static void install_code(JitLoop *loop, CodeBuffer *function)
+{
+    void *code = mmap(NULL, function->count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+    {
+        return;
+    }
+    memcpy(code, function->code, function->count);
+    if (mprotect(code, function->count, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(code, function->count);
+        return;
+    }
+    loop->code = code;
+    loop->code_size = function->count;
+    loop->function = (int (*)(Value **))code;
+}
+
+// Compiles a WHILE_STATEMENT. Always returns a loop, whose function is NULL
+// if the loop cannot be compiled.
+JitLoop *jit_compile_loop(Jit *jit, ASTNode *while_statement)
+{
+    JitLoop *loop = (JitLoop *)malloc(sizeof(JitLoop));
+    if (loop == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for JitLoop.\n");
+        exit(EXIT_FAILURE);
+    }
+    loop->function = NULL;
+    loop->variable_count = 0;
+    loop->code = NULL;
+    loop->code_size = 0;
+    loop->next = jit->loops;
+    jit->loops = loop;
+
+#if defined(__x86_64__)
+    JitCompiler jc = {{NULL, 0, 0}, loop, 0, 0};
+    jit_while(&jc, while_statement->data.statement.data.expression);
+    if (!jc.failed)
+    {
+        CodeBuffer function = {NULL, 0, 0};
+        emit_function(&function, loop, &jc.buffer);
+        install_code(loop, &function);
+        free(function.code);
+    }
+    free(jc.buffer.code);
+#endif
+
+    return loop;
+}
+
+// Runs a compiled loop. variables[i] points to variable i of the loop.
+// Returns JIT_BAILOUT without running anything if a variable is not an int.
+int jit_run_loop(JitLoop *loop, Value **variables)
+{
+    return loop->function(variables);
+}
+
+Jit *create_jit()
+{
+    Jit *jit = (Jit *)malloc(sizeof(Jit));
+    if (jit == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for Jit.\n");
+        exit(EXIT_FAILURE);
+    }
+    jit->loops = NULL;
+    return jit;
+}
+
+void free_jit(Jit *jit)
+{
+    JitLoop *loop = jit->loops;
+    while (loop)
+    {
+        JitLoop *next = loop->next;
+        if (loop->code)
+        {
+            munmap(loop->code, loop->code_size);
+        }
+        free(loop);
+        loop = next;
+    }
+    free(jit);
+}
@@ -0,0 +1,47 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+
+#include "parser.h"
+#include "value.h"
+
+// Loop variables live in registers, so a loop can use at most this many.
+#define JIT_MAX_VARIABLES 10
+
+// Results of jit_run_loop().
+#define JIT_DONE 0
+#define JIT_BAILOUT 1
+
+// JitLoop is a while loop compiled to x86-64 machine code.
+// The loop only uses int variables declared outside of it. They are named
+// like resolve() names them, relative to the scope of the while statement:
+// variable i is the slot slots[i] of the scope depths[i] levels up.
+// function is NULL if the loop cannot be compiled; engines run such loops
+// themselves.
+typedef struct JitLoop
+{
+    int (*function)(Value **variables);
+    int variable_count;
+    int depths[JIT_MAX_VARIABLES];
+    int slots[JIT_MAX_VARIABLES];
+
+    void *code;
+    size_t code_size;
+
+    struct JitLoop *next;
+} JitLoop;
+
+// Jit owns every loop it compiled.
+typedef struct Jit
+{
+    JitLoop *loops;
+} Jit;
+
+Jit *create_jit();
+void free_jit(Jit *jit);
+
+JitLoop *jit_compile_loop(Jit *jit, ASTNode *while_statement);
+int jit_run_loop(JitLoop *loop, Value **variables);
+
+#endif // JIT_H
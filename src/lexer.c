@@ -1,13 +1,41 @@
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdlib.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "lexer.h"
 
+// Character classes, so the lexer does not go through the locale tables.
+#define CHAR_SPACE 0x01
+#define CHAR_NEWLINE 0x02
+#define CHAR_DIGIT 0x04
+#define CHAR_ALPHA 0x08
+#define CHAR_ALNUM (CHAR_DIGIT | CHAR_ALPHA)
+
+static const uint8_t char_class[256] = {
+    ['\t'] = CHAR_SPACE, [' '] = CHAR_SPACE,
+    ['\n'] = CHAR_SPACE | CHAR_NEWLINE, ['\r'] = CHAR_SPACE,
+    ['0'] = CHAR_DIGIT, ['1'] = CHAR_DIGIT, ['2'] = CHAR_DIGIT, ['3'] = CHAR_DIGIT, ['4'] = CHAR_DIGIT,
+    ['5'] = CHAR_DIGIT, ['6'] = CHAR_DIGIT, ['7'] = CHAR_DIGIT, ['8'] = CHAR_DIGIT, ['9'] = CHAR_DIGIT,
+    ['A'] = CHAR_ALPHA, ['B'] = CHAR_ALPHA, ['C'] = CHAR_ALPHA, ['D'] = CHAR_ALPHA, ['E'] = CHAR_ALPHA, ['F'] = CHAR_ALPHA, ['G'] = CHAR_ALPHA,
+    ['H'] = CHAR_ALPHA, ['I'] = CHAR_ALPHA, ['J'] = CHAR_ALPHA, ['K'] = CHAR_ALPHA, ['L'] = CHAR_ALPHA, ['M'] = CHAR_ALPHA, ['N'] = CHAR_ALPHA,
+    ['O'] = CHAR_ALPHA, ['P'] = CHAR_ALPHA, ['Q'] = CHAR_ALPHA, ['R'] = CHAR_ALPHA, ['S'] = CHAR_ALPHA, ['T'] = CHAR_ALPHA, ['U'] = CHAR_ALPHA,
+    ['V'] = CHAR_ALPHA, ['W'] = CHAR_ALPHA, ['X'] = CHAR_ALPHA, ['Y'] = CHAR_ALPHA, ['Z'] = CHAR_ALPHA,
+    ['a'] = CHAR_ALPHA, ['b'] = CHAR_ALPHA, ['c'] = CHAR_ALPHA, ['d'] = CHAR_ALPHA, ['e'] = CHAR_ALPHA, ['f'] = CHAR_ALPHA, ['g'] = CHAR_ALPHA,
+    ['h'] = CHAR_ALPHA, ['i'] = CHAR_ALPHA, ['j'] = CHAR_ALPHA, ['k'] = CHAR_ALPHA, ['l'] = CHAR_ALPHA, ['m'] = CHAR_ALPHA, ['n'] = CHAR_ALPHA,
+    ['o'] = CHAR_ALPHA, ['p'] = CHAR_ALPHA, ['q'] = CHAR_ALPHA, ['r'] = CHAR_ALPHA, ['s'] = CHAR_ALPHA, ['t'] = CHAR_ALPHA, ['u'] = CHAR_ALPHA,
+    ['v'] = CHAR_ALPHA, ['w'] = CHAR_ALPHA, ['x'] = CHAR_ALPHA, ['y'] = CHAR_ALPHA, ['z'] = CHAR_ALPHA,
+};
+
+#define CHAR_IS(c, class) (char_class[(unsigned char)(c)] & (class))
+
 int is_whitespace(char c)
 {
-    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    return CHAR_IS(c, CHAR_SPACE);
 }
 
 void lex_advance(LexerState *state, int n)
@@ -35,73 +63,336 @@ char lex_peek_n(LexerState *state, int n)
     return state->prog[state->pos + n];
 }
 
-void lex_emit(LexerState *state, TokenKind type, int start_pos, int end_pos)
+// Starts a new line at line_pos.
+static void lex_newline(LexerState *state, int64_t line_pos)
 {
-    state->tail->type = type;
-    state->tail->start_pos = start_pos;
-    state->tail->end_pos = end_pos;
-    state->tail->line_start_pos = start_pos - state->line_pos;
-
-    int len = end_pos - start_pos;
-    state->tail->value = (char *)malloc(len + 1);
-    strncpy(
-        state->tail->value,
-        state->prog + start_pos,
-        len);
-    state->tail->value[len] = '\0';
-
-    state->tail->line = state->line_num;
-
-    state->tail->next = (Token *)malloc(sizeof(Token));
-    state->tail = state->tail->next;
+    state->line_num++;
+    state->line_pos = line_pos;
 }
 
-void lex_number(LexerState *state)
+void lex_emit(LexerState *state, TokenKind type, int64_t start_pos, int64_t end_pos)
+{
+    TokenBuffer *tokens = &state->tokens;
+    int slot = tokens->count & TOKEN_RING_MASK;
+
+    tokens->kinds[slot] = type;
+    tokens->starts[slot] = start_pos;
+    tokens->lengths[slot] = end_pos - start_pos;
+    tokens->lines[slot] = state->line_num;
+    tokens->line_start_positions[slot] = start_pos - state->line_pos;
+    tokens->interned[slot] = NULL;
+    tokens->count++;
+}
+
+// Emits a token whose text is interned.
+static void lex_emit_interned(LexerState *state, TokenKind type, int64_t start_pos, int64_t end_pos)
+{
+    lex_emit(state, type, start_pos, end_pos);
+    TokenBuffer *tokens = &state->tokens;
+    tokens->interned[(tokens->count - 1) & TOKEN_RING_MASK] =
+        intern(state->interns, state->prog + start_pos, (size_t)(end_pos - start_pos));
+}
+
+// Returns the kind of the token n tokens after the next one.
+TokenKind lexer_peek_kind(LexerState *state, int n)
 {
-    int start_pos = state->pos;
-    int len = 0;
-    while (lex_peek(state) != '\0' && isdigit(lex_peek(state)))
+    TokenBuffer *tokens = &state->tokens;
+    while (tokens->count - tokens->read <= n)
     {
-        lex_consume(state);
-        len++;
+        lex_token(state);
     }
+    return tokens->kinds[(tokens->read + n) & TOKEN_RING_MASK];
+}
+
+Token lexer_peek(LexerState *state, int n)
+{
+    lexer_peek_kind(state, n);
+
+    TokenBuffer *tokens = &state->tokens;
+    int slot = (tokens->read + n) & TOKEN_RING_MASK;
+    Token token;
+    token.type = tokens->kinds[slot];
+    token.start_pos = tokens->starts[slot];
+    token.length = tokens->lengths[slot];
+    token.line = tokens->lines[slot];
+    token.line_start_pos = tokens->line_start_positions[slot];
+    token.interned = tokens->interned[slot];
+    return token;
+}
 
-    lex_emit(state, NUMBER, start_pos, start_pos + len);
+// Returns the next token and releases its slot.
+// Once the program is exhausted every call returns an EOF_TOKEN.
+Token next_token(LexerState *state)
+{
+    Token token = lexer_peek(state, 0);
+    state->tokens.read++;
+    return token;
 }
 
-void lex_identifier(LexerState *state)
+// Scanners for the runs the lexer spends most of its time in. Each returns
+// the position of the first byte at or after pos that ends the run; '\0'
+// always ends a run.
+#ifdef __SSE2__
+// The SSE2 versions look at 16 bytes at a time. Loads are 16 byte aligned,
+// so they never cross into a page past the terminating '\0'.
+
+// Bytes of the block before pos are ignored.
+#define SCAN_START(prog, pos) \
+    const char *block = (const char *)((uintptr_t)((prog) + (pos)) & ~(uintptr_t)15); \
+    unsigned in_range = (0xFFFFu << ((prog) + (pos) - block)) & 0xFFFFu
+
+#define SCAN_RESULT(prog, stop) ((int64_t)(block - (prog)) + __builtin_ctz(stop))
+
+static inline __m128i simd_in_range(__m128i chunk, char low, char high)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(low - 1)),
+                         _mm_cmplt_epi8(chunk, _mm_set1_epi8(high + 1)));
+}
+
+static inline __m128i simd_is_digit(__m128i chunk)
+{
+    return simd_in_range(chunk, '0', '9');
+}
+
+static inline __m128i simd_is_alnum(__m128i chunk)
+{
+    // Setting bit 5 folds upper case letters into lower case.
+    __m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+    return _mm_or_si128(simd_is_digit(chunk), simd_in_range(lower, 'a', 'z'));
+}
+
+// Most runs are short, so the first SCALAR_PREFIX bytes are checked one at
+// a time before switching to 16 byte blocks.
+#define SCALAR_PREFIX 8
+
+// Finds the end of a run of bytes of char class member_class.
+#define DEFINE_SIMD_RUN_SCANNER(name, member_class, is_member)              \
+    static int64_t name(const char *prog, int64_t pos)                      \
+    {                                                                       \
+        for (int i = 0; i < SCALAR_PREFIX; i++, pos++)                      \
+        {                                                                   \
+            if (!CHAR_IS(prog[pos], member_class))                          \
+            {                                                               \
+                return pos;                                                 \
+            }                                                               \
+        }                                                                   \
+        SCAN_START(prog, pos);                                              \
+        for (;;)                                                            \
+        {                                                                   \
+            __m128i chunk = _mm_load_si128((const __m128i *)block);         \
+            unsigned stop = ~_mm_movemask_epi8(is_member(chunk)) & in_range; \
+            if (stop)                                                       \
+            {                                                               \
+                return SCAN_RESULT(prog, stop);                             \
+            }                                                               \
+            block += 16;                                                    \
+            in_range = 0xFFFFu;                                             \
+        }                                                                   \
+    }
+
+DEFINE_SIMD_RUN_SCANNER(scan_digits, CHAR_DIGIT, simd_is_digit)
+DEFINE_SIMD_RUN_SCANNER(scan_alnum, CHAR_ALNUM, simd_is_alnum)
+
+// Finds the end of a comment, the next '\n'.
+static int64_t scan_line_end(const char *prog, int64_t pos)
 {
-    int start_pos = state->pos;
-    int len = 0;
-    while (isalnum(lex_peek(state)) && lex_peek(state) != '\0')
+    SCAN_START(prog, pos);
+    for (;;)
     {
-        lex_consume(state);
-        len++;
+        __m128i chunk = _mm_load_si128((const __m128i *)block);
+        __m128i end = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')),
+                                   _mm_cmpeq_epi8(chunk, _mm_setzero_si128()));
+        unsigned stop = _mm_movemask_epi8(end) & in_range;
+        if (stop)
+        {
+            return SCAN_RESULT(prog, stop);
+        }
+        block += 16;
+        in_range = 0xFFFFu;
+    }
+}
+
+// Finds the next '"', '\\' or '\n' of a string literal.
+static int64_t scan_string_body(const char *prog, int64_t pos)
+{
+    SCAN_START(prog, pos);
+    for (;;)
+    {
+        __m128i chunk = _mm_load_si128((const __m128i *)block);
+        __m128i end = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')),
+                         _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')),
+                         _mm_cmpeq_epi8(chunk, _mm_setzero_si128())));
+        unsigned stop = _mm_movemask_epi8(end) & in_range;
+        if (stop)
+        {
+            return SCAN_RESULT(prog, stop);
+        }
+        block += 16;
+        in_range = 0xFFFFu;
+    }
+}
+
+// Skips whitespace, recording every line that starts inside it.
+static int64_t lex_skip_whitespace(LexerState *state)
+{
+    const char *prog = state->prog;
+    int64_t pos = state->pos;
+    for (int i = 0; i < SCALAR_PREFIX; i++, pos++)
+    {
+        if (!CHAR_IS(prog[pos], CHAR_SPACE))
+        {
+            return pos;
+        }
+        if (CHAR_IS(prog[pos], CHAR_NEWLINE))
+        {
+            lex_newline(state, pos + 1);
+        }
+    }
+
+    SCAN_START(prog, pos);
+    for (;;)
+    {
+        __m128i chunk = _mm_load_si128((const __m128i *)block);
+        __m128i newline = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'));
+        __m128i space = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                         _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')), newline));
+
+        unsigned stop = ~_mm_movemask_epi8(space) & in_range;
+        unsigned newlines = _mm_movemask_epi8(newline) & in_range;
+        if (stop)
+        {
+            // Only the newlines before the end of the run count.
+            newlines &= (stop & -stop) - 1;
+        }
+        while (newlines)
+        {
+            lex_newline(state, (int64_t)(block - prog) + __builtin_ctz(newlines) + 1);
+            newlines &= newlines - 1;
+        }
+        if (stop)
+        {
+            return SCAN_RESULT(prog, stop);
+        }
+        block += 16;
+        in_range = 0xFFFFu;
+    }
+}
+#else
+static int64_t scan_digits(const char *prog, int64_t pos)
+{
+    while (CHAR_IS(prog[pos], CHAR_DIGIT))
+    {
+        pos++;
+    }
+    return pos;
+}
+
+static int64_t scan_alnum(const char *prog, int64_t pos)
+{
+    while (CHAR_IS(prog[pos], CHAR_ALNUM))
+    {
+        pos++;
+    }
+    return pos;
+}
+
+static int64_t scan_line_end(const char *prog, int64_t pos)
+{
+    while (prog[pos] != '\0' && prog[pos] != '\n')
+    {
+        pos++;
     }
-    char id[len + 1];
-    strncpy(id, state->prog + start_pos, len);
-    id[len] = '\0';
+    return pos;
+}
 
-    // Implement into hashmap when I have time.
-    if (strcmp(id, "if") == 0)
+static int64_t scan_string_body(const char *prog, int64_t pos)
+{
+    while (prog[pos] != '\0' && prog[pos] != '"' && prog[pos] != '\\' && prog[pos] != '\n')
     {
-        lex_emit(state, IF, start_pos, start_pos + len);
+        pos++;
     }
-    else if (strcmp(id, "else") == 0)
+    return pos;
+}
+
+static int64_t lex_skip_whitespace(LexerState *state)
+{
+    int64_t pos = state->pos;
+    while (CHAR_IS(state->prog[pos], CHAR_SPACE))
     {
-        lex_emit(state, ELSE, start_pos, start_pos + len);
+        if (CHAR_IS(state->prog[pos], CHAR_NEWLINE))
+        {
+            lex_newline(state, pos + 1);
+        }
+        pos++;
     }
-    else if (strcmp(id, "while") == 0)
+    return pos;
+}
+#endif
+
+void lex_number(LexerState *state)
+{
+    int64_t start_pos = state->pos;
+    state->pos = scan_digits(state->prog, state->pos);
+
+    lex_emit(state, NUMBER, start_pos, state->pos);
+}
+
+// Returns the keyword spelled by the identifier, or IDENTIFIER.
+// Dispatching on the length first means at most two comparisons.
+static TokenKind lex_keyword(const char *id, int len)
+{
+    switch (len)
     {
-        lex_emit(state, WHILE, start_pos, start_pos + len);
+    case 2:
+        if (id[0] == 'i' && id[1] == 'f')
+        {
+            return IF;
+        }
+        break;
+    case 3:
+        if (memcmp(id, "for", 3) == 0)
+        {
+            return FOR;
+        }
+        break;
+    case 4:
+        if (memcmp(id, "else", 4) == 0)
+        {
+            return ELSE;
+        }
+        break;
+    case 5:
+        if (id[0] == 'w' && memcmp(id, "while", 5) == 0)
+        {
+            return WHILE;
+        }
+        if (id[0] == 'p' && memcmp(id, "print", 5) == 0)
+        {
+            return PRINT;
+        }
+        break;
     }
-    else if (strcmp(id, "for") == 0)
+    return IDENTIFIER;
+}
+
+void lex_identifier(LexerState *state)
+{
+    int64_t start_pos = state->pos;
+    state->pos = scan_alnum(state->prog, state->pos);
+
+    int len = (int)(state->pos - start_pos);
+    TokenKind kind = lex_keyword(state->prog + start_pos, len);
+    if (kind == IDENTIFIER)
     {
-        lex_emit(state, FOR, start_pos, start_pos + len);
+        lex_emit_interned(state, kind, start_pos, state->pos);
     }
     else
     {
-        lex_emit(state, IDENTIFIER, start_pos, start_pos + len);
+        lex_emit(state, kind, start_pos, state->pos);
     }
 }
 
@@ -110,49 +401,25 @@ void lex_string(LexerState *state)
     // Consume the ".
     lex_consume(state);
 
-    int start_pos = state->pos;
-    int len = 0;
-    while (lex_peek(state) != '\0' && lex_peek(state) != '"' && lex_peek(state) != '\n')
+    int64_t start_pos = state->pos;
+    while (1)
     {
-        len++;
-        char c = lex_consume(state);
+        state->pos = scan_string_body(state->prog, state->pos);
+        if (lex_peek(state) != '\\')
+        {
+            break;
+        }
 
-        if (c == '\\')
+        // Escape sequences are kept as written, the lexer only makes sure
+        // the escaped character (e.g. \") does not end the string.
+        //   \n \t \r \b \f \a \\ \' \" \0 \xNN \ooo
+        lex_consume(state);
+        if (lex_peek(state) != '\0' && lex_peek(state) != '\n')
         {
-            // Implementing valid escape sequences
-            // \n: Newline (line break)
-            // \t: Horizontal tab
-            // \r: Carriage return
-            // \b: Backspace
-            // \f: Form feed
-            // \a: Alert (bell)
-            // \\: Backslash (to escape the backslash itself)
-            // \': Single quote (useful inside single-quoted characters)
-            // \": Double quote (useful inside double-quoted strings)
-            // \0: Null character (end of string in C)
-            // \xNN: Hexadecimal escape (where NN is a hexadecimal number, like \x7A for the character 'z')
-            // \ooo: Octal escape (where ooo is an octal value, like \141 for 'a')
-            switch (lex_peek_next(state))
-            {
-            case 'n':
-            case 't':
-            case 'r':
-            case 'b':
-            case 'f':
-            case 'a':
-            case '\\':
-            case '\'':
-            case '"':
-            case '0':
-                lex_consume(state);
-                break;
-            // worry about this later
-            case 'o':
-            case 'x':
-                lex_advance(state, 3);
-            }
+            lex_consume(state);
         }
     }
+    int64_t end_pos = state->pos;
 
     // This should be a ".
     char c = lex_consume(state);
@@ -161,69 +428,33 @@ void lex_string(LexerState *state)
         fprintf(stderr, "Unterminated string.");
         exit(1);
     }
-    lex_emit(state, STRING, start_pos, start_pos + len);
+    lex_emit_interned(state, STRING, start_pos, end_pos);
 }
 
-int lex_match(LexerState *state, const char *str)
+// Lexes the next token into the ring buffer, skipping whitespace and
+// comments. At the end of the program an EOF_TOKEN is emitted.
+void lex_token(LexerState *state)
 {
-    int len = strlen(str);
+    int64_t count = state->tokens.count;
 
-    for (int i = 0; i < len; i++)
+    while (state->tokens.count == count)
     {
-        if (lex_peek_n(state, i) != str[i])
+        char ch = state->prog[state->pos];
+        if (ch == '\0')
         {
-            return 0;
+            lex_emit(state, EOF_TOKEN, state->pos, state->pos);
+            return;
         }
-    }
-
-    return 1;
-}
-
-Token *lexer(LexerState *state)
-{
-    // 1 + 2 + 3
-    // NUMBER(1), PLUS, NUMBER(2), PLUS, NUMBER(3), EOF
-    //  Token_t {
-    //      TokenKind.INTEGER,
-    //      "1",
-    //      Token_t {
-    //          TokenKind.PLUS
-    //          "+" - IDC
-    //          Token_t {
-    //              TokenKind.INTEGER,
-    //              "2",
-    //              null
-    //          }
-    //      }
-    // }
-    Token *head = state->tail;
-
-    while (lex_peek(state) != '\0')
-    {
-        char ch = state->prog[state->pos];
         if (is_whitespace(ch))
         {
-            if (ch == '\n' || ch == '\r')
-            {
-                state->line_pos = state->pos + 1;
-                state->line_num++;
-            }
-            lex_consume(state);
+            state->pos = lex_skip_whitespace(state);
             continue;
         }
 
-        int i;
         switch (ch)
         {
         case '#':
-            i = 1;
-            while (
-                lex_peek_n(state, i) != '\0' &&
-                lex_peek_n(state, i) != '\n')
-            {
-                i++;
-            }
-            lex_advance(state, i);
+            state->pos = scan_line_end(state->prog, state->pos + 1);
             break;
         case '+':
             lex_emit(state, PLUS, state->pos, state->pos + 1);
@@ -321,31 +552,13 @@ Token *lexer(LexerState *state)
             lex_string(state);
             break;
         default:
-            if (isdigit(ch))
+            if (CHAR_IS(ch, CHAR_DIGIT))
             {
                 lex_number(state);
                 break;
             }
-            else if (isalnum(ch))
+            else if (CHAR_IS(ch, CHAR_ALPHA))
             {
-                if (lex_match(state, "while"))
-                {
-                    lex_emit(state, WHILE, state->pos, state->pos + 5);
-                    lex_advance(state, 5);
-                    break;
-                }
-                if (lex_match(state, "print"))
-                {
-                    lex_emit(state, PRINT, state->pos, state->pos + 5);
-                    lex_advance(state, 5);
-                    break;
-                }
-                if (lex_match(state, "for"))
-                {
-                    lex_emit(state, FOR, state->pos, state->pos + 5);
-                    lex_advance(state, 5);
-                    break;
-                }
                 lex_identifier(state);
                 break;
             }
@@ -356,16 +569,9 @@ Token *lexer(LexerState *state)
         }
     }
 
-    state->tail->type = EOF_TOKEN;
-    state->tail->start_pos = state->pos;
-    state->tail->end_pos = state->pos;
-    state->tail->line = state->line_num;
-    state->tail->next = NULL;
-
-    return head;
 }
 
-LexerState *create_lexer_state(char *program)
+LexerState *create_lexer_state(char *program, InternTable *interns)
 {
     LexerState *state = (LexerState *)malloc(sizeof(LexerState));
     if (state == NULL)
@@ -375,21 +581,18 @@ LexerState *create_lexer_state(char *program)
     }
     state->pos = 0;
     state->prog = program;
+    state->interns = interns;
 
     state->line_num = 0;
+    state->line_pos = 0;
 
-    Token *tail = (Token *)malloc(sizeof(Token));
-    if (tail == NULL)
-    {
-        fprintf(stderr, "Failed to allocate memory for LexerState->tail.\n");
-        exit(EXIT_FAILURE);
-    }
-    state->tail = tail;
+    state->tokens.read = 0;
+    state->tokens.count = 0;
 
     return state;
 }
 
 void free_lexer_state(LexerState *state)
 {
-    // THIS FUNCTION DOESN'T DO ANYTHING BECAUSE I DON'T CARE ENOUGH
+    free(state);
 }
\ No newline at end of file
@@ -1,6 +1,11 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "intern.h"
+
 typedef enum TokenKind
 {
     // Statements
@@ -45,28 +50,57 @@ typedef enum TokenKind
     STRING,
 } TokenKind;
 
+// A token does not copy its text, it is a span of the program source.
+// Tokens are stored in a TokenBuffer, this is a by-value view of one of them.
+// Positions are 64-bit so programs can be larger than 2 GB.
 typedef struct Token
 {
     TokenKind type;
-    char *value;
 
     // Positional values
-    int start_pos;
-    int end_pos;
-    int line;
-    int line_start_pos;
-    
-    // Linked list next token
-    struct Token *next;
+    int64_t start_pos;
+    int64_t length;
+    int64_t line;
+    int64_t line_start_pos;
+
+    // IDENTIFIER and STRING tokens: the interned text (without the quotes).
+    char *interned;
 } Token;
 
+// Number of tokens the lexer keeps around, must be a power of two.
+// The parser never looks further ahead than TOKEN_RING_SIZE - 1 tokens.
+#define TOKEN_RING_SIZE 16
+#define TOKEN_RING_MASK (TOKEN_RING_SIZE - 1)
+
+// TokenBuffer is a ring of the tokens that have been lexed but not yet
+// consumed, stored as parallel arrays. Consumed slots are reused, so the
+// memory used by tokens does not depend on the size of the program.
+typedef struct TokenBuffer
+{
+    uint8_t kinds[TOKEN_RING_SIZE];
+    int64_t starts[TOKEN_RING_SIZE];
+    int64_t lengths[TOKEN_RING_SIZE];
+    int64_t lines[TOKEN_RING_SIZE];
+    int64_t line_start_positions[TOKEN_RING_SIZE];
+    char *interned[TOKEN_RING_SIZE];
+
+    // Both count tokens since the start of the program.
+    int64_t read;
+    int64_t count;
+} TokenBuffer;
+
+// The lexer runs on demand: tokens are only produced when the parser asks
+// for them through lexer_peek() and next_token().
 typedef struct LexerState
 {
-    int pos;
+    int64_t pos;
     char *prog;
-    struct Token *tail;
-    int line_num;
-    int line_pos;
+    TokenBuffer tokens;
+    int64_t line_num;
+    int64_t line_pos;
+
+    // Identifiers and string literals are interned here as they are lexed.
+    InternTable *interns;
 } LexerState;
 
 int is_whitespace(char c);
@@ -75,12 +109,15 @@ char lex_consume(LexerState *state);
 char lex_peek(LexerState *state);
 char lex_peek_next(LexerState *state);
 char lex_peek_n(LexerState *state, int n);
-void lex_emit(LexerState *state, TokenKind type, int start_pos, int end_pos);
+void lex_emit(LexerState *state, TokenKind type, int64_t start_pos, int64_t end_pos);
 void lex_number(LexerState *state);
 void lex_identifier(LexerState *state);
 void lex_string(LexerState *state);
-Token *lexer(LexerState *state);
-LexerState *create_lexer_state(char *program);
+void lex_token(LexerState *state);
+TokenKind lexer_peek_kind(LexerState *state, int n);
+Token lexer_peek(LexerState *state, int n);
+Token next_token(LexerState *state);
+LexerState *create_lexer_state(char *program, InternTable *interns);
 void free_lexer_state(LexerState *state);
 
 #endif // LEXER_H
\ No newline at end of file
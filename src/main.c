@@ -1,99 +1,494 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <inttypes.h>
 
 #include "util.h"
 #include "lexer.h"
+#include "intern.h"
 #include "parser.h"
 #include "interpreter.h"
+#include "resolver.h"
+#include "compiler.h"
+#include "vm.h"
+#include "source.h"
+#include "optimizer.h"
+#include "closure.h"
+#include "jit.h"
+#include "codegen.h"
+#include "ir.h"
+#include "gc.h"
 
-int main(int argc, char *argv[])
+typedef enum Engine
+{
+    ENGINE_VM,
+    ENGINE_TREE,
+    ENGINE_CLOSURE,
+    ENGINE_IR,
+} Engine;
+
+typedef struct Options
 {
-    if (argc > 2)
+    Engine engine;
+    int disassemble;
+    int arena_stats;
+    int resolver_stats;
+    int gc_stats;
+    int bench_lexer;
+    int stream;
+    int optimize;
+    int dump_optimized_ast;
+    int jit;
+    int emit_asm;
+    const char *output_name;
+    int dump_ir;
+    int time_passes;
+    const char *file_name;
+} Options;
+
+void print_usage()
+{
+    fprintf(stderr, "Correct use: mccp [--engine=vm|tree|closure|ir] [--disassemble] [--arena-stats] [--resolver-stats] [--gc-stats] [--bench-lexer] [--stream] [--no-optimize] [--dump-optimized-ast] [--jit] [--emit-asm] [-o executable] [--dump-ir] [--time-passes] [filename]\n");
+}
+
+Options parse_options(int argc, char *argv[])
+{
+    Options options;
+    options.engine = ENGINE_VM;
+    options.disassemble = 0;
+    options.arena_stats = 0;
+    options.resolver_stats = 0;
+    options.gc_stats = 0;
+    options.bench_lexer = 0;
+    options.stream = 0;
+    options.optimize = 1;
+    options.dump_optimized_ast = 0;
+    options.jit = 0;
+    options.emit_asm = 0;
+    options.output_name = NULL;
+    options.dump_ir = 0;
+    options.time_passes = 0;
+    options.file_name = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--engine=vm") == 0)
+        {
+            options.engine = ENGINE_VM;
+        }
+        else if (strcmp(argv[i], "--engine=tree") == 0)
+        {
+            options.engine = ENGINE_TREE;
+        }
+        else if (strcmp(argv[i], "--engine=closure") == 0)
+        {
+            options.engine = ENGINE_CLOSURE;
+        }
+        else if (strcmp(argv[i], "--engine=ir") == 0)
+        {
+            options.engine = ENGINE_IR;
+        }
+        else if (strcmp(argv[i], "--disassemble") == 0)
+        {
+            options.disassemble = 1;
+        }
+        else if (strcmp(argv[i], "--arena-stats") == 0)
+        {
+            options.arena_stats = 1;
+        }
+        else if (strcmp(argv[i], "--resolver-stats") == 0)
+        {
+            options.resolver_stats = 1;
+        }
+        else if (strcmp(argv[i], "--gc-stats") == 0)
+        {
+            options.gc_stats = 1;
+        }
+        else if (strcmp(argv[i], "--bench-lexer") == 0)
+        {
+            options.bench_lexer = 1;
+        }
+        else if (strcmp(argv[i], "--stream") == 0)
+        {
+            options.stream = 1;
+        }
+        else if (strcmp(argv[i], "--no-optimize") == 0)
+        {
+            options.optimize = 0;
+        }
+        else if (strcmp(argv[i], "--dump-optimized-ast") == 0)
+        {
+            options.dump_optimized_ast = 1;
+        }
+        else if (strcmp(argv[i], "--jit") == 0)
+        {
+            options.jit = 1;
+        }
+        else if (strcmp(argv[i], "--emit-asm") == 0)
+        {
+            options.emit_asm = 1;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            options.output_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "--dump-ir") == 0)
+        {
+            options.dump_ir = 1;
+        }
+        else if (strcmp(argv[i], "--time-passes") == 0)
+        {
+            options.time_passes = 1;
+        }
+        else if (argv[i][0] != '-' && options.file_name == NULL)
+        {
+            options.file_name = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "Invalid arguments.\n");
+            print_usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Native code and the SSA graph are built for a whole file at once.
+    int whole_program = options.emit_asm || options.output_name || options.dump_ir || options.time_passes || options.engine == ENGINE_IR;
+    if (whole_program && (options.file_name == NULL || options.stream))
     {
         fprintf(stderr, "Invalid arguments.\n");
-        fprintf(stderr, "Correct use: mccp [filename]\n");
+        print_usage();
         exit(EXIT_FAILURE);
     }
 
-    if (argc == 2)
+    return options;
+}
+
+// Lexes and parses a program. The parser pulls tokens from the lexer one at
+// a time; identifiers and string literals are interned in interns.
+ParserState *parse_program(Options *options, char *program, InternTable *interns)
+{
+    LexerState *lexer_state = create_lexer_state(program, interns);
+
+    // // Debug: Print Token list (this consumes the tokens)
+    // printf("Token list:\n");
+    // print_list(lexer_state);
+
+    ParserState *parser_state = create_parser_state(program, lexer_state);
+    parser(parser_state);
+
+    // // Debug: Print AST
+    // printf("Parsed expression list:\n");
+    // print_ast(parser_state->node);
+
+    if (options->arena_stats)
+    {
+        fprintf(stderr, "Tokens   %10zu bytes for %" PRId64 " tokens\n", sizeof(TokenBuffer), lexer_state->tokens.count);
+        print_arena_stats(parser_state->arena);
+    }
+    free_lexer_state(lexer_state);
+    parser_state->lexer = NULL;
+
+    return parser_state;
+}
+
+static double seconds_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Lexes the program over and over (for at least a second) and reports the
+// lexer throughput.
+void bench_lexer(char *program)
+{
+    size_t length = strlen(program);
+    size_t bytes = 0;
+    int64_t token_count = 0;
+    int iterations = 0;
+
+    double start = seconds_now();
+    double elapsed;
+    do
     {
-        const char *file_name = argv[1];
-        FILE *file = fopen(file_name, "r");
-        if (file == NULL)
+        InternTable *interns = create_intern_table();
+        LexerState *lexer_state = create_lexer_state(program, interns);
+        while (next_token(lexer_state).type != EOF_TOKEN)
         {
-            fprintf(stderr, "Failed to open file.\n");
-            exit(EXIT_FAILURE);
         }
+        token_count = lexer_state->tokens.count;
+        free_lexer_state(lexer_state);
+        free_intern_table(interns);
+
+        bytes += length;
+        iterations++;
+        elapsed = seconds_now() - start;
+    } while (elapsed < 1.0);
+
+    fprintf(stderr, "Lexed %zu bytes (%" PRId64 " tokens) %d times in %.3f s: %.1f MB/s\n",
+            length, token_count, iterations, elapsed, bytes / elapsed / 1e6);
+}
+
+// Runtime holds the passes and engines that outlive a single program, so a
+// REPL session or a streamed file keeps its variables. Values built at
+// runtime are allocated on heap. Each engine only uses its own state.
+typedef struct Runtime
+{
+    Heap *heap;
+    InternTable *interns;
+    Resolver *resolver;
+    Optimizer *optimizer;
+    Environment *env;
+    Compiler *compiler;
+    VM *vm;
+    ClosureEngine *closures;
 
-        fseek(file, 0, SEEK_END);
-        long file_size = ftell(file);
-        fseek(file, 0, SEEK_SET);
+    // Machine code of the loops compiled with --jit, shared by the engines.
+    Jit *jit;
+} Runtime;
 
-        char *program = (char *)malloc(file_size + 1);
-        if (program == NULL)
+Runtime create_runtime(Options *options)
+{
+    Runtime runtime;
+    runtime.heap = create_heap();
+    runtime.interns = create_intern_table();
+    runtime.resolver = create_resolver();
+    runtime.optimizer = create_optimizer(runtime.interns);
+    runtime.env = create_empty_environment(runtime.heap, NULL, 0);
+    heap_add_root(runtime.heap, mark_environment, runtime.env);
+    runtime.compiler = create_compiler();
+    runtime.vm = create_vm(runtime.heap);
+    runtime.closures = create_closure_engine(runtime.heap);
+
+    runtime.jit = options->jit ? create_jit() : NULL;
+    runtime.env->jit = runtime.jit;
+    runtime.compiler->jit = runtime.jit;
+    runtime.closures->jit = runtime.jit;
+    return runtime;
+}
+
+void free_runtime(Runtime *runtime)
+{
+    if (runtime->jit)
+    {
+        free_jit(runtime->jit);
+    }
+    free_closure_engine(runtime->closures);
+    free_vm(runtime->vm);
+    free_compiler(runtime->compiler);
+    free_optimizer(runtime->optimizer);
+    free_resolver(runtime->resolver);
+    free_intern_table(runtime->interns);
+    free_environment(runtime->env);
+    free_heap(runtime->heap);
+}
+
+// Resolves, optimizes and runs a parsed program with the selected engine.
+// The nodes of program are allocated in arena.
+int run(Options *options, ASTNode *program, Arena *arena, Runtime *runtime)
+{
+    if (resolve(runtime->resolver, program) == FAILURE)
+    {
+        return FAILURE;
+    }
+
+    if (options->optimize)
+    {
+        optimize(runtime->optimizer, program, arena);
+    }
+    if (options->dump_optimized_ast)
+    {
+        print_ast(program);
+        printf("\n");
+        if (options->file_name != NULL)
         {
-            fprintf(stderr, "Failed to allocate memory for program contents.\n");
-            exit(EXIT_FAILURE);
+            return SUCCESS;
         }
-        fread(program, 1, file_size, file);
-        program[file_size] = '\0';
-        fclose(file);
+    }
 
-        // // Debug: Print actual input
-        // printf("Program input:\n");
-        // printf("%s\n", program);
+    if (options->engine == ENGINE_IR || options->dump_ir || options->time_passes)
+    {
+        IrFunction *function = ir_build(program);
+        if (function == NULL)
+        {
+            return FAILURE;
+        }
+        ir_optimize(function, options->time_passes);
+        if (options->dump_ir)
+        {
+            ir_dump(function);
+        }
+
+        int status = SUCCESS;
+        if (options->engine == ENGINE_IR && !options->dump_ir)
+        {
+            status = ir_run(function, runtime->heap);
+        }
+        free_ir(function);
+        if (options->engine == ENGINE_IR || options->dump_ir)
+        {
+            return status;
+        }
+    }
 
-        LexerState *lexer_state = create_lexer_state(program);
-        Token *head = lexer(lexer_state);
+    if (options->emit_asm)
+    {
+        return codegen_emit(stdout, program);
+    }
+    if (options->output_name)
+    {
+        return codegen_build(program, options->output_name);
+    }
+
+    if (options->engine == ENGINE_TREE)
+    {
+        return interpret(runtime->env, program);
+    }
+    if (options->engine == ENGINE_CLOSURE)
+    {
+        return closure_run(runtime->closures, program);
+    }
 
-        // // Debug: Print Token list
-        // printf("Token list:\n");
-        // print_list(head, lexer_state->prog);
+    Chunk *chunk = compile(runtime->compiler, program);
+    if (chunk == NULL)
+    {
+        return FAILURE;
+    }
 
-        ParserState *parser_state = create_parser_state(program, head);
-        parser(parser_state);
+    int status = SUCCESS;
+    if (options->disassemble)
+    {
+        disassemble_chunk(chunk, "program");
+    }
+    if (!options->disassemble || options->file_name == NULL)
+    {
+        status = vm_run(runtime->vm, chunk);
+    }
 
-        // // Debug: Print AST
-        // printf("Parsed expression list:\n");
-        // print_ast(parser_state->node);
+    free_chunk(chunk);
+    return status;
+}
 
-        // Debug: Print Output and Status
-        // printf("Program Output:\n");
-        // int value =
-        interpret(NULL, parser_state->node);
-        // printf("Program status: %d\n", value);
+// Parses and runs one top-level statement at a time, releasing its tokens
+// and AST before the next one is parsed. Output starts right away and the
+// memory used by the parser does not grow with the program. Unlike run(),
+// errors in later statements are only found once the earlier ones ran.
+int run_stream(Options *options, char *program, Runtime *runtime)
+{
+    LexerState *lexer_state = create_lexer_state(program, runtime->interns);
+    ParserState *parser_state = create_parser_state(program, lexer_state);
 
-        free_parser_state(parser_state);
-        free_lexer_state(lexer_state);
+    int status = SUCCESS;
+    ASTNode *statement;
+    while (status == SUCCESS && (statement = parse_next_program(parser_state)) != NULL)
+    {
+        status = run(options, statement, parser_state->arena, runtime);
+    }
 
-        return 0;
+    if (options->arena_stats)
+    {
+        fprintf(stderr, "Tokens   %10zu bytes for %" PRId64 " tokens\n", sizeof(TokenBuffer), lexer_state->tokens.count);
+        print_arena_stats(parser_state->arena);
+    }
+    free_parser_state(parser_state);
+    free_lexer_state(lexer_state);
+
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options = parse_options(argc, argv);
+
+    if (options.file_name != NULL)
+    {
+        Source *source = open_source(options.file_name);
+        char *program = source->text;
+
+        if (options.bench_lexer)
+        {
+            bench_lexer(program);
+            close_source(source);
+            return 0;
+        }
+
+        // // Debug: Print actual input
+        // printf("Program input:\n");
+        // printf("%s\n", program);
+
+        Runtime runtime = create_runtime(&options);
+
+        int status;
+        if (options.stream)
+        {
+            status = run_stream(&options, program, &runtime);
+        }
+        else
+        {
+            ParserState *parser_state = parse_program(&options, program, runtime.interns);
+            status = run(&options, parser_state->node, parser_state->arena, &runtime);
+            free_parser_state(parser_state);
+        }
+
+        if (options.arena_stats)
+        {
+            print_intern_stats(runtime.interns);
+        }
+        if (options.resolver_stats)
+        {
+            print_resolver_stats(runtime.resolver);
+        }
+        if (options.gc_stats)
+        {
+            print_heap_stats(runtime.heap);
+        }
+        free_runtime(&runtime);
+        close_source(source);
+
+        return status == FAILURE ? EXIT_FAILURE : 0;
     }
 
     printf("-----------------REPL-----------------\n");
     printf("Write out statements to run.\n");
     printf("--------------------------------------\n");
 
-    Environment *env = create_empty_environment(NULL);
+    // Values outlive the line that created them, so the REPL keeps a single
+    // runtime while the tokens and AST of every line are released.
+    Runtime runtime = create_runtime(&options);
 
     do
     {
         printf("> ");
         char input_line[1024];
-        fgets(input_line, sizeof(input_line), stdin);
-        input_line[strlen(input_line) - 1] = '\0';
-
-        LexerState *lexer_state = create_lexer_state(input_line);
-        Token *head = lexer(lexer_state);
+        if (fgets(input_line, sizeof(input_line), stdin) == NULL)
+        {
+            printf("\n");
+            break;
+        }
+        input_line[strcspn(input_line, "\n")] = '\0';
 
-        ParserState *parser_state = create_parser_state(input_line, head);
-        parser(parser_state);
+        ParserState *parser_state = parse_program(&options, input_line, runtime.interns);
 
-        interpret(env, parser_state->node);
+        run(&options, parser_state->node, parser_state->arena, &runtime);
 
+        if (options.arena_stats)
+        {
+            print_intern_stats(runtime.interns);
+        }
+        if (options.resolver_stats)
+        {
+            print_resolver_stats(runtime.resolver);
+        }
+        if (options.gc_stats)
+        {
+            print_heap_stats(runtime.heap);
+        }
         free_parser_state(parser_state);
-        free_lexer_state(lexer_state);
     } while (1);
 
+    free_runtime(&runtime);
+
     return 0;
 }
\ No newline at end of file
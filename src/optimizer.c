@@ -0,0 +1,1482 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+
+#include "optimizer.h"
+#include "value.h"
+
+// Types of the values a variable can hold, joined over every store.
+// Non-negative values are a ValueType.
+#define TYPE_NONE -2
+#define TYPE_ANY -1
+
+static ConstantScope *create_constant_scope(ConstantScope *outer, int count)
+{
+    ConstantScope *scope = (ConstantScope *)malloc(sizeof(ConstantScope));
+    if (scope == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for ConstantScope.\n");
+        exit(EXIT_FAILURE);
+    }
+    scope->outer = outer;
+    scope->count = count;
+    scope->declarations = (ASTNode **)calloc(count > 0 ? count : 1, sizeof(ASTNode *));
+    if (scope->declarations == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for ConstantScope->declarations.\n");
+        exit(EXIT_FAILURE);
+    }
+    return scope;
+}
+
+static void push_scope(Optimizer *optimizer, int count)
+{
+    optimizer->current = create_constant_scope(optimizer->current, count);
+}
+
+static void pop_scope(Optimizer *optimizer)
+{
+    ConstantScope *scope = optimizer->current;
+    optimizer->current = scope->outer;
+    free(scope->declarations);
+    free(scope);
+}
+
+// Returns the declaration an identifier was bound to by resolve(), or NULL
+// if it was declared outside of the program being optimized (an earlier
+// REPL line) or conditionally.
+static ASTNode *find_declaration(Optimizer *optimizer, ASTNode *identifier)
+{
+    ConstantScope *scope = optimizer->current;
+    for (int depth = identifier->data.identifier.depth; depth > 0 && scope; depth--)
+    {
+        scope = scope->outer;
+    }
+    if (scope == NULL || identifier->data.identifier.slot >= scope->count)
+    {
+        return NULL;
+    }
+    return scope->declarations[identifier->data.identifier.slot];
+}
+
+static void record_declaration(Optimizer *optimizer, ASTNode *declaration)
+{
+    int slot = declaration->data.declaration.identifier->data.identifier.slot;
+    if (slot < optimizer->current->count)
+    {
+        optimizer->current->declarations[slot] = declaration;
+    }
+}
+
+static int is_literal(ASTNode *node)
+{
+    return node->type == NODE_INTEGER || node->type == NODE_STRING;
+}
+
+static Value literal_value(ASTNode *node)
+{
+    if (node->type == NODE_INTEGER)
+    {
+        return INT_VALUE(node->data.integer_value);
+    }
+    return STR_VALUE(node->data.string_value);
+}
+
+// Turns node into the literal holding value.
+static void make_literal(ASTNode *node, Value value)
+{
+    if (value.type == VAL_INT)
+    {
+        node->type = NODE_INTEGER;
+        node->data.integer_value = value.as.integer;
+    }
+    else
+    {
+        node->type = NODE_STRING;
+        node->data.string_value = value.as.string;
+    }
+}
+
+// Operations that fail at runtime are left alone, so the program still
+// reports the error when (and if) it reaches them.
+static int can_fold_binary_op(BinaryOp op, Value left, Value right)
+{
+    if (left.type != right.type)
+    {
+        return 0;
+    }
+    if (left.type == VAL_STR)
+    {
+        return op != SUBTRACT && op != MULTIPLY && op != DIVIDE;
+    }
+    if (op == DIVIDE)
+    {
+        return right.as.integer != 0 && !(left.as.integer == INT_MIN && right.as.integer == -1);
+    }
+    return 1;
+}
+
+// Folds a binary operation on two literals. Folded strings are interned like
+// the other string literals, the heap only holds strings built at runtime.
+static int fold_binary_op(Optimizer *optimizer, BinaryOp op, Value left, Value right, Value *result)
+{
+    if (op != ADD || left.type != VAL_STR)
+    {
+        // Nothing else allocates.
+        return value_binary_op(NULL, op, left, right, result);
+    }
+
+    size_t length = string_length(left.as.string) + string_length(right.as.string);
+    void *memory = malloc(string_size(length));
+    if (memory == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for a folded string.\n");
+        exit(EXIT_FAILURE);
+    }
+    char *str = string_concat(memory, left.as.string, right.as.string);
+    *result = STR_VALUE(intern(optimizer->interns, str, length));
+    free(memory);
+    return SUCCESS;
+}
+
+// Infers the type an expression will most likely have. Declared types are
+// not enforced, so this is only a guess that quickened handlers check.
+// Returns 0 if nothing is known.
+static int infer_type(Optimizer *optimizer, ASTNode *node, ValueType *type)
+{
+    switch (node->type)
+    {
+    case NODE_INTEGER:
+        *type = VAL_INT;
+        return 1;
+    case NODE_STRING:
+        *type = VAL_STR;
+        return 1;
+    case NODE_IDENTIFIER:
+    {
+        ASTNode *declaration = find_declaration(optimizer, node);
+        if (declaration == NULL)
+        {
+            return 0;
+        }
+        char *type_name = declaration->data.declaration.type->data.type.identifier->data.identifier.value;
+        if (strcmp(type_name, "int") == 0)
+        {
+            *type = VAL_INT;
+            return 1;
+        }
+        if (strcmp(type_name, "str") == 0)
+        {
+            *type = VAL_STR;
+            return 1;
+        }
+        return 0;
+    }
+    case NODE_BINARY_OP:
+        switch (node->data.binary_op.handler)
+        {
+        case HANDLER_UNQUICKENED:
+        case HANDLER_GENERIC:
+            return 0;
+        case HANDLER_STR_ADD:
+            *type = VAL_STR;
+            return 1;
+        default:
+            *type = VAL_INT;
+            return 1;
+        }
+    case NODE_UNARY_OP:
+        *type = VAL_INT;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void fold_expression(Optimizer *optimizer, ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_IDENTIFIER:
+    {
+        ASTNode *declaration = find_declaration(optimizer, node);
+        if (declaration == NULL || declaration->data.declaration.is_reassigned)
+        {
+            break;
+        }
+
+        ASTNode *right = declaration->data.declaration.right;
+        if (right == NULL)
+        {
+            // Uninitialized variables hold -1.
+            make_literal(node, INT_VALUE(-1));
+        }
+        else if (is_literal(right))
+        {
+            make_literal(node, literal_value(right));
+        }
+        break;
+    }
+    case NODE_BINARY_OP:
+    {
+        ASTNode *left = node->data.binary_op.left;
+        ASTNode *right = node->data.binary_op.right;
+        fold_expression(optimizer, left);
+        fold_expression(optimizer, right);
+        if (!is_literal(left) || !is_literal(right))
+        {
+            // Quicken the operation ahead of time when the operand types are known.
+            ValueType left_type, right_type;
+            if (infer_type(optimizer, left, &left_type) && infer_type(optimizer, right, &right_type))
+            {
+                node->data.binary_op.handler = binary_handler_for(node->data.binary_op.op, left_type, right_type);
+            }
+            break;
+        }
+
+        BinaryOp op = node->data.binary_op.op;
+        Value result;
+        if (can_fold_binary_op(op, literal_value(left), literal_value(right)) &&
+            fold_binary_op(optimizer, op, literal_value(left), literal_value(right), &result) == SUCCESS)
+        {
+            make_literal(node, result);
+        }
+        break;
+    }
+    case NODE_UNARY_OP:
+    {
+        ASTNode *right = node->data.unary_op.right;
+        fold_expression(optimizer, right);
+
+        Value result;
+        if (right->type == NODE_INTEGER &&
+            value_unary_op(node->data.unary_op.op, literal_value(right), &result) == SUCCESS)
+        {
+            make_literal(node, result);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Marks every declaration of the program that is the target of an
+// assignment. Only those that are not can be propagated.
+static void mark_assignments(Optimizer *optimizer, ASTNode *node, int conditional)
+{
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+    {
+        ASTNode *declaration = node->data.statement.data.declaration;
+        declaration->data.declaration.is_reassigned = 0;
+        declaration->data.declaration.value_type = TYPE_NONE;
+
+        // A declaration that is the body of an if or while may not run,
+        // its variable is never treated as a constant.
+        if (!conditional)
+        {
+            record_declaration(optimizer, declaration);
+        }
+        break;
+    }
+    case ASSIGNMENT:
+    {
+        ASTNode *declaration = find_declaration(optimizer, node->data.statement.data.assignment->data.assignment.identifier);
+        if (declaration)
+        {
+            declaration->data.declaration.is_reassigned = 1;
+        }
+        break;
+    }
+    case BLOCK_STATEMENT:
+        push_scope(optimizer, node->data.statement.slot_count);
+        for (ASTNode *dummy = node->data.statement.data.head; dummy; dummy = dummy->next)
+        {
+            mark_assignments(optimizer, dummy, 0);
+        }
+        pop_scope(optimizer);
+        break;
+    case WHILE_STATEMENT:
+    case IF_STATEMENT:
+        for (ASTNode *body = node->data.statement.data.expression->next; body; body = body->next)
+        {
+            mark_assignments(optimizer, body, 1);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void fold_statement(Optimizer *optimizer, ASTNode *node, int conditional)
+{
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+    {
+        ASTNode *declaration = node->data.statement.data.declaration;
+        if (declaration->data.declaration.right)
+        {
+            fold_expression(optimizer, declaration->data.declaration.right);
+        }
+        if (!conditional)
+        {
+            record_declaration(optimizer, declaration);
+        }
+        break;
+    }
+    case ASSIGNMENT:
+        fold_expression(optimizer, node->data.statement.data.assignment->data.assignment.right);
+        break;
+    case BLOCK_STATEMENT:
+        push_scope(optimizer, node->data.statement.slot_count);
+        for (ASTNode *dummy = node->data.statement.data.head; dummy; dummy = dummy->next)
+        {
+            fold_statement(optimizer, dummy, 0);
+        }
+        pop_scope(optimizer);
+        break;
+    case WHILE_STATEMENT:
+    {
+        ASTNode *condition = node->data.statement.data.expression;
+        fold_expression(optimizer, condition);
+        fold_statement(optimizer, condition->next, 1);
+        break;
+    }
+    case IF_STATEMENT:
+    {
+        ASTNode *condition = node->data.statement.data.expression;
+        ASTNode *body = condition->next;
+        ASTNode *else_body = body->next;
+        fold_expression(optimizer, condition);
+        fold_statement(optimizer, body, 1);
+        if (else_body)
+        {
+            fold_statement(optimizer, else_body, 1);
+        }
+
+        if (!is_literal(condition))
+        {
+            break;
+        }
+
+        // Replace the if statement by the branch that is always taken. A
+        // declaration in the other one still makes its variable read -1,
+        // see conditional_declaration(), so such an if is kept.
+        ASTNode *next = node->next;
+        ASTNode *taken = value_is_truthy(literal_value(condition)) ? body : else_body;
+        ASTNode *skipped = taken == body ? else_body : body;
+        if (skipped && (skipped->data.statement.type == DECLARATION || conditional_declaration(skipped, 0)))
+        {
+            break;
+        }
+        if (taken)
+        {
+            *node = *taken;
+        }
+        else
+        {
+            node->data.statement.type = BLOCK_STATEMENT;
+            node->data.statement.data.head = NULL;
+            node->data.statement.slot_count = 0;
+        }
+        node->next = next;
+        break;
+    }
+    case PRINT_STATEMENT:
+        fold_expression(optimizer, node->data.statement.data.expression);
+        break;
+    default:
+        break;
+    }
+}
+
+static int join_types(int left, int right)
+{
+    if (left == TYPE_NONE)
+    {
+        return right;
+    }
+    if (right == TYPE_NONE || left == right)
+    {
+        return left;
+    }
+    return TYPE_ANY;
+}
+
+// Returns the type of an expression given the types inferred so far.
+// Unlike infer_type(), this does not trust declared types: a variable only
+// has a type once every value stored in it was found to have that type.
+static int expression_type(Optimizer *optimizer, ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_INTEGER:
+        return VAL_INT;
+    case NODE_STRING:
+        return VAL_STR;
+    case NODE_IDENTIFIER:
+    {
+        ASTNode *declaration = find_declaration(optimizer, node);
+        return declaration ? declaration->data.declaration.value_type : TYPE_ANY;
+    }
+    case NODE_BINARY_OP:
+    {
+        int left = expression_type(optimizer, node->data.binary_op.left);
+        int right = expression_type(optimizer, node->data.binary_op.right);
+        if (left == TYPE_NONE || right == TYPE_NONE)
+        {
+            return TYPE_NONE;
+        }
+        if (left != right || left == TYPE_ANY)
+        {
+            return TYPE_ANY;
+        }
+        if (left == VAL_STR)
+        {
+            BinaryOp op = node->data.binary_op.op;
+            if (op == SUBTRACT || op == MULTIPLY || op == DIVIDE)
+            {
+                return TYPE_ANY;
+            }
+            return op == ADD ? VAL_STR : VAL_INT;
+        }
+        return VAL_INT;
+    }
+    case NODE_UNARY_OP:
+    {
+        int right = expression_type(optimizer, node->data.unary_op.right);
+        return right == VAL_INT || right == TYPE_NONE ? right : TYPE_ANY;
+    }
+    default:
+        return TYPE_ANY;
+    }
+}
+
+static void store_type(ASTNode *declaration, int type, int *changed)
+{
+    int joined = join_types(declaration->data.declaration.value_type, type);
+    if (joined != declaration->data.declaration.value_type)
+    {
+        declaration->data.declaration.value_type = joined;
+        *changed = 1;
+    }
+}
+
+// Joins the type of every value stored by node into its variable.
+static void infer_variable_types(Optimizer *optimizer, ASTNode *node, int conditional, int *changed)
+{
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+    {
+        ASTNode *declaration = node->data.statement.data.declaration;
+        if (!conditional)
+        {
+            // Uninitialized variables hold -1.
+            ASTNode *right = declaration->data.declaration.right;
+            store_type(declaration, right ? expression_type(optimizer, right) : VAL_INT, changed);
+            record_declaration(optimizer, declaration);
+        }
+        break;
+    }
+    case ASSIGNMENT:
+    {
+        ASTNode *assignment = node->data.statement.data.assignment;
+        ASTNode *declaration = find_declaration(optimizer, assignment->data.assignment.identifier);
+        if (declaration)
+        {
+            store_type(declaration, expression_type(optimizer, assignment->data.assignment.right), changed);
+        }
+        break;
+    }
+    case BLOCK_STATEMENT:
+        push_scope(optimizer, node->data.statement.slot_count);
+        for (ASTNode *dummy = node->data.statement.data.head; dummy; dummy = dummy->next)
+        {
+            infer_variable_types(optimizer, dummy, 0, changed);
+        }
+        pop_scope(optimizer);
+        break;
+    case WHILE_STATEMENT:
+    case IF_STATEMENT:
+        for (ASTNode *body = node->data.statement.data.expression->next; body; body = body->next)
+        {
+            infer_variable_types(optimizer, body, 1, changed);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Collects the declarations of the variables a loop body assigns or
+// declares. Returns 0 if the body declares a variable outside of a block,
+// in the scope the loop runs in.
+static int collect_assigned(Optimizer *optimizer, ASTNode *node, int nesting)
+{
+    ASTNode *declaration = NULL;
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+        if (nesting == 0)
+        {
+            return 0;
+        }
+        declaration = node->data.statement.data.declaration;
+        record_declaration(optimizer, declaration);
+        break;
+    case ASSIGNMENT:
+        declaration = find_declaration(optimizer, node->data.statement.data.assignment->data.assignment.identifier);
+        break;
+    case BLOCK_STATEMENT:
+    {
+        int result = 1;
+        push_scope(optimizer, node->data.statement.slot_count);
+        for (ASTNode *dummy = node->data.statement.data.head; dummy && result; dummy = dummy->next)
+        {
+            result = collect_assigned(optimizer, dummy, nesting + 1);
+        }
+        pop_scope(optimizer);
+        return result;
+    }
+    case WHILE_STATEMENT:
+    case IF_STATEMENT:
+        for (ASTNode *body = node->data.statement.data.expression->next; body; body = body->next)
+        {
+            if (!collect_assigned(optimizer, body, nesting))
+            {
+                return 0;
+            }
+        }
+        return 1;
+    default:
+        return 1;
+    }
+
+    if (declaration == NULL)
+    {
+        return 1;
+    }
+    if (optimizer->assigned_count == optimizer->assigned_capacity)
+    {
+        optimizer->assigned_capacity = optimizer->assigned_capacity ? optimizer->assigned_capacity * 2 : 16;
+        optimizer->assigned = (ASTNode **)realloc(optimizer->assigned, optimizer->assigned_capacity * sizeof(ASTNode *));
+        if (optimizer->assigned == NULL)
+        {
+            fprintf(stderr, "Failed to allocate memory for Optimizer->assigned.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    optimizer->assigned[optimizer->assigned_count++] = declaration;
+    return 1;
+}
+
+// Whether an expression has the same value every time the current loop
+// evaluates it: it only reads variables declared outside of the loop
+// (nesting blocks out) that the loop does not assign.
+static int is_invariant(Optimizer *optimizer, ASTNode *node, int nesting)
+{
+    switch (node->type)
+    {
+    case NODE_INTEGER:
+    case NODE_STRING:
+        return 1;
+    case NODE_IDENTIFIER:
+    {
+        if (node->data.identifier.depth < nesting)
+        {
+            return 0;
+        }
+        ASTNode *declaration = find_declaration(optimizer, node);
+        if (declaration == NULL)
+        {
+            return 0;
+        }
+        for (int i = 0; i < optimizer->assigned_count; i++)
+        {
+            if (optimizer->assigned[i] == declaration)
+            {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    case NODE_BINARY_OP:
+        return is_invariant(optimizer, node->data.binary_op.left, nesting) &&
+               is_invariant(optimizer, node->data.binary_op.right, nesting);
+    case NODE_UNARY_OP:
+        return is_invariant(optimizer, node->data.unary_op.right, nesting);
+    default:
+        return 0;
+    }
+}
+
+// Whether evaluating an expression can report an error. Only expressions
+// that cannot are hoisted: the loop may not run, or may fail or print
+// something before it reaches them.
+static int can_fail(Optimizer *optimizer, ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_BINARY_OP:
+    {
+        ASTNode *left = node->data.binary_op.left;
+        ASTNode *right = node->data.binary_op.right;
+        if (can_fail(optimizer, left) || can_fail(optimizer, right))
+        {
+            return 1;
+        }
+        int left_type = expression_type(optimizer, left);
+        if (left_type < 0 || left_type != expression_type(optimizer, right))
+        {
+            return 1;
+        }
+        BinaryOp op = node->data.binary_op.op;
+        if (left_type == VAL_STR)
+        {
+            return op == SUBTRACT || op == MULTIPLY || op == DIVIDE;
+        }
+        if (op == DIVIDE)
+        {
+            return right->type != NODE_INTEGER || right->data.integer_value == 0 || right->data.integer_value == -1;
+        }
+        return 0;
+    }
+    case NODE_UNARY_OP:
+        return can_fail(optimizer, node->data.unary_op.right) ||
+               expression_type(optimizer, node->data.unary_op.right) != VAL_INT;
+    default:
+        return 0;
+    }
+}
+
+static void add_hoisted(Optimizer *optimizer, ASTNode *node, int nesting)
+{
+    if (optimizer->hoisted_count == optimizer->hoisted_capacity)
+    {
+        optimizer->hoisted_capacity = optimizer->hoisted_capacity ? optimizer->hoisted_capacity * 2 : 16;
+        optimizer->hoisted = (ASTNode **)realloc(optimizer->hoisted, optimizer->hoisted_capacity * sizeof(ASTNode *));
+        optimizer->hoisted_nesting = (int *)realloc(optimizer->hoisted_nesting, optimizer->hoisted_capacity * sizeof(int));
+        optimizer->hoisted_type = (int *)realloc(optimizer->hoisted_type, optimizer->hoisted_capacity * sizeof(int));
+        if (optimizer->hoisted == NULL || optimizer->hoisted_nesting == NULL || optimizer->hoisted_type == NULL)
+        {
+            fprintf(stderr, "Failed to allocate memory for Optimizer->hoisted.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    optimizer->hoisted[optimizer->hoisted_count] = node;
+    optimizer->hoisted_nesting[optimizer->hoisted_count] = nesting;
+    optimizer->hoisted_type[optimizer->hoisted_count] = expression_type(optimizer, node);
+    optimizer->hoisted_count++;
+}
+
+// Collects the largest operations of an expression that can be hoisted.
+// Identifiers and literals are left alone, reading them is as cheap as
+// reading a hoisted value.
+static void find_hoistable_expressions(Optimizer *optimizer, ASTNode *node, int nesting)
+{
+    switch (node->type)
+    {
+    case NODE_BINARY_OP:
+        if (is_invariant(optimizer, node, nesting) && !can_fail(optimizer, node))
+        {
+            add_hoisted(optimizer, node, nesting);
+            break;
+        }
+        find_hoistable_expressions(optimizer, node->data.binary_op.left, nesting);
+        find_hoistable_expressions(optimizer, node->data.binary_op.right, nesting);
+        break;
+    case NODE_UNARY_OP:
+        if (is_invariant(optimizer, node, nesting) && !can_fail(optimizer, node))
+        {
+            add_hoisted(optimizer, node, nesting);
+            break;
+        }
+        find_hoistable_expressions(optimizer, node->data.unary_op.right, nesting);
+        break;
+    default:
+        break;
+    }
+}
+
+static void find_hoistable_statements(Optimizer *optimizer, ASTNode *node, int nesting)
+{
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+    {
+        ASTNode *declaration = node->data.statement.data.declaration;
+        if (declaration->data.declaration.right)
+        {
+            find_hoistable_expressions(optimizer, declaration->data.declaration.right, nesting);
+        }
+        record_declaration(optimizer, declaration);
+        break;
+    }
+    case ASSIGNMENT:
+        find_hoistable_expressions(optimizer, node->data.statement.data.assignment->data.assignment.right, nesting);
+        break;
+    case BLOCK_STATEMENT:
+        push_scope(optimizer, node->data.statement.slot_count);
+        for (ASTNode *dummy = node->data.statement.data.head; dummy; dummy = dummy->next)
+        {
+            find_hoistable_statements(optimizer, dummy, nesting + 1);
+        }
+        pop_scope(optimizer);
+        break;
+    case WHILE_STATEMENT:
+    case IF_STATEMENT:
+    {
+        ASTNode *condition = node->data.statement.data.expression;
+        find_hoistable_expressions(optimizer, condition, nesting);
+        for (ASTNode *body = condition->next; body; body = body->next)
+        {
+            find_hoistable_statements(optimizer, body, nesting);
+        }
+        break;
+    }
+    case PRINT_STATEMENT:
+        find_hoistable_expressions(optimizer, node->data.statement.data.expression, nesting);
+        break;
+    default:
+        break;
+    }
+}
+
+// Adds amount to the depth of every identifier of an expression that
+// refers to a variable declared more than nesting blocks out.
+static void shift_expression_depths(ASTNode *node, int nesting, int amount)
+{
+    switch (node->type)
+    {
+    case NODE_IDENTIFIER:
+        if (node->data.identifier.depth >= nesting)
+        {
+            node->data.identifier.depth += amount;
+        }
+        break;
+    case NODE_BINARY_OP:
+        shift_expression_depths(node->data.binary_op.left, nesting, amount);
+        shift_expression_depths(node->data.binary_op.right, nesting, amount);
+        break;
+    case NODE_UNARY_OP:
+        shift_expression_depths(node->data.unary_op.right, nesting, amount);
+        break;
+    default:
+        break;
+    }
+}
+
+static void shift_statement_depths(ASTNode *node, int nesting)
+{
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+    {
+        ASTNode *declaration = node->data.statement.data.declaration;
+        if (declaration->data.declaration.right)
+        {
+            shift_expression_depths(declaration->data.declaration.right, nesting, 1);
+        }
+        break;
+    }
+    case ASSIGNMENT:
+    {
+        ASTNode *assignment = node->data.statement.data.assignment;
+        shift_expression_depths(assignment->data.assignment.right, nesting, 1);
+        shift_expression_depths(assignment->data.assignment.identifier, nesting, 1);
+        break;
+    }
+    case BLOCK_STATEMENT:
+        for (ASTNode *dummy = node->data.statement.data.head; dummy; dummy = dummy->next)
+        {
+            shift_statement_depths(dummy, nesting + 1);
+        }
+        break;
+    case WHILE_STATEMENT:
+    case IF_STATEMENT:
+    {
+        ASTNode *condition = node->data.statement.data.expression;
+        shift_expression_depths(condition, nesting, 1);
+        for (ASTNode *body = condition->next; body; body = body->next)
+        {
+            shift_statement_depths(body, nesting);
+        }
+        break;
+    }
+    case PRINT_STATEMENT:
+        shift_expression_depths(node->data.statement.data.expression, nesting, 1);
+        break;
+    default:
+        break;
+    }
+}
+
+static ASTNode *create_node(Optimizer *optimizer, NodeType type)
+{
+    ASTNode *node = create_empty_ast_node(optimizer->arena);
+    node->type = type;
+    node->next = NULL;
+    return node;
+}
+
+static ASTNode *create_identifier(Optimizer *optimizer, char *name, int depth, int slot)
+{
+    ASTNode *node = create_node(optimizer, NODE_IDENTIFIER);
+    node->data.identifier.value = name;
+    node->data.identifier.hash = string_hash(name);
+    node->data.identifier.depth = depth;
+    node->data.identifier.slot = slot;
+    return node;
+}
+
+// Declares a variable in slot holding the value of expression, of type.
+static ASTNode *create_temporary(Optimizer *optimizer, ASTNode *expression, int type, int slot, char *name)
+{
+    const char *type_string = value_type_to_string(type);
+    char *type_name = intern(optimizer->interns, type_string, strlen(type_string));
+
+    ASTNode *declaration = create_node(optimizer, NODE_DECLARATION);
+    declaration->data.declaration.type = create_node(optimizer, NODE_TYPE);
+    declaration->data.declaration.type->data.type.identifier =
+        create_identifier(optimizer, type_name, 0, 0);
+    declaration->data.declaration.identifier = create_identifier(optimizer, name, 0, slot);
+    declaration->data.declaration.right = expression;
+    declaration->data.declaration.is_reassigned = 0;
+    declaration->data.declaration.value_type = type;
+
+    ASTNode *statement = create_node(optimizer, NODE_STATEMENT);
+    statement->data.statement.type = DECLARATION;
+    statement->data.statement.data.declaration = declaration;
+    statement->data.statement.jit_loop = NULL;
+    return statement;
+}
+
+static char *create_temporary_name(Optimizer *optimizer, const char *prefix)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%s%d", prefix, optimizer->temporary_count++);
+    return intern(optimizer->interns, buffer, strlen(buffer));
+}
+
+// Hoists the invariant expressions of a while loop. The loop is replaced
+// by a block that declares one variable per expression, then runs the
+// loop reading those variables instead. Returns whether anything moved.
+static int hoist_loop(Optimizer *optimizer, ASTNode *node)
+{
+    ASTNode *condition = node->data.statement.data.expression;
+    ASTNode *body = condition->next;
+
+    optimizer->assigned_count = 0;
+    if (!collect_assigned(optimizer, body, 0))
+    {
+        return 0;
+    }
+    optimizer->hoisted_count = 0;
+    find_hoistable_expressions(optimizer, condition, 0);
+    find_hoistable_statements(optimizer, body, 0);
+    if (optimizer->hoisted_count == 0)
+    {
+        return 0;
+    }
+
+    // The loop moves one block further from the variables it uses.
+    ASTNode *loop = create_node(optimizer, NODE_STATEMENT);
+    *loop = *node;
+    loop->next = NULL;
+    shift_expression_depths(condition, 0, 1);
+    shift_statement_depths(body, 0);
+
+    ASTNode *dummy_head = create_node(optimizer, NODE_STATEMENT);
+    ASTNode *dummy_tail = dummy_head;
+    for (int i = 0; i < optimizer->hoisted_count; i++)
+    {
+        ASTNode *expression = optimizer->hoisted[i];
+        int nesting = optimizer->hoisted_nesting[i];
+        char *name = create_temporary_name(optimizer, "$hoisted");
+
+        // The expression is now evaluated in the new block instead of
+        // nesting blocks inside the loop. It keeps its place in the tree
+        // (its next pointer may be the loop body), turned into a read of
+        // the variable.
+        ASTNode *moved = create_node(optimizer, NODE_BINARY_OP);
+        *moved = *expression;
+        moved->next = NULL;
+        shift_expression_depths(moved, 0, -nesting);
+
+        dummy_tail->next = create_temporary(optimizer, moved, optimizer->hoisted_type[i], i, name);
+        dummy_tail = dummy_tail->next;
+
+        expression->type = NODE_IDENTIFIER;
+        expression->data.identifier.value = name;
+        expression->data.identifier.hash = string_hash(name);
+        expression->data.identifier.depth = nesting;
+        expression->data.identifier.slot = i;
+    }
+    dummy_tail->next = loop;
+
+    node->data.statement.type = BLOCK_STATEMENT;
+    node->data.statement.data.head = dummy_head->next;
+    node->data.statement.slot_count = optimizer->hoisted_count;
+    node->data.statement.jit_loop = NULL;
+    return 1;
+}
+
+// The most assignments a loop evaluated in closed form can have.
+#define EVOLUTION_MAX 16
+
+// How a variable changes in a loop whose body only adds to variables.
+// A linear variable adds (or subtracts) the invariant step every
+// iteration; an accumulator adds the current value of a linear variable,
+// source. target is the variable as the assignment names it, nesting
+// blocks inside the loop.
+typedef struct Evolution
+{
+    ASTNode *declaration;
+    ASTNode *target;
+    int nesting;
+    BinaryOp op;
+    ASTNode *step;
+    ASTNode *source_declaration;
+    int source;
+} Evolution;
+
+// Copies an expression, adding amount to the depth of every identifier.
+static ASTNode *copy_expression(Optimizer *optimizer, ASTNode *node, int amount)
+{
+    ASTNode *copy = create_node(optimizer, node->type);
+    *copy = *node;
+    copy->next = NULL;
+    switch (node->type)
+    {
+    case NODE_IDENTIFIER:
+        copy->data.identifier.depth += amount;
+        break;
+    case NODE_BINARY_OP:
+        copy->data.binary_op.left = copy_expression(optimizer, node->data.binary_op.left, amount);
+        copy->data.binary_op.right = copy_expression(optimizer, node->data.binary_op.right, amount);
+        break;
+    case NODE_UNARY_OP:
+        copy->data.unary_op.right = copy_expression(optimizer, node->data.unary_op.right, amount);
+        break;
+    default:
+        break;
+    }
+    return copy;
+}
+
+static ASTNode *create_int_operation(Optimizer *optimizer, BinaryOp op, ASTNode *left, ASTNode *right)
+{
+    ASTNode *node = create_node(optimizer, NODE_BINARY_OP);
+    node->data.binary_op.op = op;
+    node->data.binary_op.left = left;
+    node->data.binary_op.right = right;
+    node->data.binary_op.handler = binary_handler_for(op, VAL_INT, VAL_INT);
+    return node;
+}
+
+static ASTNode *create_integer(Optimizer *optimizer, int value)
+{
+    ASTNode *node = create_node(optimizer, NODE_INTEGER);
+    node->data.integer_value = value;
+    return node;
+}
+
+static int is_integer(ASTNode *node, int value)
+{
+    return node->type == NODE_INTEGER && node->data.integer_value == value;
+}
+
+// Multiplies by a step, which is usually 1.
+static ASTNode *create_product(Optimizer *optimizer, ASTNode *step, ASTNode *right)
+{
+    return is_integer(step, 1) ? right : create_int_operation(optimizer, MULTIPLY, step, right);
+}
+
+// Whether two identifiers used in the same scope name the same variable.
+static int is_same_variable(ASTNode *left, ASTNode *right)
+{
+    return left->type == NODE_IDENTIFIER && right->type == NODE_IDENTIFIER &&
+           left->data.identifier.depth == right->data.identifier.depth &&
+           left->data.identifier.slot == right->data.identifier.slot;
+}
+
+// Matches an assignment `v = v + x`, `v = x + v` or `v = v - x` to an int
+// variable, where x is invariant or names another variable.
+static int match_evolution(Optimizer *optimizer, ASTNode *assignment, int nesting, Evolution *evolution)
+{
+    ASTNode *target = assignment->data.assignment.identifier;
+    ASTNode *right = assignment->data.assignment.right;
+    ASTNode *declaration = find_declaration(optimizer, target);
+    if (declaration == NULL || declaration->data.declaration.value_type != VAL_INT || right->type != NODE_BINARY_OP)
+    {
+        return 0;
+    }
+
+    BinaryOp op = right->data.binary_op.op;
+    ASTNode *self = right->data.binary_op.left;
+    ASTNode *other = right->data.binary_op.right;
+    if (op == ADD && !is_same_variable(self, target))
+    {
+        self = right->data.binary_op.right;
+        other = right->data.binary_op.left;
+    }
+    if ((op != ADD && op != SUBTRACT) || !is_same_variable(self, target))
+    {
+        return 0;
+    }
+
+    evolution->declaration = declaration;
+    evolution->target = target;
+    evolution->nesting = nesting;
+    evolution->op = op;
+    evolution->step = NULL;
+    evolution->source_declaration = NULL;
+    evolution->source = -1;
+    if (is_invariant(optimizer, other, nesting) && !can_fail(optimizer, other) &&
+        expression_type(optimizer, other) == VAL_INT)
+    {
+        evolution->step = other;
+        return 1;
+    }
+    if (other->type == NODE_IDENTIFIER)
+    {
+        evolution->source_declaration = find_declaration(optimizer, other);
+        return evolution->source_declaration != NULL;
+    }
+    return 0;
+}
+
+static int find_evolution(Evolution *evolutions, int count, ASTNode *declaration)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (evolutions[i].declaration == declaration)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns the evolution of the variable an expression reads, if it is
+// just an identifier.
+static Evolution *find_counter(Optimizer *optimizer, Evolution *evolutions, int count, ASTNode *node)
+{
+    if (node->type != NODE_IDENTIFIER)
+    {
+        return NULL;
+    }
+    int index = find_evolution(evolutions, count, find_declaration(optimizer, node));
+    return index == -1 ? NULL : &evolutions[index];
+}
+
+// Returns by how much a linear variable changes every iteration if that
+// is 1 or -1, and 0 otherwise.
+static int unit_step(Evolution *evolution)
+{
+    ASTNode *step = evolution->step;
+    if (step == NULL || step->type != NODE_INTEGER ||
+        (step->data.integer_value != 1 && step->data.integer_value != -1))
+    {
+        return 0;
+    }
+    return evolution->op == ADD ? step->data.integer_value : -step->data.integer_value;
+}
+
+// Builds the number of iterations of a loop whose condition compares the
+// linear variable counter to bound, as an expression evaluated one block
+// out of the loop. Returns NULL if the comparison is not supported.
+// The count is only used when it is positive: a loop that runs 2^31 times
+// or more (the counter wraps around, or never stops) is left to run.
+static ASTNode *build_trip_count(Optimizer *optimizer, Evolution *counter, BinaryOp compare, ASTNode *bound)
+{
+    int direction = unit_step(counter);
+    if (direction == 0)
+    {
+        return NULL;
+    }
+
+    // The last value of the counter must not wrap around.
+    int inclusive = compare == LESS_THAN_EQUAL || compare == GREATER_THAN_EQUAL;
+    if (inclusive && (bound->type != NODE_INTEGER ||
+                      bound->data.integer_value == (direction > 0 ? INT_MAX : INT_MIN)))
+    {
+        return NULL;
+    }
+
+    switch (compare)
+    {
+    case IS_LESS_THAN:
+    case LESS_THAN_EQUAL:
+        if (direction < 0)
+        {
+            return NULL;
+        }
+        break;
+    case IS_GREATER_THAN:
+    case GREATER_THAN_EQUAL:
+        if (direction > 0)
+        {
+            return NULL;
+        }
+        break;
+    case IS_NOT_EQUAL:
+        break;
+    default:
+        return NULL;
+    }
+
+    ASTNode *value = copy_expression(optimizer, counter->target, 1 - counter->nesting);
+    ASTNode *limit = copy_expression(optimizer, bound, 1);
+    ASTNode *trips = direction > 0 ? create_int_operation(optimizer, SUBTRACT, limit, value)
+                                   : create_int_operation(optimizer, SUBTRACT, value, limit);
+    if (direction < 0 && is_integer(limit, 0))
+    {
+        trips = value;
+    }
+    if (inclusive)
+    {
+        trips = create_int_operation(optimizer, ADD, trips, create_integer(optimizer, 1));
+    }
+    return trips;
+}
+
+static ASTNode *create_assignment_statement(Optimizer *optimizer, ASTNode *identifier, ASTNode *right)
+{
+    ASTNode *assignment = create_node(optimizer, NODE_ASSIGNMENT);
+    assignment->data.assignment.identifier = identifier;
+    assignment->data.assignment.right = right;
+
+    ASTNode *statement = create_node(optimizer, NODE_STATEMENT);
+    statement->data.statement.type = ASSIGNMENT;
+    statement->data.statement.data.assignment = assignment;
+    statement->data.statement.jit_loop = NULL;
+    return statement;
+}
+
+// Evaluates a loop that only adds to int variables in constant time.
+// With n the number of iterations, a linear variable v ends at
+// v + n * step, and an accumulator s of a linear variable v at
+// s + n * v + step * n * (n - 1) / 2 (plus n * step if v is updated
+// first). int arithmetic wraps around, so these are exact.
+//
+// The loop is replaced by a block that computes n, applies the closed
+// forms if n is positive and then runs the loop, whose condition is then
+// false. Returns whether the loop was rewritten.
+static int evolve_loop(Optimizer *optimizer, ASTNode *node)
+{
+    ASTNode *condition = node->data.statement.data.expression;
+    ASTNode *body = condition->next;
+
+    optimizer->assigned_count = 0;
+    if (!collect_assigned(optimizer, body, 0))
+    {
+        return 0;
+    }
+
+    // The body is a single assignment, or a block of them.
+    ASTNode *first = body;
+    int nesting = 0;
+    if (body->data.statement.type == BLOCK_STATEMENT)
+    {
+        if (body->data.statement.slot_count > 0)
+        {
+            return 0;
+        }
+        first = body->data.statement.data.head;
+        nesting = 1;
+    }
+
+    Evolution evolutions[EVOLUTION_MAX];
+    int count = 0;
+    int matched = 1;
+    push_scope(optimizer, 0);
+    for (ASTNode *statement = first; statement && matched; statement = nesting ? statement->next : NULL)
+    {
+        matched = statement->data.statement.type == ASSIGNMENT && count < EVOLUTION_MAX &&
+                  match_evolution(optimizer, statement->data.statement.data.assignment, nesting, &evolutions[count]) &&
+                  find_evolution(evolutions, count, evolutions[count].declaration) == -1;
+        count++;
+    }
+    pop_scope(optimizer);
+    if (!matched || first == NULL)
+    {
+        return 0;
+    }
+
+    // Accumulators must add a linear variable.
+    int has_accumulator = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (evolutions[i].source_declaration == NULL)
+        {
+            continue;
+        }
+        int source = find_evolution(evolutions, count, evolutions[i].source_declaration);
+        if (source == -1 || source == i || evolutions[source].step == NULL)
+        {
+            return 0;
+        }
+        evolutions[i].source = source;
+        has_accumulator = 1;
+    }
+
+    // The condition compares a linear variable to an invariant bound.
+    Evolution *counter = NULL;
+    BinaryOp compare = IS_NOT_EQUAL;
+    ASTNode *bound = NULL;
+    if (condition->type == NODE_IDENTIFIER)
+    {
+        counter = find_counter(optimizer, evolutions, count, condition);
+        bound = create_integer(optimizer, 0);
+    }
+    else if (condition->type == NODE_BINARY_OP && condition->data.binary_op.op >= IS_EQUAL)
+    {
+        static const BinaryOp flipped[] = {
+            [IS_EQUAL] = IS_EQUAL,
+            [IS_LESS_THAN] = IS_GREATER_THAN,
+            [LESS_THAN_EQUAL] = GREATER_THAN_EQUAL,
+            [IS_GREATER_THAN] = IS_LESS_THAN,
+            [GREATER_THAN_EQUAL] = LESS_THAN_EQUAL,
+            [IS_NOT_EQUAL] = IS_NOT_EQUAL,
+        };
+        compare = condition->data.binary_op.op;
+        bound = condition->data.binary_op.right;
+        counter = find_counter(optimizer, evolutions, count, condition->data.binary_op.left);
+        if (counter == NULL)
+        {
+            compare = flipped[compare];
+            bound = condition->data.binary_op.left;
+            counter = find_counter(optimizer, evolutions, count, condition->data.binary_op.right);
+        }
+        if (counter && (!is_invariant(optimizer, bound, 0) || can_fail(optimizer, bound) ||
+                        expression_type(optimizer, bound) != VAL_INT))
+        {
+            return 0;
+        }
+    }
+    if (counter == NULL || counter->step == NULL)
+    {
+        return 0;
+    }
+    ASTNode *trips_value = build_trip_count(optimizer, counter, compare, bound);
+    if (trips_value == NULL)
+    {
+        return 0;
+    }
+
+    // { int $trips = n; if $trips > 0 { int $half = ...; updates } loop }
+    // The updates run one block inside the if, two blocks out of the
+    // variables' scope compared to the loop itself.
+    char *trips_name = create_temporary_name(optimizer, "$trips");
+    ASTNode *trips_declaration = create_temporary(optimizer, trips_value, VAL_INT, 0, trips_name);
+
+    ASTNode *dummy_head = create_node(optimizer, NODE_STATEMENT);
+    ASTNode *dummy_tail = dummy_head;
+    char *half_name = NULL;
+    if (has_accumulator)
+    {
+        // n * (n - 1) / 2 without overflowing: n / 2 * (n - 1 + n % 2).
+        half_name = create_temporary_name(optimizer, "$half");
+        ASTNode *halved = create_int_operation(optimizer, DIVIDE, create_identifier(optimizer, trips_name, 1, 0), create_integer(optimizer, 2));
+        ASTNode *remainder = create_int_operation(optimizer, SUBTRACT, create_identifier(optimizer, trips_name, 1, 0),
+                                                  create_int_operation(optimizer, MULTIPLY, copy_expression(optimizer, halved, 0), create_integer(optimizer, 2)));
+        ASTNode *odd = create_int_operation(optimizer, ADD,
+                                            create_int_operation(optimizer, SUBTRACT, create_identifier(optimizer, trips_name, 1, 0), create_integer(optimizer, 1)),
+                                            remainder);
+        dummy_tail->next = create_temporary(optimizer, create_int_operation(optimizer, MULTIPLY, halved, odd), VAL_INT, 0, half_name);
+        dummy_tail = dummy_tail->next;
+    }
+
+    // Accumulators read the initial values of the linear variables, so
+    // they are updated first.
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            Evolution *evolution = &evolutions[i];
+            if ((evolution->source != -1) != (pass == 0))
+            {
+                continue;
+            }
+
+            int amount = 2 - evolution->nesting;
+            ASTNode *change;
+            if (evolution->source == -1)
+            {
+                change = create_product(optimizer, copy_expression(optimizer, evolution->step, amount),
+                                        create_identifier(optimizer, trips_name, 1, 0));
+            }
+            else
+            {
+                Evolution *source = &evolutions[evolution->source];
+                int source_amount = 2 - source->nesting;
+                change = create_int_operation(optimizer, MULTIPLY, create_identifier(optimizer, trips_name, 1, 0),
+                                              copy_expression(optimizer, source->target, source_amount));
+                change = create_int_operation(optimizer, source->op, change,
+                                              create_product(optimizer, copy_expression(optimizer, source->step, source_amount),
+                                                             create_identifier(optimizer, half_name, 0, 0)));
+                if (evolution->source < i)
+                {
+                    change = create_int_operation(optimizer, source->op, change,
+                                                  create_product(optimizer, copy_expression(optimizer, source->step, source_amount),
+                                                                 create_identifier(optimizer, trips_name, 1, 0)));
+                }
+            }
+            ASTNode *value = create_int_operation(optimizer, evolution->op, copy_expression(optimizer, evolution->target, amount), change);
+            dummy_tail->next = create_assignment_statement(optimizer, copy_expression(optimizer, evolution->target, amount), value);
+            dummy_tail = dummy_tail->next;
+        }
+    }
+
+    ASTNode *updates = create_node(optimizer, NODE_STATEMENT);
+    updates->data.statement.type = BLOCK_STATEMENT;
+    updates->data.statement.data.head = dummy_head->next;
+    updates->data.statement.slot_count = has_accumulator ? 1 : 0;
+    updates->data.statement.jit_loop = NULL;
+
+    ASTNode *guard = create_node(optimizer, NODE_STATEMENT);
+    guard->data.statement.type = IF_STATEMENT;
+    guard->data.statement.data.expression = create_int_operation(optimizer, IS_GREATER_THAN, create_identifier(optimizer, trips_name, 0, 0),
+                                                                 create_integer(optimizer, 0));
+    guard->data.statement.data.expression->next = updates;
+    guard->data.statement.jit_loop = NULL;
+
+    // The loop moves one block further from the variables it uses.
+    ASTNode *loop = create_node(optimizer, NODE_STATEMENT);
+    *loop = *node;
+    loop->next = NULL;
+    shift_expression_depths(condition, 0, 1);
+    shift_statement_depths(body, 0);
+
+    trips_declaration->next = guard;
+    guard->next = loop;
+    node->data.statement.type = BLOCK_STATEMENT;
+    node->data.statement.data.head = trips_declaration;
+    node->data.statement.slot_count = 1;
+    node->data.statement.jit_loop = NULL;
+    return 1;
+}
+
+// Hoists loop-invariant expressions out of every while loop, outer loops
+// first: what an inner loop hoists is then only what varies in the outer
+// one. Loops that only count are then evaluated in closed form.
+static void hoist_statement(Optimizer *optimizer, ASTNode *node, int conditional)
+{
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+        if (!conditional)
+        {
+            record_declaration(optimizer, node->data.statement.data.declaration);
+        }
+        break;
+    case BLOCK_STATEMENT:
+        push_scope(optimizer, node->data.statement.slot_count);
+        for (ASTNode *dummy = node->data.statement.data.head; dummy; dummy = dummy->next)
+        {
+            hoist_statement(optimizer, dummy, 0);
+        }
+        pop_scope(optimizer);
+        break;
+    case WHILE_STATEMENT:
+        if (hoist_loop(optimizer, node))
+        {
+            hoist_statement(optimizer, node, conditional);
+            break;
+        }
+        hoist_statement(optimizer, node->data.statement.data.expression->next, 1);
+        evolve_loop(optimizer, node);
+        break;
+    case IF_STATEMENT:
+        for (ASTNode *body = node->data.statement.data.expression->next; body; body = body->next)
+        {
+            hoist_statement(optimizer, body, 1);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Optimizes a program that went through resolve(), whose nodes are in arena.
+void optimize(Optimizer *optimizer, ASTNode *program, Arena *arena)
+{
+    optimizer->arena = arena;
+    optimizer->temporary_count = 0;
+
+    // The first node of a program is a dummy head.
+    ASTNode *head = program->data.program.head->next;
+
+    push_scope(optimizer, program->data.program.slot_count);
+    for (ASTNode *dummy = head; dummy && dummy->type == NODE_STATEMENT; dummy = dummy->next)
+    {
+        mark_assignments(optimizer, dummy, 0);
+    }
+    pop_scope(optimizer);
+
+    push_scope(optimizer, program->data.program.slot_count);
+    for (ASTNode *dummy = head; dummy && dummy->type == NODE_STATEMENT; dummy = dummy->next)
+    {
+        fold_statement(optimizer, dummy, 0);
+    }
+    pop_scope(optimizer);
+
+    // Loop-invariant code motion needs the types of the variables, which
+    // depend on each other: join them until they stop changing.
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+        push_scope(optimizer, program->data.program.slot_count);
+        for (ASTNode *dummy = head; dummy && dummy->type == NODE_STATEMENT; dummy = dummy->next)
+        {
+            infer_variable_types(optimizer, dummy, 0, &changed);
+        }
+        pop_scope(optimizer);
+    }
+
+    push_scope(optimizer, program->data.program.slot_count);
+    for (ASTNode *dummy = head; dummy && dummy->type == NODE_STATEMENT; dummy = dummy->next)
+    {
+        hoist_statement(optimizer, dummy, 0);
+    }
+    pop_scope(optimizer);
+}
+
+Optimizer *create_optimizer(InternTable *interns)
+{
+    Optimizer *optimizer = (Optimizer *)malloc(sizeof(Optimizer));
+    if (optimizer == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for Optimizer.\n");
+        exit(EXIT_FAILURE);
+    }
+    optimizer->current = NULL;
+    optimizer->arena = NULL;
+    optimizer->interns = interns;
+    optimizer->assigned = NULL;
+    optimizer->assigned_count = 0;
+    optimizer->assigned_capacity = 0;
+    optimizer->hoisted = NULL;
+    optimizer->hoisted_nesting = NULL;
+    optimizer->hoisted_type = NULL;
+    optimizer->hoisted_count = 0;
+    optimizer->hoisted_capacity = 0;
+    optimizer->temporary_count = 0;
+    return optimizer;
+}
+
+void free_optimizer(Optimizer *optimizer)
+{
+    free(optimizer->assigned);
+    free(optimizer->hoisted);
+    free(optimizer->hoisted_nesting);
+    free(optimizer->hoisted_type);
+    free(optimizer);
+}
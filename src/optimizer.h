@@ -0,0 +1,55 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "arena.h"
+#include "intern.h"
+#include "parser.h"
+
+// ConstantScope maps the slots of one scope to the declarations that
+// created them, while optimize() walks a block.
+typedef struct ConstantScope
+{
+    struct ConstantScope *outer;
+    ASTNode **declarations;
+    int count;
+} ConstantScope;
+
+// Optimizer rewrites a resolved program in place: constant expressions are
+// folded, variables that are never reassigned are replaced by their value
+// and if statements with a constant condition are reduced to one branch.
+// Binary operations whose operand types can be inferred are quickened.
+// Expressions of a while loop that do not depend on the loop are hoisted
+// into variables that are computed once, before the loop, and loops that
+// only add to int variables are replaced by the values they compute.
+typedef struct Optimizer
+{
+    ConstantScope *current;
+
+    // Loop-invariant code motion: the declarations of the variables the
+    // current loop assigns, and the expressions that can be hoisted out of
+    // it with the number of blocks between them and the loop, and their type.
+    ASTNode **assigned;
+    int assigned_count;
+    int assigned_capacity;
+    ASTNode **hoisted;
+    int *hoisted_nesting;
+    int *hoisted_type;
+    int hoisted_count;
+    int hoisted_capacity;
+    int temporary_count;
+
+    // Nodes created by the optimizer are allocated in the arena of the
+    // program being optimized, so they are released along with it.
+    // Temporary names are numbered from 0 in every program.
+    Arena *arena;
+
+    // Folded strings are interned next to the string literals.
+    InternTable *interns;
+} Optimizer;
+
+Optimizer *create_optimizer(InternTable *interns);
+void free_optimizer(Optimizer *optimizer);
+
+void optimize(Optimizer *optimizer, ASTNode *program, Arena *arena);
+
+#endif // OPTIMIZER_H
@@ -1,32 +1,40 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include "parser.h"
 #include "util.h"
 
 int parse_is_at_eof(ParserState *state)
 {
-    return state->cur->type == EOF_TOKEN;
+    return parse_peek(state) == EOF_TOKEN;
 }
 
-Token *parse_peek(ParserState *state)
+TokenKind parse_peek(ParserState *state)
 {
-    return state->cur;
+    return lexer_peek_kind(state->lexer, 0);
 }
 
-Token *parse_peek_next(ParserState *state)
+TokenKind parse_peek_next(ParserState *state)
 {
-    return state->cur->next;
+    return parse_peek_n(state, 1);
+}
+
+// Looks n tokens ahead, n must be below TOKEN_RING_SIZE.
+// Looking past the end yields EOF_TOKEN.
+TokenKind parse_peek_n(ParserState *state, int n)
+{
+    return lexer_peek_kind(state->lexer, n);
 }
 
 int parse_match(ParserState *state, const TokenKind expected_tokens[], int len)
 {
-    Token *current_token = parse_peek(state);
+    TokenKind current_kind = parse_peek(state);
 
     for (int i = 0; i < len; i++)
     {
-        if (expected_tokens[i] == current_token->type)
+        if (expected_tokens[i] == current_kind)
         {
             return 1;
         }
@@ -35,12 +43,12 @@ int parse_match(ParserState *state, const TokenKind expected_tokens[], int len)
     return 0;
 }
 
-Token *parse_consume(ParserState *state, const TokenKind expected_tokens[], int len)
+Token parse_consume(ParserState *state, const TokenKind expected_tokens[], int len)
 {
+    Token current_token = lexer_peek(state->lexer, 0);
+
     if (expected_tokens != NULL && !parse_match(state, expected_tokens, len))
     {
-        Token *current_token = parse_peek(state);
-
         // Print expected tokens
         if (len == 1)
         {
@@ -57,27 +65,18 @@ Token *parse_consume(ParserState *state, const TokenKind expected_tokens[], int
         }
 
         // Print found token
-        fprintf(stderr, "Found: '%s'\n", token_kind_to_string(current_token->type));
+        fprintf(stderr, "Found: '%s'\n", token_kind_to_string(current_token.type));
 
         // Print where parse error occurred
-        fprintf(stderr, "%d:%d\n", current_token->line, current_token->line_start_pos);
+        fprintf(stderr, "%" PRId64 ":%" PRId64 "\n", current_token.line, current_token.line_start_pos);
 
-        int line_num = current_token->line;
         char *prog = state->prog;
 
         // Find the start of the line
-        int line_start = 0;
-        while (line_num > 0)
-        {
-            if (prog[line_start] == '\n')
-            {
-                line_num--;
-            }
-            line_start++;
-        }
+        int64_t line_start = current_token.start_pos - current_token.line_start_pos;
 
         // Find the end of the line
-        int line_end = line_start;
+        int64_t line_end = line_start;
         while (prog[line_end] != '\n' && prog[line_end] != '\0')
         {
             line_end++;
@@ -85,10 +84,10 @@ Token *parse_consume(ParserState *state, const TokenKind expected_tokens[], int
 
         // Write the line to stderr
         fwrite(prog + line_start, sizeof(char), line_end - line_start, stderr);
-        printf("\n");
+        fprintf(stderr, "\n");
 
         // Print a pointer (^) at the token's position
-        for (int i = 0; i < current_token->line_start_pos; i++)
+        for (int64_t i = 0; i < current_token.line_start_pos; i++)
         {
             fprintf(stderr, " ");
         }
@@ -99,9 +98,7 @@ Token *parse_consume(ParserState *state, const TokenKind expected_tokens[], int
     }
 
     // If no error, update the parser state and return the current token
-    Token *temp = state->cur;
-    state->cur = state->cur->next;
-    return temp;
+    return next_token(state->lexer);
 }
 
 ASTNode *parse_eof(ParserState *state)
@@ -109,7 +106,7 @@ ASTNode *parse_eof(ParserState *state)
     TokenKind expected[] = {EOF_TOKEN};
     parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
 
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
     node->type = NODE_EOF;
 
     return node;
@@ -118,16 +115,13 @@ ASTNode *parse_eof(ParserState *state)
 ASTNode *parse_string(ParserState *state)
 {
     TokenKind expected[] = {STRING};
-    Token *current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
+    Token current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
 
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
 
     node->type = NODE_STRING;
 
-    // Should this be moved to its own function?
-    // I vote yes because malloc
-    node->data.string_value = (char *)malloc(sizeof(char) * (current_token->end_pos - current_token->start_pos + 1));
-    strcpy(node->data.string_value, current_token->value);
+    node->data.string_value = current_token.interned;
 
     return node;
 }
@@ -135,15 +129,15 @@ ASTNode *parse_string(ParserState *state)
 ASTNode *parse_number(ParserState *state)
 {
     TokenKind expected[] = {NUMBER};
-    Token *current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
+    Token current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
 
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
 
     node->type = NODE_INTEGER;
 
     // Should this be moved to its own function?
     node->data.integer_value = 0;
-    for (int i = current_token->start_pos; i < current_token->end_pos; i++)
+    for (int64_t i = current_token.start_pos; i < current_token.start_pos + current_token.length; i++)
     {
         node->data.integer_value *= 10;
         node->data.integer_value += state->prog[i] - '0';
@@ -155,11 +149,11 @@ ASTNode *parse_number(ParserState *state)
 ASTNode *parse_unary_operator(ParserState *state)
 {
     TokenKind expected[] = {TILDE, BANG};
-    Token *current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
+    Token current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
 
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
     node->type = NODE_UNARY_OP;
-    switch (current_token->type)
+    switch (current_token.type)
     {
     case TILDE:
         node->data.unary_op.op = NEGATE;
@@ -177,12 +171,13 @@ ASTNode *parse_unary_operator(ParserState *state)
 ASTNode *parse_additive_operator(ParserState *state)
 {
     TokenKind expected[] = {PLUS, MINUS};
-    Token *current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
+    Token current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
 
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
     node->type = NODE_BINARY_OP;
+    node->data.binary_op.handler = HANDLER_UNQUICKENED;
 
-    switch (current_token->type)
+    switch (current_token.type)
     {
     case PLUS:
         node->data.binary_op.op = ADD;
@@ -200,12 +195,13 @@ ASTNode *parse_additive_operator(ParserState *state)
 ASTNode *parse_multiplicative_operator(ParserState *state)
 {
     TokenKind expected[] = {STAR, SLASH};
-    Token *current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
+    Token current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
 
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
     node->type = NODE_BINARY_OP;
+    node->data.binary_op.handler = HANDLER_UNQUICKENED;
 
-    switch (current_token->type)
+    switch (current_token.type)
     {
     case STAR:
         node->data.binary_op.op = MULTIPLY;
@@ -223,12 +219,13 @@ ASTNode *parse_multiplicative_operator(ParserState *state)
 ASTNode *parse_comparison_operator(ParserState *state)
 {
     TokenKind expected[] = {GREATER, GREATER_EQUAL, LESS, LESS_EQUAL, BANG_EQUAL, EQUAL_EQUAL};
-    Token *current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
+    Token current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
 
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
     node->type = NODE_BINARY_OP;
+    node->data.binary_op.handler = HANDLER_UNQUICKENED;
 
-    switch (current_token->type)
+    switch (current_token.type)
     {
     case GREATER:
         node->data.binary_op.op = IS_GREATER_THAN;
@@ -240,7 +237,7 @@ ASTNode *parse_comparison_operator(ParserState *state)
         node->data.binary_op.op = IS_LESS_THAN;
         break;
     case LESS_EQUAL:
-        node->data.binary_op.op = IS_GREATER_THAN;
+        node->data.binary_op.op = LESS_THAN_EQUAL;
         break;
     case BANG_EQUAL:
         node->data.binary_op.op = IS_NOT_EQUAL;
@@ -257,19 +254,19 @@ ASTNode *parse_comparison_operator(ParserState *state)
 
 ASTNode *parse_factor(ParserState *state)
 {
-    Token *current_token = parse_peek(state);
+    Token current_token = lexer_peek(state->lexer, 0);
 
-    if (current_token->type == STRING)
+    if (current_token.type == STRING)
     {
         return parse_string(state);
     }
 
-    if (current_token->type == NUMBER)
+    if (current_token.type == NUMBER)
     {
         return parse_number(state);
     }
 
-    if (current_token->type == LEFT_PAREN)
+    if (current_token.type == LEFT_PAREN)
     {
         parse_consume(state, NULL, 0); // Consume LEFT_PAREN.
 
@@ -281,19 +278,19 @@ ASTNode *parse_factor(ParserState *state)
         return node;
     }
 
-    if (current_token->type == BANG || current_token->type == TILDE)
+    if (current_token.type == BANG || current_token.type == TILDE)
     {
         ASTNode *node = parse_unary_operator(state);
         node->data.unary_op.right = parse_factor(state);
         return node;
     }
 
-    if (current_token->type == IDENTIFIER)
+    if (current_token.type == IDENTIFIER)
     {
         return parse_identifier(state);
     }
 
-    char *str = token_to_string(current_token);
+    char *str = token_to_string(&current_token, state->prog);
     fprintf(stderr, "Unexpected Token in Expression. Found: %s\n", str);
     free(str);
     exit(EXIT_FAILURE);
@@ -303,7 +300,7 @@ ASTNode *parse_term(ParserState *state)
 {
     ASTNode *node = parse_factor(state);
 
-    while (parse_peek(state)->type == STAR || parse_peek(state)->type == SLASH)
+    while (parse_peek(state) == STAR || parse_peek(state) == SLASH)
     {
         ASTNode *op_node = parse_multiplicative_operator(state);
         op_node->data.binary_op.left = node;
@@ -318,7 +315,7 @@ ASTNode *parse_expression(ParserState *state)
 {
     ASTNode *node = parse_term(state);
 
-    while (parse_peek(state)->type == PLUS || parse_peek(state)->type == MINUS)
+    while (parse_peek(state) == PLUS || parse_peek(state) == MINUS)
     {
         ASTNode *op_node = parse_additive_operator(state);
         op_node->data.binary_op.left = node;
@@ -327,12 +324,12 @@ ASTNode *parse_expression(ParserState *state)
     }
 
     while (
-        parse_peek(state)->type == GREATER ||
-        parse_peek(state)->type == GREATER_EQUAL ||
-        parse_peek(state)->type == LESS ||
-        parse_peek(state)->type == LESS_EQUAL ||
-        parse_peek(state)->type == BANG_EQUAL ||
-        parse_peek(state)->type == EQUAL_EQUAL)
+        parse_peek(state) == GREATER ||
+        parse_peek(state) == GREATER_EQUAL ||
+        parse_peek(state) == LESS ||
+        parse_peek(state) == LESS_EQUAL ||
+        parse_peek(state) == BANG_EQUAL ||
+        parse_peek(state) == EQUAL_EQUAL)
     {
         ASTNode *op_node = parse_comparison_operator(state);
         op_node->data.binary_op.left = node;
@@ -346,26 +343,22 @@ ASTNode *parse_expression(ParserState *state)
 ASTNode *parse_identifier(ParserState *state)
 {
     TokenKind expected[] = {IDENTIFIER};
-    Token *current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
+    Token current_token = parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
 
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
     node->type = NODE_IDENTIFIER;
 
-    size_t identifier_length = current_token->end_pos - current_token->start_pos;
-    node->data.identifier_value = (char *)malloc(identifier_length + 1);
-    if (node->data.identifier_value == NULL)
-    {
-        fprintf(stderr, "Failed to allocate memory for 'IDENTIFIER'.\n");
-        exit(EXIT_FAILURE);
-    }
-    strcpy(node->data.identifier_value, current_token->value);
+    node->data.identifier.value = current_token.interned;
+    node->data.identifier.hash = string_hash(current_token.interned);
+    node->data.identifier.depth = -1;
+    node->data.identifier.slot = -1;
 
     return node;
 }
 
 ASTNode *parse_type(ParserState *state)
 {
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
     node->type = NODE_TYPE;
     node->data.type.identifier = parse_identifier(state);
     return node;
@@ -376,12 +369,14 @@ ASTNode *parse_variable_declaration(ParserState *state)
     ASTNode *type_node = parse_type(state);
     ASTNode *identifier_node = parse_identifier(state);
 
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
     node->type = NODE_DECLARATION;
     node->data.declaration.type = type_node;
     node->data.declaration.identifier = identifier_node;
+    node->data.declaration.is_reassigned = 0;
+    node->data.declaration.value_type = -1;
 
-    if (parse_peek(state)->type == EQUALS)
+    if (parse_peek(state) == EQUALS)
     {
         parse_consume(state, NULL, 0); // Consume EQUALS.
 
@@ -404,7 +399,7 @@ ASTNode *parse_variable_assignment(ParserState *state)
     // TODO: FIX
     parse_consume(state, expected, sizeof(expected) / sizeof(TokenKind));
 
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
     node->type = NODE_ASSIGNMENT;
     node->data.assignment.identifier = identifier_node;
     node->data.assignment.right = parse_expression(state);
@@ -414,23 +409,24 @@ ASTNode *parse_variable_assignment(ParserState *state)
 
 ASTNode *parse_statement(ParserState *state)
 {
-    while (parse_peek(state)->type == SEMICOLON)
+    while (parse_peek(state) == SEMICOLON)
     {
         parse_consume(state, NULL, 0); // Consume SEMICOLON.
     }
 
-    ASTNode *node = create_empty_ast_node();
+    ASTNode *node = create_empty_ast_node(state->arena);
     node->type = NODE_STATEMENT;
+    node->data.statement.jit_loop = NULL;
 
     TokenKind expected_semi[] = {SEMICOLON};
-    switch (parse_peek(state)->type)
+    switch (parse_peek(state))
     {
     case IF:
         node->data.statement.type = IF_STATEMENT;
         parse_consume(state, NULL, 0); // Consume IF.
         node->data.statement.data.expression = parse_expression(state);
         node->data.statement.data.expression->next = parse_statement(state);
-        if (parse_peek(state)->type == ELSE)
+        if (parse_peek(state) == ELSE)
         {
             parse_consume(state, NULL, 0); // Consume ELSE.
             node->data.statement.data.expression->next->next = parse_statement(state);
@@ -452,7 +448,7 @@ ASTNode *parse_statement(ParserState *state)
         return node;
         break;
     case IDENTIFIER:
-        if (parse_peek_next(state)->type == IDENTIFIER)
+        if (parse_peek_next(state) == IDENTIFIER)
         {
             node->data.statement.type = DECLARATION;
             node->data.statement.data.declaration = parse_variable_declaration(state);
@@ -469,12 +465,13 @@ ASTNode *parse_statement(ParserState *state)
         break;
     case LEFT_BRACKET:
         node->data.statement.type = BLOCK_STATEMENT;
+        node->data.statement.slot_count = 0;
         parse_consume(state, NULL, 0); // Consume LEFT_BRACKET.
 
-        ASTNode *dummy_head = create_empty_ast_node();
+        ASTNode *dummy_head = create_empty_ast_node(state->arena);
         ASTNode *dummy_tail = dummy_head;
 
-        while (parse_peek(state)->type != RIGHT_BRACKET)
+        while (parse_peek(state) != RIGHT_BRACKET)
         {
             ASTNode *temp = parse_statement(state);
 
@@ -491,14 +488,13 @@ ASTNode *parse_statement(ParserState *state)
         node->data.statement.data.head = dummy_head->next;
         return node;
     default:
-        free(node);
-
         // Commenting out this entire section
         // Pretty sure its useless but im not 100%
         // // WHY IS THIS CODE HERE??
-        // if (parse_peek(state)->type != RIGHT_BRACKET)
+        // if (parse_peek(state) != RIGHT_BRACKET)
         // {
-        char *str = token_to_string(parse_peek(state));
+        Token current_token = lexer_peek(state->lexer, 0);
+        char *str = token_to_string(&current_token, state->prog);
         printf("Unexpected Token. Expected Statement. Found: %s\n", str);
         free(str);
         exit(EXIT_FAILURE);
@@ -531,19 +527,122 @@ ASTNode *parser(ParserState *state)
     return state->node;
 }
 
-ASTNode *create_empty_ast_node()
+ASTNode *create_empty_ast_node(Arena *arena)
+{
+    ASTNode *node = (ASTNode *)arena_alloc(arena, sizeof(ASTNode));
+    node->next = NULL;
+    return node;
+}
+
+// Finds what a resolved assignment adds to the variable it assigns, as in
+// "s = s + x" or "s = s + x + y", which parses as "(s + x) + y". Fills
+// operands with them in order and returns how many there are, or 0 for any
+// other assignment, one known to be on ints, or one with more than
+// APPEND_MAX operands. Engines run these with value_append_all(), which
+// can grow a string in place.
+int append_operands(ASTNode *assignment, ASTNode **operands)
 {
-    ASTNode *node = (ASTNode *)malloc(sizeof(ASTNode));
-    if (node == NULL)
+    ASTNode *target = assignment->data.assignment.identifier;
+    ASTNode *left = assignment->data.assignment.right;
+    int count = 0;
+    while (left->type == NODE_BINARY_OP && left->data.binary_op.op == ADD &&
+           left->data.binary_op.handler != HANDLER_INT_ADD)
     {
-        fprintf(stderr, "Failed to allocate memory for ASTNode.\n");
-        exit(EXIT_FAILURE);
+        if (count == APPEND_MAX)
+        {
+            return 0;
+        }
+        operands[count++] = left->data.binary_op.right;
+        left = left->data.binary_op.left;
     }
-    node->next = NULL;
+    if (count == 0 || left->type != NODE_IDENTIFIER ||
+        left->data.identifier.depth != target->data.identifier.depth ||
+        left->data.identifier.slot != target->data.identifier.slot)
+    {
+        return 0;
+    }
+
+    // The chain was walked from its last operand.
+    for (int i = 0; i < count / 2; i++)
+    {
+        ASTNode *operand = operands[i];
+        operands[i] = operands[count - 1 - i];
+        operands[count - 1 - i] = operand;
+    }
+    return count;
+}
+
+static ASTNode *find_conditional_declaration(ASTNode *statement, int *index)
+{
+    if (statement->data.statement.type != IF_STATEMENT && statement->data.statement.type != WHILE_STATEMENT)
+    {
+        return NULL;
+    }
+    for (ASTNode *body = statement->data.statement.data.expression->next; body; body = body->next)
+    {
+        if (body->data.statement.type == DECLARATION)
+        {
+            if ((*index)-- == 0)
+            {
+                return body->data.statement.data.declaration;
+            }
+            continue;
+        }
+        ASTNode *declaration = find_conditional_declaration(body, index);
+        if (declaration)
+        {
+            return declaration;
+        }
+    }
+    return NULL;
+}
+
+// Returns the index-th declaration a statement of a block makes without
+// always running it, or NULL: a declaration that is the body of an if or
+// while, directly or through other ifs and whiles, as in "if c int x = 1;".
+// Its variable belongs to the block, and the tree walker resets the slots
+// of a block to -1 when it enters it. The other engines set these slots to
+// -1 before running the statement, which happens once per block entry.
+ASTNode *conditional_declaration(ASTNode *statement, int index)
+{
+    return find_conditional_declaration(statement, &index);
+}
+
+static ASTNode *create_program_node(Arena *arena)
+{
+    ASTNode *node = create_empty_ast_node(arena);
+    node->type = NODE_PROGRAM;
+    node->data.program.slot_count = 0;
+    node->data.program.head = create_empty_ast_node(arena);
+    node->data.program.tail = node->data.program.head;
     return node;
 }
 
-ParserState *create_parser_state(char *program, Token *head)
+// Parses the next top-level statement into a program of its own.
+// The previous program returned by this function is released first.
+// Returns NULL once the input is exhausted.
+ASTNode *parse_next_program(ParserState *state)
+{
+    while (parse_peek(state) == SEMICOLON)
+    {
+        parse_consume(state, NULL, 0); // Consume SEMICOLON.
+    }
+    if (parse_is_at_eof(state))
+    {
+        return NULL;
+    }
+
+    arena_reset(state->arena);
+    state->node = create_program_node(state->arena);
+
+    ASTNode *node = parse_statement(state);
+    state->node->data.program.head->next = node;
+    state->node->data.program.tail = node;
+
+    return state->node;
+}
+
+ParserState *create_parser_state(char *program, LexerState *lexer)
 {
     ParserState *parser_state = (ParserState *)malloc(sizeof(ParserState));
     if (parser_state == NULL)
@@ -555,23 +654,18 @@ ParserState *create_parser_state(char *program, Token *head)
     // Program
     parser_state->prog = program;
     // Tokens
-    parser_state->head = head;
-    parser_state->cur = head;
+    parser_state->lexer = lexer;
+    // Arena
+    parser_state->arena = create_arena("ast");
     // PROGRAM_NODE
-    parser_state->node = create_empty_ast_node();
-    if (parser_state->node == NULL)
-    {
-        fprintf(stderr, "Failed to allocate memory for ParserState->head_node.\n");
-        exit(EXIT_FAILURE);
-    }
-    parser_state->node->type = NODE_PROGRAM;
-    parser_state->node->data.program.head = create_empty_ast_node();
-    parser_state->node->data.program.tail = parser_state->node->data.program.head;
+    parser_state->node = create_program_node(parser_state->arena);
 
     return parser_state;
 }
 
-void free_parser_state(ParserState *state) {
-    // THIS FUNCTION DOESN'T DO ANYTHING BECAUSE I DON'T CARE ENOUGH
-    // Ideally it would be paired with a recursive free_astnode that frees each ASTNode
-};
\ No newline at end of file
+// Frees the whole AST. Interned strings are left alone.
+void free_parser_state(ParserState *state)
+{
+    free_arena(state->arena);
+    free(state);
+}
\ No newline at end of file
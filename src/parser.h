@@ -1,8 +1,12 @@
+#include "arena.h"
 #include "lexer.h"
 
 #ifndef PARSER_H
 #define PARSER_H
 
+// Most operands an assignment can append at once, see append_operands().
+#define APPEND_MAX 16
+
 /**
  * I would like to thank ChatGPT for help making the following breakdown:
  *
@@ -96,6 +100,28 @@ typedef enum BinaryOp
     IS_NOT_EQUAL,
 } BinaryOp;
 
+// The tree walker rewrites a binary operation into a handler specialized
+// for the operand types it sees the first time it runs (or that the
+// optimizer infers). Specialized handlers check their operand types and
+// fall back to HANDLER_GENERIC for good when the check fails.
+typedef enum BinaryHandler
+{
+    HANDLER_UNQUICKENED,
+    HANDLER_GENERIC,
+    HANDLER_INT_ADD,
+    HANDLER_INT_SUBTRACT,
+    HANDLER_INT_MULTIPLY,
+    HANDLER_INT_DIVIDE,
+    HANDLER_INT_EQUAL,
+    HANDLER_INT_LESS,
+    HANDLER_INT_LESS_EQUAL,
+    HANDLER_INT_GREATER,
+    HANDLER_INT_GREATER_EQUAL,
+    HANDLER_INT_NOT_EQUAL,
+    HANDLER_STR_ADD,
+    HANDLER_STR_COMPARE,
+} BinaryHandler;
+
 typedef enum UnaryOp
 {
     NEGATE,
@@ -107,6 +133,8 @@ typedef struct
     char *name;
 } Identifier;
 
+struct JitLoop;
+
 typedef struct ASTNode
 {
     NodeType type;
@@ -116,9 +144,21 @@ typedef struct ASTNode
         int integer_value;
 
         // Identifier
-        char *identifier_value;
+        struct
+        {
+            // Interned by the lexer, see intern.h.
+            char *value;
+
+            // Set by the parser: string_hash() of value.
+            unsigned int hash;
 
-        // String
+            // Set by resolve(): the number of scopes between this use and
+            // the declaration, and the variable's slot in that scope.
+            int depth;
+            int slot;
+        } identifier;
+
+        // String, interned by the lexer
         char *string_value;
 
         // Binary Operation
@@ -127,6 +167,7 @@ typedef struct ASTNode
             BinaryOp op;
             struct ASTNode *left;
             struct ASTNode *right;
+            BinaryHandler handler;
         } binary_op;
 
         // Unary Operation
@@ -149,6 +190,12 @@ typedef struct ASTNode
             struct ASTNode *type;
             struct ASTNode *right;
             struct ASTNode *identifier;
+
+            // Set by optimize(): whether an assignment targets the variable,
+            // and the ValueType of every value it can hold (negative if
+            // that is not known).
+            int is_reassigned;
+            int value_type;
         } declaration;
 
         // Statement
@@ -162,6 +209,13 @@ typedef struct ASTNode
                 struct ASTNode *head;
                 struct ASTNode *expression;
             } data;
+
+            // BLOCK_STATEMENT: number of variables declared in the block, set by resolve().
+            int slot_count;
+
+            // WHILE_STATEMENT: machine code of the loop, set by the tree
+            // walker the first time it runs the loop with --jit.
+            struct JitLoop *jit_loop;
         } statement;
 
         // Type Declaration
@@ -175,6 +229,9 @@ typedef struct ASTNode
         {
             struct ASTNode *head;
             struct ASTNode *tail;
+
+            // Number of global variables, set by resolve().
+            int slot_count;
         } program;
     } data;
     struct ASTNode *next;
@@ -182,16 +239,22 @@ typedef struct ASTNode
 
 typedef struct
 {
-    Token *head;
-    Token *cur;
+    // Tokens are pulled from the lexer as the parser needs them.
+    LexerState *lexer;
     ASTNode *node;
     char *prog;
+
+    // AST nodes live in arena until free_parser_state(). Identifiers and
+    // string literals are interned by the lexer, so they can outlive the
+    // AST (e.g. the globals of a REPL session).
+    Arena *arena;
 } ParserState;
 
 int parse_is_at_eof(ParserState *state);
-Token *parse_peek(ParserState *state);
-Token *parse_peek_next(ParserState *state);
-Token *parse_consume(ParserState *state, const TokenKind expected_tokens[], int len);
+TokenKind parse_peek(ParserState *state);
+TokenKind parse_peek_next(ParserState *state);
+TokenKind parse_peek_n(ParserState *state, int n);
+Token parse_consume(ParserState *state, const TokenKind expected_tokens[], int len);
 ASTNode *parse_eof(ParserState *state);
 ASTNode *parse_number(ParserState *state);
 ASTNode *parse_unary_operator(ParserState *state);
@@ -207,8 +270,11 @@ ASTNode *parse_variable_declaration(ParserState *state);
 ASTNode *parse_variable_assignment(ParserState *state);
 ASTNode *parse_statement(ParserState *state);
 ASTNode *parser(ParserState *state);
-ASTNode *create_empty_ast_node();
-ParserState *create_parser_state(char *program, Token *head);
+ASTNode *parse_next_program(ParserState *state);
+ASTNode *create_empty_ast_node(Arena *arena);
+int append_operands(ASTNode *assignment, ASTNode **operands);
+ASTNode *conditional_declaration(ASTNode *statement, int index);
+ParserState *create_parser_state(char *program, LexerState *lexer);
 void free_parser_state(ParserState *state);
 
 #endif // PARSER_H
\ No newline at end of file
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resolver.h"
+#include "value.h"
+
+static Scope *create_scope(Scope *outer)
+{
+    Scope *scope = (Scope *)malloc(sizeof(Scope));
+    if (scope == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for Scope.\n");
+        exit(EXIT_FAILURE);
+    }
+    scope->outer = outer;
+    scope->names = NULL;
+    scope->count = 0;
+    scope->capacity = 0;
+    scope->buckets = NULL;
+    scope->bucket_count = 0;
+    return scope;
+}
+
+static void free_scope(Scope *scope)
+{
+    free(scope->names);
+    free(scope->buckets);
+    free(scope);
+}
+
+// Puts slot in the first free bucket after the one its hash maps to.
+// Returns whether that was not the first bucket.
+static int scope_insert(Scope *scope, int slot)
+{
+    unsigned int mask = scope->bucket_count - 1;
+    unsigned int bucket = string_hash(scope->names[slot]) & mask;
+    int collided = scope->buckets[bucket] != -1;
+    while (scope->buckets[bucket] != -1)
+    {
+        bucket = (bucket + 1) & mask;
+    }
+    scope->buckets[bucket] = slot;
+    return collided;
+}
+
+// Rebuilds the table of a scope with bucket_count buckets. Names that were
+// already counted as collisions when they were added are not counted again.
+static void scope_rehash(Scope *scope, int bucket_count)
+{
+    free(scope->buckets);
+    scope->bucket_count = bucket_count;
+    scope->buckets = (int *)malloc(bucket_count * sizeof(int));
+    if (scope->buckets == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for Scope->buckets.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < bucket_count; i++)
+    {
+        scope->buckets[i] = -1;
+    }
+    for (int slot = 0; slot < scope->count; slot++)
+    {
+        scope_insert(scope, slot);
+    }
+}
+
+// Returns the slot of an identifier in scope, or -1.
+static int scope_find(Resolver *resolver, Scope *scope, ASTNode *identifier)
+{
+    if (scope->count == 0)
+    {
+        return -1;
+    }
+
+    // Names are interned, so equal names are the same pointer.
+    const char *name = identifier->data.identifier.value;
+    unsigned int mask = scope->bucket_count - 1;
+    int probes = 1;
+    int slot;
+    resolver->stats.lookups++;
+    for (unsigned int bucket = identifier->data.identifier.hash & mask; (slot = scope->buckets[bucket]) != -1; bucket = (bucket + 1) & mask)
+    {
+        if (scope->names[slot] == name)
+        {
+            break;
+        }
+        probes++;
+    }
+
+    resolver->stats.probes += probes;
+    if (probes > resolver->stats.longest_probe)
+    {
+        resolver->stats.longest_probe = probes;
+    }
+    return slot;
+}
+
+// Names are interned, so they outlive the AST of a REPL line like the
+// global scope does.
+static int scope_add(Resolver *resolver, Scope *scope, ASTNode *identifier)
+{
+    if (scope->count == scope->capacity)
+    {
+        scope->capacity = scope->capacity < 8 ? 8 : scope->capacity * 2;
+        scope->names = (char **)realloc(scope->names, scope->capacity * sizeof(char *));
+        if (scope->names == NULL)
+        {
+            fprintf(stderr, "Failed to allocate memory for Scope->names.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    int slot = scope->count;
+    scope->names[slot] = identifier->data.identifier.value;
+
+    if ((slot + 1) * 2 > scope->bucket_count)
+    {
+        scope_rehash(scope, scope->bucket_count < 16 ? 16 : scope->bucket_count * 2);
+    }
+    scope->count++;
+    resolver->stats.collisions += scope_insert(scope, slot);
+    return slot;
+}
+
+// Fills in depth and slot of an identifier node.
+// Returns FAILURE if no enclosing scope declares it.
+static int bind(Resolver *resolver, ASTNode *identifier)
+{
+    int depth = 0;
+    for (Scope *scope = resolver->current; scope; scope = scope->outer)
+    {
+        int slot = scope_find(resolver, scope, identifier);
+        if (slot != -1)
+        {
+            identifier->data.identifier.depth = depth;
+            identifier->data.identifier.slot = slot;
+            return SUCCESS;
+        }
+        depth++;
+    }
+    return FAILURE;
+}
+
+void resolve_expression(Resolver *resolver, ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_STRING:
+    case NODE_INTEGER:
+        break;
+    case NODE_IDENTIFIER:
+        if (bind(resolver, node) == FAILURE)
+        {
+            fprintf(stderr, "Resolve Error: Unknown variable '%s'\n", node->data.identifier.value);
+            resolver->had_error = 1;
+        }
+        break;
+    case NODE_BINARY_OP:
+        resolve_expression(resolver, node->data.binary_op.left);
+        resolve_expression(resolver, node->data.binary_op.right);
+        break;
+    case NODE_UNARY_OP:
+        resolve_expression(resolver, node->data.unary_op.right);
+        break;
+    default:
+        fprintf(stderr, "Resolve Error: Invalid Expression.\n");
+        resolver->had_error = 1;
+        break;
+    }
+}
+
+static void resolve_declaration(Resolver *resolver, ASTNode *node)
+{
+    // The initializer cannot see the variable it initializes.
+    if (node->data.declaration.right)
+    {
+        resolve_expression(resolver, node->data.declaration.right);
+    }
+
+    // Variables cannot shadow a name that is already visible.
+    ASTNode *identifier = node->data.declaration.identifier;
+    if (bind(resolver, identifier) == SUCCESS)
+    {
+        fprintf(stderr, "Resolve Error: Unable to declare variable '%s'. Has it already been declared?\n", identifier->data.identifier.value);
+        resolver->had_error = 1;
+        return;
+    }
+
+    identifier->data.identifier.depth = 0;
+    identifier->data.identifier.slot = scope_add(resolver, resolver->current, identifier);
+}
+
+static void resolve_assignment(Resolver *resolver, ASTNode *node)
+{
+    resolve_expression(resolver, node->data.assignment.right);
+
+    ASTNode *identifier = node->data.assignment.identifier;
+    if (bind(resolver, identifier) == FAILURE)
+    {
+        fprintf(stderr, "Resolve Error: Unable to update variable '%s'. Has it been declared yet?\n", identifier->data.identifier.value);
+        resolver->had_error = 1;
+    }
+}
+
+void resolve_statement(Resolver *resolver, ASTNode *node)
+{
+    switch (node->data.statement.type)
+    {
+    case DECLARATION:
+        resolve_declaration(resolver, node->data.statement.data.declaration);
+        break;
+    case ASSIGNMENT:
+        resolve_assignment(resolver, node->data.statement.data.assignment);
+        break;
+    case BLOCK_STATEMENT:
+    {
+        Scope *scope = create_scope(resolver->current);
+        resolver->current = scope;
+        for (ASTNode *dummy = node->data.statement.data.head; dummy; dummy = dummy->next)
+        {
+            resolve_statement(resolver, dummy);
+        }
+        node->data.statement.slot_count = scope->count;
+        resolver->current = scope->outer;
+        free_scope(scope);
+        break;
+    }
+    case WHILE_STATEMENT:
+    case IF_STATEMENT:
+    {
+        // The condition is followed by the body (and the else branch).
+        ASTNode *condition = node->data.statement.data.expression;
+        resolve_expression(resolver, condition);
+        for (ASTNode *body = condition->next; body; body = body->next)
+        {
+            resolve_statement(resolver, body);
+        }
+        break;
+    }
+    case PRINT_STATEMENT:
+        resolve_expression(resolver, node->data.statement.data.expression);
+        break;
+    default:
+        fprintf(stderr, "Resolve Error: Unknown statement type %d!\n", node->data.statement.type);
+        resolver->had_error = 1;
+        break;
+    }
+}
+
+// Resolves every identifier of a NODE_PROGRAM.
+// Returns FAILURE (after reporting every error) if the program uses a
+// variable that is not declared; in that case no globals are added.
+int resolve(Resolver *resolver, ASTNode *program)
+{
+    int global_count = resolver->globals->count;
+    resolver->current = resolver->globals;
+    resolver->had_error = 0;
+
+    // The first node of a program is a dummy head.
+    for (ASTNode *dummy = program->data.program.head->next; dummy; dummy = dummy->next)
+    {
+        if (dummy->type == NODE_STATEMENT)
+        {
+            resolve_statement(resolver, dummy);
+        }
+    }
+
+    if (resolver->had_error)
+    {
+        resolver->globals->count = global_count;
+        if (resolver->globals->bucket_count > 0)
+        {
+            scope_rehash(resolver->globals, resolver->globals->bucket_count);
+        }
+        return FAILURE;
+    }
+
+    program->data.program.slot_count = resolver->globals->count;
+    return SUCCESS;
+}
+
+Resolver *create_resolver()
+{
+    Resolver *resolver = (Resolver *)malloc(sizeof(Resolver));
+    if (resolver == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for Resolver.\n");
+        exit(EXIT_FAILURE);
+    }
+    resolver->globals = create_scope(NULL);
+    resolver->current = resolver->globals;
+    resolver->had_error = 0;
+    resolver->stats.lookups = 0;
+    resolver->stats.probes = 0;
+    resolver->stats.longest_probe = 0;
+    resolver->stats.collisions = 0;
+    return resolver;
+}
+
+void free_resolver(Resolver *resolver)
+{
+    free_scope(resolver->globals);
+    free(resolver);
+}
+
+void print_resolver_stats(Resolver *resolver)
+{
+    ResolverStats *stats = &resolver->stats;
+    fprintf(stderr, "Resolver %10ld lookups, %.2f probes on average, %d at most\n",
+            stats->lookups, stats->lookups ? (double)stats->probes / stats->lookups : 0.0, stats->longest_probe);
+    fprintf(stderr, "Resolver %10ld collisions, %d globals in %d buckets\n",
+            stats->collisions, resolver->globals->count, resolver->globals->bucket_count);
+}
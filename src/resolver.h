@@ -0,0 +1,49 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "parser.h"
+
+// Scope holds the (interned) names declared in one block, in slot order,
+// and an open-addressing table from their hashes to their slots. A bucket
+// holds a slot, or -1 if it is empty. The table is at most half full.
+typedef struct Scope
+{
+    struct Scope *outer;
+    char **names;
+    int count;
+    int capacity;
+
+    int *buckets;
+    int bucket_count;
+} Scope;
+
+// How well the tables of every scope spread the names, for --resolver-stats.
+typedef struct ResolverStats
+{
+    long lookups;
+    long probes;
+    int longest_probe;
+    long collisions;
+} ResolverStats;
+
+// Resolver binds every identifier to a (depth, slot) pair before the program runs.
+// The global scope is kept between calls so a REPL session can refer to
+// variables declared on earlier lines.
+typedef struct Resolver
+{
+    Scope *globals;
+    Scope *current;
+    int had_error;
+
+    ResolverStats stats;
+} Resolver;
+
+Resolver *create_resolver();
+void free_resolver(Resolver *resolver);
+void print_resolver_stats(Resolver *resolver);
+
+int resolve(Resolver *resolver, ASTNode *program);
+void resolve_statement(Resolver *resolver, ASTNode *node);
+void resolve_expression(Resolver *resolver, ASTNode *node);
+
+#endif // RESOLVER_H
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "source.h"
+
+// Maps the file followed by at least one zeroed byte. The file is mapped
+// over an anonymous mapping one page larger, so the terminating '\0'
+// exists even when the file size is a multiple of the page size.
+static char *map_source(int fd, size_t length, size_t *mapped_size)
+{
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (length / page_size + 1) * page_size;
+
+    char *text = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (text == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    if (length > 0 && mmap(text, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(text, size);
+        return NULL;
+    }
+
+    *mapped_size = size;
+    return text;
+}
+
+// Fallback for files that cannot be mapped (e.g. pipes).
+static char *read_source(FILE *file, size_t *length)
+{
+    size_t capacity = 4096;
+    char *text = (char *)malloc(capacity);
+    if (text == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for program contents.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t count = 0;
+    size_t read;
+    while ((read = fread(text + count, 1, capacity - count - 1, file)) > 0)
+    {
+        count += read;
+        if (capacity - count == 1)
+        {
+            capacity *= 2;
+            text = (char *)realloc(text, capacity);
+            if (text == NULL)
+            {
+                fprintf(stderr, "Failed to allocate memory for program contents.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    text[count] = '\0';
+
+    *length = count;
+    return text;
+}
+
+Source *open_source(const char *file_name)
+{
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Failed to open file.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Source *source = (Source *)malloc(sizeof(Source));
+    if (source == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for Source.\n");
+        exit(EXIT_FAILURE);
+    }
+    source->text = NULL;
+    source->mapped_size = 0;
+
+    struct stat info;
+    if (fstat(fileno(file), &info) == 0 && S_ISREG(info.st_mode))
+    {
+        source->length = (size_t)info.st_size;
+        source->text = map_source(fileno(file), source->length, &source->mapped_size);
+    }
+
+    if (source->text == NULL)
+    {
+        source->text = read_source(file, &source->length);
+    }
+
+    fclose(file);
+    return source;
+}
+
+void close_source(Source *source)
+{
+    if (source->mapped_size > 0)
+    {
+        munmap(source->text, source->mapped_size);
+    }
+    else
+    {
+        free(source->text);
+    }
+    free(source);
+}
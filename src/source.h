@@ -0,0 +1,21 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+
+// Source is the text of a program file followed by a '\0'.
+// The file is memory mapped when possible, so its pages are only read in
+// as the lexer reaches them.
+typedef struct Source
+{
+    char *text;
+    size_t length;
+
+    // Size of the mapping, 0 if text was read into a malloc'd buffer.
+    size_t mapped_size;
+} Source;
+
+Source *open_source(const char *file_name);
+void close_source(Source *source);
+
+#endif // SOURCE_H
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "str.h"
+
+String *string_of(const char *handle)
+{
+    return (String *)(handle - offsetof(String, chars));
+}
+
+size_t string_length(const char *handle)
+{
+    return string_of(handle)->length;
+}
+
+// FNV-1a.
+unsigned int hash_chars(const char *chars, size_t length)
+{
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)chars[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Returns the hash of a string, computing it the first time it is needed.
+unsigned int string_hash(const char *handle)
+{
+    String *string = string_of(handle);
+    if (string->hash == 0)
+    {
+        string->hash = hash_chars(string->chars, string->length);
+    }
+    return string->hash;
+}
+
+// Bytes a string of length chars takes, including the header and the '\0'.
+size_t string_size(size_t length)
+{
+    return sizeof(String) + length + 1;
+}
+
+// Builds a string of length chars in memory, which must hold
+// string_size(length) bytes. Returns its handle.
+char *string_init(void *memory, const char *chars, size_t length)
+{
+    String *string = (String *)memory;
+    string->length = length;
+    string->capacity = length;
+    string->owner = NULL;
+    string->hash = 0;
+    memcpy(string->chars, chars, length);
+    string->chars[length] = '\0';
+    return string->chars;
+}
+
+// Builds left followed by right in memory, which must hold
+// string_size(string_length(left) + string_length(right)) bytes.
+char *string_concat(void *memory, const char *left, const char *right)
+{
+    size_t length = string_length(left) + string_length(right);
+    return string_concat_owned(memory, length, left, right, NULL);
+}
+
+// Like string_concat(), but memory holds string_size(capacity) bytes and
+// the string is owned by owner, which may append to it in place.
+char *string_concat_owned(void *memory, size_t capacity, const char *left, const char *right, const void *owner)
+{
+    size_t left_len = string_length(left);
+    size_t right_len = string_length(right);
+    String *string = (String *)memory;
+    string->length = left_len + right_len;
+    string->capacity = capacity;
+    string->owner = owner;
+    string->hash = 0;
+    memcpy(string->chars, left, left_len);
+    memcpy(string->chars + left_len, right, right_len + 1);
+    return string->chars;
+}
+
+// Appends right to the string at handle if owner owns it and it has room.
+// Returns 0, leaving the string alone, otherwise.
+int string_append(char *handle, const char *right, const void *owner)
+{
+    String *string = string_of(handle);
+    size_t right_len = string_length(right);
+    if (owner == NULL || string->owner != owner || string->capacity - string->length < right_len)
+    {
+        return 0;
+    }
+
+    // right may be the string itself, its chars end before the ones written.
+    memcpy(string->chars + string->length, right, right_len);
+    string->length += right_len;
+    string->chars[string->length] = '\0';
+    string->hash = 0;
+    return 1;
+}
+
+// Called when a string is stored in slot. If another slot owns it, the
+// string is now shared and can no longer be appended to in place. A NULL
+// slot gives up ownership, e.g. when slots are moved.
+void string_store(const char *handle, const void *slot)
+{
+    String *string = string_of(handle);
+    if (string->owner != NULL && string->owner != slot)
+    {
+        string->owner = NULL;
+    }
+}
+
+// Strings that are the same object, e.g. two uses of a literal, are equal
+// right away. Otherwise strings of different lengths or hashes differ; only
+// hashes that are already known are compared, computing them would cost as
+// much as comparing the bytes.
+int string_equals(const char *left, const char *right)
+{
+    if (left == right)
+    {
+        return 1;
+    }
+    String *left_string = string_of(left);
+    String *right_string = string_of(right);
+    if (left_string->length != right_string->length)
+    {
+        return 0;
+    }
+    if (left_string->hash != 0 && right_string->hash != 0 && left_string->hash != right_string->hash)
+    {
+        return 0;
+    }
+    // memcmp() is vectorized by the C library and was faster than an SSE2
+    // loop here, even for long strings.
+    return memcmp(left, right, left_string->length) == 0;
+}
+
+// Orders strings like strcmp(), without looking for their ends.
+int string_compare(const char *left, const char *right)
+{
+    if (left == right)
+    {
+        return 0;
+    }
+    size_t left_len = string_length(left);
+    size_t right_len = string_length(right);
+    int order = memcmp(left, right, left_len < right_len ? left_len : right_len);
+    if (order != 0)
+    {
+        return order;
+    }
+    return left_len < right_len ? -1 : left_len > right_len;
+}
+
+// Called when a string moves from one slot to another and the old slot is
+// never read again: ownership moves along with it.
+void string_move(const char *handle, const void *from, const void *to)
+{
+    String *string = string_of(handle);
+    if (string->owner == from)
+    {
+        string->owner = to;
+    }
+    else
+    {
+        string_store(handle, to);
+    }
+}
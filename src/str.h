@@ -0,0 +1,40 @@
+#ifndef STR_H
+#define STR_H
+
+#include <stddef.h>
+
+// Every string value is a String. Values point at chars, so a string can be
+// used as an ordinary NUL-terminated C string; its length and hash are found
+// right before it. hash is 0 until string_hash() first computes it.
+//
+// Strings are never modified once built, so they can be shared freely. The
+// one exception is a buffer built by appending to a variable ("s = s + x"):
+// it is owned by the variable's slot, and as long as no other slot holds it
+// the owner may append to it in place, up to capacity chars.
+typedef struct String
+{
+    size_t length;
+    size_t capacity;
+    const void *owner;
+    unsigned int hash;
+    char chars[];
+} String;
+
+String *string_of(const char *handle);
+size_t string_length(const char *handle);
+unsigned int string_hash(const char *handle);
+size_t string_size(size_t length);
+
+char *string_init(void *memory, const char *chars, size_t length);
+char *string_concat(void *memory, const char *left, const char *right);
+char *string_concat_owned(void *memory, size_t capacity, const char *left, const char *right, const void *owner);
+int string_append(char *handle, const char *right, const void *owner);
+void string_store(const char *handle, const void *slot);
+void string_move(const char *handle, const void *from, const void *to);
+
+int string_equals(const char *left, const char *right);
+int string_compare(const char *left, const char *right);
+
+unsigned int hash_chars(const char *chars, size_t length);
+
+#endif // STR_H
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include "lexer.h"
 #include "parser.h"
@@ -73,9 +74,20 @@ const char *token_kind_to_string(TokenKind type)
     }
 }
 
-char *token_to_string(Token *tok)
+// The token's value is read from the program source.
+char *token_to_string(Token *tok, char *prog)
 {
-    char *x = (char *)malloc(100 * sizeof(char));
+    const char *format = "Token { type: %s, line: %" PRId64 ", line_pos: %" PRId64 ", pos: %" PRId64 ", length: %" PRId64 ", value: \"%.*s\" }\n";
+    int len = snprintf(NULL, 0, format,
+                       token_kind_to_string(tok->type),
+                       tok->line,
+                       tok->line_start_pos,
+                       tok->start_pos,
+                       tok->length,
+                       (int)tok->length,
+                       prog + tok->start_pos);
+
+    char *x = (char *)malloc(len + 1);
 
     if (x == NULL)
     {
@@ -83,30 +95,29 @@ char *token_to_string(Token *tok)
         exit(EXIT_FAILURE);
     }
 
-    sprintf(x,
-            "Token { type: %s, line: %d, line_pos: %d, pos: %d, length: %d, value: \"%s\" }\n",
+    sprintf(x, format,
             token_kind_to_string(tok->type),
             tok->line,
             tok->line_start_pos,
             tok->start_pos,
-            tok->end_pos - tok->start_pos,
-            tok->value);
+            tok->length,
+            (int)tok->length,
+            prog + tok->start_pos);
 
     return x;
 }
 
-void print_list(Token *head, char *prog)
+// Pulls every remaining token from the lexer and prints it.
+void print_list(LexerState *lexer)
 {
-    Token *current = head;
-
-    while (current != NULL)
+    Token current;
+    do
     {
-        char *str = token_to_string(current);
+        current = next_token(lexer);
+        char *str = token_to_string(&current, lexer->prog);
         printf("%s", str);
         free(str);
-
-        current = current->next;
-    }
+    } while (current.type != EOF_TOKEN);
 }
 // Helper function to print binary operation
 const char *binary_op_to_str(BinaryOp op)
@@ -130,7 +141,7 @@ const char *binary_op_to_str(BinaryOp op)
     case GREATER_THAN_EQUAL:
         return ">=";
     case LESS_THAN_EQUAL:
-        return "<";
+        return "<=";
     case IS_NOT_EQUAL:
         return "!=";
     default:
@@ -249,7 +260,7 @@ void print_ast(ASTNode *node)
         printf("EOF\n");
         break;
     case NODE_IDENTIFIER:
-        printf("%s", node->data.identifier_value);
+        printf("%s", node->data.identifier.value);
         break;
     case NODE_DECLARATION:
         print_ast(node->data.declaration.type);
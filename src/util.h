@@ -9,9 +9,9 @@
 
 const char *token_kind_to_string(TokenKind type);
 
-char *token_to_string(Token *tok);
+char *token_to_string(Token *tok, char *prog);
 
-void print_list(Token *head, char *prog);
+void print_list(LexerState *lexer);
 
 const char *binary_op_to_str(BinaryOp op);
 
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gc.h"
+#include "value.h"
+
+// Smallest buffer value_append() allocates.
+#define APPEND_MIN_CAPACITY 16
+
+const char *value_type_to_string(ValueType type)
+{
+    switch (type)
+    {
+    case VAL_INT:
+        return "int";
+    case VAL_STR:
+        return "str";
+    default:
+        return "unknown";
+    }
+}
+
+// Integers are true when non-zero, strings are always true.
+int value_is_truthy(Value value)
+{
+    if (value.type == VAL_INT)
+    {
+        return value.as.integer != 0;
+    }
+    return 1;
+}
+
+void print_value(Value value)
+{
+    switch (value.type)
+    {
+    case VAL_INT:
+        printf("%d\n", value.as.integer);
+        break;
+    case VAL_STR:
+        fwrite(value.as.string, 1, string_length(value.as.string), stdout);
+        putchar('\n');
+        break;
+    default:
+        // SHOULD NOT HAPPEN?
+        fprintf(stderr, "Runtime Error: Cannot print invalid type\n");
+        break;
+    }
+}
+
+static int string_binary_op(Heap *heap, BinaryOp op, char *left, char *right, Value *result)
+{
+    switch (op)
+    {
+    case ADD:
+    {
+        size_t length = string_length(left) + string_length(right);
+        *result = STR_VALUE(string_concat(heap_alloc(heap, string_size(length)), left, right));
+        return SUCCESS;
+    }
+    case SUBTRACT:
+        fprintf(stderr, "Runtime Error: Cannot subtract strings.\n");
+        return FAILURE;
+    case MULTIPLY:
+        fprintf(stderr, "Runtime Error: Cannot multiply strings.\n");
+        return FAILURE;
+    case DIVIDE:
+        fprintf(stderr, "Runtime Error: Cannot divide strings.\n");
+        return FAILURE;
+    case IS_EQUAL:
+        *result = INT_VALUE(string_equals(left, right));
+        return SUCCESS;
+    case IS_LESS_THAN:
+        *result = INT_VALUE(string_compare(left, right) < 0);
+        return SUCCESS;
+    case LESS_THAN_EQUAL:
+        *result = INT_VALUE(string_compare(left, right) <= 0);
+        return SUCCESS;
+    case IS_GREATER_THAN:
+        *result = INT_VALUE(string_compare(left, right) > 0);
+        return SUCCESS;
+    case GREATER_THAN_EQUAL:
+        *result = INT_VALUE(string_compare(left, right) >= 0);
+        return SUCCESS;
+    case IS_NOT_EQUAL:
+        *result = INT_VALUE(!string_equals(left, right));
+        return SUCCESS;
+    default:
+        fprintf(stderr, "Runtime Error: Unsupported Binary Operation.\n");
+        return FAILURE;
+    }
+}
+
+static int int_binary_op(BinaryOp op, int left, int right, Value *result)
+{
+    switch (op)
+    {
+    case ADD:
+        *result = INT_VALUE(left + right);
+        return SUCCESS;
+    case SUBTRACT:
+        *result = INT_VALUE(left - right);
+        return SUCCESS;
+    case MULTIPLY:
+        *result = INT_VALUE(left * right);
+        return SUCCESS;
+    case DIVIDE:
+        if (right == 0)
+        {
+            fprintf(stderr, "Runtime Error: Division by zero.\n");
+            return FAILURE;
+        }
+        *result = INT_VALUE(left / right);
+        return SUCCESS;
+    case IS_EQUAL:
+        *result = INT_VALUE(left == right);
+        return SUCCESS;
+    case IS_LESS_THAN:
+        *result = INT_VALUE(left < right);
+        return SUCCESS;
+    case LESS_THAN_EQUAL:
+        *result = INT_VALUE(left <= right);
+        return SUCCESS;
+    case IS_GREATER_THAN:
+        *result = INT_VALUE(left > right);
+        return SUCCESS;
+    case GREATER_THAN_EQUAL:
+        *result = INT_VALUE(left >= right);
+        return SUCCESS;
+    case IS_NOT_EQUAL:
+        *result = INT_VALUE(left != right);
+        return SUCCESS;
+    default:
+        fprintf(stderr, "Runtime Error: Unsupported Binary Operation.\n");
+        return FAILURE;
+    }
+}
+
+// Applies a binary operator to two values. New strings are allocated on heap.
+// Returns FAILURE (after reporting the error) on type errors.
+int value_binary_op(Heap *heap, BinaryOp op, Value left, Value right, Value *result)
+{
+    if (left.type != right.type)
+    {
+        fprintf(stderr, "Runtime Error: Unsupported Binary Operation on two different types.\n");
+        return FAILURE;
+    }
+
+    switch (left.type)
+    {
+    case VAL_INT:
+        return int_binary_op(op, left.as.integer, right.as.integer, result);
+    case VAL_STR:
+        return string_binary_op(heap, op, left.as.string, right.as.string, result);
+    default:
+        fprintf(stderr, "Runtime Error: Unexpected type '%s'.\n", value_type_to_string(left.type));
+        return FAILURE;
+    }
+}
+
+// Runs "*slot = *slot + right" for a slot that is assigned its own value
+// plus something. Strings are appended in place when the slot owns a buffer
+// with room left; otherwise the sum gets a new buffer owned by the slot,
+// twice as large as needed, so building a string this way is amortized
+// linear instead of quadratic.
+int value_append(Heap *heap, Value *slot, Value right)
+{
+    Value left = *slot;
+    if (left.type != VAL_STR || right.type != VAL_STR)
+    {
+        return value_binary_op(heap, ADD, left, right, slot);
+    }
+
+    if (string_append(left.as.string, right.as.string, slot))
+    {
+        return SUCCESS;
+    }
+    size_t capacity = (string_length(left.as.string) + string_length(right.as.string)) * 2;
+    if (capacity < APPEND_MIN_CAPACITY)
+    {
+        capacity = APPEND_MIN_CAPACITY;
+    }
+    char *str = string_concat_owned(heap_alloc(heap, string_size(capacity)), capacity, left.as.string, right.as.string, slot);
+    *slot = STR_VALUE(str);
+    return SUCCESS;
+}
+
+// Runs "*slot = *slot + parts[0] + ... + parts[count - 1]", with every
+// part evaluated beforehand. Strings are appended one by one with
+// value_append(). With other types, or a later part that is the string
+// being appended to, the sum is computed as written instead: a failing
+// addition then reports the same error and leaves the slot unchanged.
+int value_append_all(Heap *heap, Value *slot, Value *parts, int count)
+{
+    if (count == 1)
+    {
+        return value_append(heap, slot, parts[0]);
+    }
+
+    int appendable = slot->type == VAL_STR;
+    for (int i = 0; i < count && appendable; i++)
+    {
+        appendable = parts[i].type == VAL_STR && (i == 0 || parts[i].as.string != slot->as.string);
+    }
+    if (appendable)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            value_append(heap, slot, parts[i]);
+        }
+        return SUCCESS;
+    }
+
+    Value sum = *slot;
+    for (int i = 0; i < count; i++)
+    {
+        if (value_binary_op(heap, ADD, sum, parts[i], &sum) == FAILURE)
+        {
+            return FAILURE;
+        }
+    }
+    *slot = sum;
+    if (sum.type == VAL_STR)
+    {
+        string_store(sum.as.string, slot);
+    }
+    return SUCCESS;
+}
+
+// Picks the specialized handler of op for the given operand types.
+// Operations that can only fail get the generic handler, which reports the error.
+BinaryHandler binary_handler_for(BinaryOp op, ValueType left, ValueType right)
+{
+    if (left != right)
+    {
+        return HANDLER_GENERIC;
+    }
+
+    if (left == VAL_STR)
+    {
+        switch (op)
+        {
+        case ADD:
+            return HANDLER_STR_ADD;
+        case SUBTRACT:
+        case MULTIPLY:
+        case DIVIDE:
+            return HANDLER_GENERIC;
+        default:
+            return HANDLER_STR_COMPARE;
+        }
+    }
+
+    switch (op)
+    {
+    case ADD:
+        return HANDLER_INT_ADD;
+    case SUBTRACT:
+        return HANDLER_INT_SUBTRACT;
+    case MULTIPLY:
+        return HANDLER_INT_MULTIPLY;
+    case DIVIDE:
+        return HANDLER_INT_DIVIDE;
+    case IS_EQUAL:
+        return HANDLER_INT_EQUAL;
+    case IS_LESS_THAN:
+        return HANDLER_INT_LESS;
+    case LESS_THAN_EQUAL:
+        return HANDLER_INT_LESS_EQUAL;
+    case IS_GREATER_THAN:
+        return HANDLER_INT_GREATER;
+    case GREATER_THAN_EQUAL:
+        return HANDLER_INT_GREATER_EQUAL;
+    case IS_NOT_EQUAL:
+        return HANDLER_INT_NOT_EQUAL;
+    default:
+        return HANDLER_GENERIC;
+    }
+}
+
+int value_unary_op(UnaryOp op, Value right, Value *result)
+{
+    if (right.type != VAL_INT)
+    {
+        fprintf(stderr, "Runtime Error: Unsupported Unary Operation on non-integer value.\n");
+        return FAILURE;
+    }
+
+    switch (op)
+    {
+    case NEGATE:
+        *result = INT_VALUE(0 - right.as.integer);
+        return SUCCESS;
+    case LOGICAL_NOT:
+        *result = INT_VALUE(!right.as.integer);
+        return SUCCESS;
+    default:
+        fprintf(stderr, "Runtime Error: Unsupported Unary Operation.\n");
+        return FAILURE;
+    }
+}
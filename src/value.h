@@ -0,0 +1,48 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include "arena.h"
+#include "parser.h"
+#include "str.h"
+
+#define FAILURE -1
+#define SUCCESS 0
+
+struct Heap;
+
+typedef enum ValueType
+{
+    VAL_INT,
+    VAL_STR,
+} ValueType;
+
+// A runtime value. Integers are stored inline, strings by pointer to the
+// chars of a String, see str.h.
+typedef struct Value
+{
+    ValueType type;
+    union
+    {
+        int integer;
+        char *string;
+    } as;
+} Value;
+
+#define INT_VALUE(value) ((Value){VAL_INT, {.integer = (value)}})
+#define STR_VALUE(value) ((Value){VAL_STR, {.string = (value)}})
+
+const char *value_type_to_string(ValueType type);
+
+int value_is_truthy(Value value);
+
+void print_value(Value value);
+
+int value_binary_op(struct Heap *heap, BinaryOp op, Value left, Value right, Value *result);
+int value_append(struct Heap *heap, Value *slot, Value right);
+int value_append_all(struct Heap *heap, Value *slot, Value *parts, int count);
+
+BinaryHandler binary_handler_for(BinaryOp op, ValueType left, ValueType right);
+
+int value_unary_op(UnaryOp op, Value right, Value *result);
+
+#endif // VALUE_H
\ No newline at end of file
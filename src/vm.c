@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vm.h"
+
+// GCC and Clang support taking the address of a label, which lets every
+// instruction jump straight to the next handler instead of going back
+// through a switch.
+#if defined(__GNUC__)
+#define USE_COMPUTED_GOTO 1
+#else
+#define USE_COMPUTED_GOTO 0
+#endif
+
+// Roots of the VM: the variables and the values on the stack.
+static void mark_vm(Heap *heap, void *context)
+{
+    VM *vm = (VM *)context;
+    heap_mark_values(heap, vm->slots, vm->slot_count);
+    heap_mark_values(heap, vm->stack, (int)(vm->stack_top - vm->stack));
+}
+
+VM *create_vm(Heap *heap)
+{
+    VM *vm = (VM *)malloc(sizeof(VM));
+    if (vm == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for VM.\n");
+        exit(EXIT_FAILURE);
+    }
+    vm->slots = NULL;
+    vm->slot_count = 0;
+    vm->stack_top = vm->stack;
+    vm->heap = heap;
+    heap_add_root(heap, mark_vm, vm);
+    return vm;
+}
+
+void free_vm(VM *vm)
+{
+    free(vm->slots);
+    free(vm);
+}
+
+// Grows the slot array to hold every variable of a chunk.
+static void reserve_slots(VM *vm, int slot_count)
+{
+    if (slot_count <= vm->slot_count)
+    {
+        return;
+    }
+
+    vm->slots = (Value *)realloc(vm->slots, slot_count * sizeof(Value));
+    if (vm->slots == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for VM->slots.\n");
+        exit(EXIT_FAILURE);
+    }
+    // Strings owned by the old slots can no longer be appended to in place.
+    for (int i = 0; i < vm->slot_count; i++)
+    {
+        if (vm->slots[i].type == VAL_STR)
+        {
+            string_store(vm->slots[i].as.string, NULL);
+        }
+    }
+    for (int i = vm->slot_count; i < slot_count; i++)
+    {
+        vm->slots[i] = INT_VALUE(-1);
+    }
+    vm->slot_count = slot_count;
+}
+
+// INT as in STATUS
+// 0 = good     !0 = bad
+int vm_run(VM *vm, Chunk *chunk)
+{
+    reserve_slots(vm, chunk->slot_count);
+
+    uint8_t *ip = chunk->code;
+    Value *sp = vm->stack;
+    Value *slots = vm->slots;
+    vm->stack_top = sp;
+
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+#define PUSH(value) (*sp++ = (value))
+#define POP() (*--sp)
+
+// Integer operands take the fast path, anything else goes through value_binary_op().
+#define BINARY_OP(c_op, ast_op)                                                     \
+    do                                                                              \
+    {                                                                               \
+        Value right = POP();                                                        \
+        Value left = POP();                                                         \
+        if (left.type == VAL_INT && right.type == VAL_INT)                          \
+        {                                                                           \
+            PUSH(INT_VALUE(left.as.integer c_op right.as.integer));                 \
+        }                                                                           \
+        else                                                                        \
+        {                                                                           \
+            Value result;                                                           \
+            if (value_binary_op(vm->heap, ast_op, left, right, &result) == FAILURE) \
+            {                                                                       \
+                goto runtime_error;                                                 \
+            }                                                                       \
+            PUSH(result);                                                           \
+        }                                                                           \
+    } while (0)
+
+#if USE_COMPUTED_GOTO
+    static void *dispatch_table[] = {
+        [OP_CONSTANT] = &&target_OP_CONSTANT,
+        [OP_ADD] = &&target_OP_ADD,
+        [OP_SUBTRACT] = &&target_OP_SUBTRACT,
+        [OP_MULTIPLY] = &&target_OP_MULTIPLY,
+        [OP_DIVIDE] = &&target_OP_DIVIDE,
+        [OP_EQUAL] = &&target_OP_EQUAL,
+        [OP_NOT_EQUAL] = &&target_OP_NOT_EQUAL,
+        [OP_LESS] = &&target_OP_LESS,
+        [OP_LESS_EQUAL] = &&target_OP_LESS_EQUAL,
+        [OP_GREATER] = &&target_OP_GREATER,
+        [OP_GREATER_EQUAL] = &&target_OP_GREATER_EQUAL,
+        [OP_NEGATE] = &&target_OP_NEGATE,
+        [OP_NOT] = &&target_OP_NOT,
+        [OP_GET] = &&target_OP_GET,
+        [OP_SET] = &&target_OP_SET,
+        [OP_APPEND] = &&target_OP_APPEND,
+        [OP_JUMP] = &&target_OP_JUMP,
+        [OP_JUMP_IF_FALSE] = &&target_OP_JUMP_IF_FALSE,
+        [OP_LOOP] = &&target_OP_LOOP,
+        [OP_JIT_LOOP] = &&target_OP_JIT_LOOP,
+        [OP_PRINT] = &&target_OP_PRINT,
+        [OP_HALT] = &&target_OP_HALT,
+    };
+#define DISPATCH() goto *dispatch_table[READ_BYTE()]
+#define TARGET(op) target_##op
+#else
+#define DISPATCH() goto dispatch
+#define TARGET(op) case op
+#endif
+
+    DISPATCH();
+
+#if !USE_COMPUTED_GOTO
+dispatch:
+    switch (READ_BYTE())
+    {
+#endif
+
+    TARGET(OP_CONSTANT):
+        PUSH(chunk->constants[READ_SHORT()]);
+        DISPATCH();
+
+    TARGET(OP_ADD):
+        BINARY_OP(+, ADD);
+        DISPATCH();
+
+    TARGET(OP_SUBTRACT):
+        BINARY_OP(-, SUBTRACT);
+        DISPATCH();
+
+    TARGET(OP_MULTIPLY):
+        BINARY_OP(*, MULTIPLY);
+        DISPATCH();
+
+    TARGET(OP_DIVIDE):
+    {
+        // Always take the slow path so division by zero is reported.
+        Value right = POP();
+        Value left = POP();
+        Value result;
+        if (value_binary_op(vm->heap, DIVIDE, left, right, &result) == FAILURE)
+        {
+            goto runtime_error;
+        }
+        PUSH(result);
+        DISPATCH();
+    }
+
+    TARGET(OP_EQUAL):
+        BINARY_OP(==, IS_EQUAL);
+        DISPATCH();
+
+    TARGET(OP_NOT_EQUAL):
+        BINARY_OP(!=, IS_NOT_EQUAL);
+        DISPATCH();
+
+    TARGET(OP_LESS):
+        BINARY_OP(<, IS_LESS_THAN);
+        DISPATCH();
+
+    TARGET(OP_LESS_EQUAL):
+        BINARY_OP(<=, LESS_THAN_EQUAL);
+        DISPATCH();
+
+    TARGET(OP_GREATER):
+        BINARY_OP(>, IS_GREATER_THAN);
+        DISPATCH();
+
+    TARGET(OP_GREATER_EQUAL):
+        BINARY_OP(>=, GREATER_THAN_EQUAL);
+        DISPATCH();
+
+    TARGET(OP_NEGATE):
+    {
+        Value right = POP();
+        Value result;
+        if (value_unary_op(NEGATE, right, &result) == FAILURE)
+        {
+            goto runtime_error;
+        }
+        PUSH(result);
+        DISPATCH();
+    }
+
+    TARGET(OP_NOT):
+    {
+        Value right = POP();
+        Value result;
+        if (value_unary_op(LOGICAL_NOT, right, &result) == FAILURE)
+        {
+            goto runtime_error;
+        }
+        PUSH(result);
+        DISPATCH();
+    }
+
+    TARGET(OP_GET):
+        PUSH(slots[READ_SHORT()]);
+        DISPATCH();
+
+    TARGET(OP_SET):
+    {
+        Value *slot = &slots[READ_SHORT()];
+        *slot = POP();
+        if (slot->type == VAL_STR)
+        {
+            string_store(slot->as.string, slot);
+        }
+        DISPATCH();
+    }
+
+    TARGET(OP_APPEND):
+    {
+        Value *slot = &slots[READ_SHORT()];
+        uint16_t count = READ_SHORT();
+        sp -= count;
+        if (count == 1 && slot->type == VAL_INT && sp->type == VAL_INT)
+        {
+            slot->as.integer += sp->as.integer;
+        }
+        else if (value_append_all(vm->heap, slot, sp, count) == FAILURE)
+        {
+            goto runtime_error;
+        }
+        DISPATCH();
+    }
+
+    TARGET(OP_JUMP):
+    {
+        uint16_t offset = READ_SHORT();
+        ip += offset;
+        DISPATCH();
+    }
+
+    TARGET(OP_JUMP_IF_FALSE):
+    {
+        uint16_t offset = READ_SHORT();
+        if (!value_is_truthy(POP()))
+        {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+
+    TARGET(OP_LOOP):
+    {
+        uint16_t offset = READ_SHORT();
+        ip -= offset;
+        // Safepoint: every live value is in a slot or on the stack.
+        if (heap_should_collect(vm->heap))
+        {
+            vm->stack_top = sp;
+            heap_collect(vm->heap, NULL, NULL);
+        }
+        DISPATCH();
+    }
+
+    TARGET(OP_JIT_LOOP):
+    {
+        JitSite *site = &chunk->jit_sites[READ_SHORT()];
+        uint16_t offset = READ_SHORT();
+        Value *variables[JIT_MAX_VARIABLES];
+        for (int i = 0; i < site->loop->variable_count; i++)
+        {
+            variables[i] = &slots[site->slots[i]];
+        }
+        if (jit_run_loop(site->loop, variables) == JIT_DONE)
+        {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+
+    TARGET(OP_PRINT):
+        print_value(POP());
+        DISPATCH();
+
+    TARGET(OP_HALT):
+        return SUCCESS;
+
+#if !USE_COMPUTED_GOTO
+    default:
+        fprintf(stderr, "Runtime Error: Unknown opcode %d!\n", ip[-1]);
+        goto runtime_error;
+    }
+#endif
+
+runtime_error:
+    return FAILURE;
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef PUSH
+#undef POP
+#undef BINARY_OP
+#undef DISPATCH
+#undef TARGET
+}
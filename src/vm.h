@@ -0,0 +1,27 @@
+#ifndef VM_H
+#define VM_H
+
+#include "bytecode.h"
+#include "gc.h"
+
+// VM executes chunks produced by compile().
+// Variable slots outlive a single run so a REPL session can keep its state.
+typedef struct VM
+{
+    Value stack[STACK_MAX];
+
+    // End of the stack at the last safepoint, marked by collections.
+    Value *stack_top;
+
+    Value *slots;
+    int slot_count;
+
+    // Strings built at runtime are allocated here.
+    Heap *heap;
+} VM;
+
+VM *create_vm(Heap *heap);
+void free_vm(VM *vm);
+int vm_run(VM *vm, Chunk *chunk);
+
+#endif // VM_H
\ No newline at end of file